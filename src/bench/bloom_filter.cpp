@@ -0,0 +1,76 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <bloom.h>
+#include <merkleblock.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <streams.h>
+
+namespace block_bench {
+#include <bench/data/block413567.raw.h>
+} // namespace block_bench
+
+// Serving a freshly announced block to many BIP37 peers: every peer asks for a merkleblock
+// against its own filter.
+static const int BLOOM_BENCH_PEERS = 16;
+
+static CBlock ReadBenchBlock()
+{
+    CDataStream stream((const char*)block_bench::block413567,
+            (const char*)block_bench::block413567 + sizeof(block_bench::block413567),
+            SER_NETWORK, PROTOCOL_VERSION);
+    CBlock block;
+    stream >> block;
+    return block;
+}
+
+static std::vector<CBloomFilter> MakePeerFilters()
+{
+    FastRandomContext rng(true);
+    std::vector<CBloomFilter> filters;
+    for (int i = 0; i < BLOOM_BENCH_PEERS; ++i) {
+        // BLOOM_UPDATE_NONE keeps the filters unchanged between iterations.
+        CBloomFilter filter(100, 0.0001, rng.rand32(), BLOOM_UPDATE_NONE);
+        for (int j = 0; j < 100; ++j) {
+            filter.insert(rng.randbytes(20));
+        }
+        filters.push_back(filter);
+    }
+    return filters;
+}
+
+static void BloomFilterMerkleBlock(benchmark::State& state)
+{
+    const CBlock block = ReadBenchBlock();
+    std::vector<CBloomFilter> filters = MakePeerFilters();
+
+    while (state.KeepRunning()) {
+        for (CBloomFilter& filter : filters) {
+            CMerkleBlock merkle_block(block, filter);
+        }
+    }
+}
+
+static void BloomFilterMerkleBlockPrepared(benchmark::State& state)
+{
+    const CBlock block = ReadBenchBlock();
+    std::vector<CBloomFilter> filters = MakePeerFilters();
+
+    while (state.KeepRunning()) {
+        std::vector<CBloomTxElements> block_elements;
+        block_elements.reserve(block.vtx.size());
+        for (const CTransactionRef& tx : block.vtx) {
+            block_elements.emplace_back(tx);
+        }
+        for (CBloomFilter& filter : filters) {
+            CMerkleBlock merkle_block(block, filter, block_elements);
+        }
+    }
+}
+
+BENCHMARK(BloomFilterMerkleBlock, 5);
+BENCHMARK(BloomFilterMerkleBlockPrepared, 5);
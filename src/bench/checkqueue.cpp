@@ -60,3 +60,35 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.join_all();
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+
+// This Benchmark tests the CheckQueue with many small batches of cheap checks,
+// as added by a block of mostly one- and two-input transactions, where the
+// overhead of handing out the checks dominates.
+static void CCheckQueueSpeedSmallBatches(benchmark::State& state)
+{
+    struct CounterJob {
+        uint64_t n{0};
+        bool operator()()
+        {
+            for (int i = 0; i < 100; i++) n = n * 6364136223846793005ULL + 1;
+            return true;
+        }
+        void swap(CounterJob& x) { std::swap(n, x.n); }
+    };
+    CCheckQueue<CounterJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()); ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<CounterJob> control(&queue);
+        for (size_t batch = 0; batch < 2000; ++batch) {
+            std::vector<CounterJob> vChecks(1 + batch % 2);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+BENCHMARK(CCheckQueueSpeedSmallBatches, 100);
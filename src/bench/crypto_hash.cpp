@@ -61,6 +61,35 @@ static void SHA256D64_1024(benchmark::State& state)
     }
 }
 
+/** 1024 transaction-sized messages, double-SHA256'd one by one and all at once. */
+static const size_t MULTI_MESSAGES = 1024;
+static const size_t MULTI_MESSAGE_SIZE = 250;
+
+static void SHA256D_1024x250b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(MULTI_MESSAGES * MULTI_MESSAGE_SIZE, 0);
+    std::vector<uint8_t> out(MULTI_MESSAGES * CHash256::OUTPUT_SIZE);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < MULTI_MESSAGES; i++) {
+            CHash256().Write(in.data() + i * MULTI_MESSAGE_SIZE, MULTI_MESSAGE_SIZE).Finalize(out.data() + i * CHash256::OUTPUT_SIZE);
+        }
+    }
+}
+
+static void SHA256DMulti_1024x250b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(MULTI_MESSAGES * MULTI_MESSAGE_SIZE, 0);
+    std::vector<uint8_t> out(MULTI_MESSAGES * CHash256::OUTPUT_SIZE);
+    std::vector<const unsigned char*> inputs;
+    for (size_t i = 0; i < MULTI_MESSAGES; i++) {
+        inputs.push_back(in.data() + i * MULTI_MESSAGE_SIZE);
+    }
+    const std::vector<size_t> lengths(MULTI_MESSAGES, MULTI_MESSAGE_SIZE);
+    while (state.KeepRunning()) {
+        SHA256DMulti(out.data(), inputs.data(), lengths.data(), MULTI_MESSAGES);
+    }
+}
+
 static void SHA512(benchmark::State& state)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -102,5 +131,7 @@ BENCHMARK(SHA512, 330);
 BENCHMARK(SHA256_32b, 4700 * 1000);
 BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
 BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(SHA256D_1024x250b, 2000);
+BENCHMARK(SHA256DMulti_1024x250b, 2000);
 BENCHMARK(FastRandom_32bit, 110 * 1000 * 1000);
 BENCHMARK(FastRandom_1bit, 440 * 1000 * 1000);
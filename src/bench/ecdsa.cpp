@@ -0,0 +1,53 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <hash.h>
+#include <key.h>
+#include <pubkey.h>
+
+#include <secp256k1.h>
+
+#include <cassert>
+#include <vector>
+
+// Building a verification context is what the precomputed ecmult tables cost at startup,
+// as every process that checks signatures does it once. It is next to free when the tables
+// are generated at build time (--enable-ecmult-static-verify-tables).
+static void ECDSAVerifyContextCreate(benchmark::State& state)
+{
+    while (state.KeepRunning()) {
+        secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+        assert(ctx != nullptr);
+        secp256k1_context_destroy(ctx);
+    }
+}
+
+// The signing context that ECC_Start sets up, which uses a table generated at build time.
+static void ECDSASignContextCreate(benchmark::State& state)
+{
+    while (state.KeepRunning()) {
+        ECC_Stop();
+        ECC_Start();
+    }
+}
+
+// Verification throughput, which depends on the window size of the tables (--with-ecmult-window).
+static void ECDSAVerify(benchmark::State& state)
+{
+    ECCVerifyHandle verify_handle;
+    CKey key;
+    key.MakeNewKey(true);
+    const CPubKey pubkey = key.GetPubKey();
+    const uint256 hash = Hash(pubkey.begin(), pubkey.end());
+    std::vector<unsigned char> sig;
+    assert(key.Sign(hash, sig));
+    while (state.KeepRunning()) {
+        assert(pubkey.Verify(hash, sig));
+    }
+}
+
+BENCHMARK(ECDSAVerifyContextCreate, 100);
+BENCHMARK(ECDSASignContextCreate, 1000);
+BENCHMARK(ECDSAVerify, 4000);
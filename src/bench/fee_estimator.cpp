@@ -0,0 +1,79 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/fees.h>
+#include <txmempool.h>
+
+#include <vector>
+
+static const size_t TXS_PER_BLOCK = 100;
+
+static std::vector<CTransactionRef> MakeTransactions()
+{
+    std::vector<CTransactionRef> txs;
+    for (size_t i = 0; i < TXS_PER_BLOCK; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = i;
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        txs.push_back(MakeTransactionRef(tx));
+    }
+    return txs;
+}
+
+/** Have the estimator see the transactions enter the mempool at height, and be mined in the next block. */
+static void ProcessBlock(CBlockPolicyEstimator& estimator, const std::vector<CTransactionRef>& txs, unsigned int& height)
+{
+    std::vector<CTxMemPoolEntry> entries;
+    entries.reserve(txs.size());
+    LockPoints lp;
+    for (size_t i = 0; i < txs.size(); i++) {
+        // Spread the feerates over a good part of the buckets.
+        const CAmount fee = 1000 + 1000 * (i % 50) * (i % 7 + 1);
+        entries.emplace_back(txs[i], fee, 0 /* nTime */, height, false /* spendsCoinbase */, 4 /* sigOpCost */, lp);
+        estimator.processTransaction(entries.back(), true /* validFeeEstimate */);
+    }
+    std::vector<const CTxMemPoolEntry*> block;
+    // Leave every fourth transaction unconfirmed, so that failures are tracked too.
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (i % 4 != 0) block.push_back(&entries[i]);
+    }
+    estimator.processBlock(++height, block);
+    for (size_t i = 0; i < entries.size(); i += 4) {
+        estimator.removeTx(entries[i].GetTx().GetHash(), false /* inBlock */);
+    }
+}
+
+static void FeeEstimatorProcessBlock(benchmark::State& state)
+{
+    CBlockPolicyEstimator estimator;
+    const std::vector<CTransactionRef> txs = MakeTransactions();
+    unsigned int height = 0;
+    while (state.KeepRunning()) {
+        ProcessBlock(estimator, txs, height);
+    }
+}
+
+static void FeeEstimatorEstimateSmartFee(benchmark::State& state)
+{
+    CBlockPolicyEstimator estimator;
+    const std::vector<CTransactionRef> txs = MakeTransactions();
+    unsigned int height = 0;
+    for (int i = 0; i < 200; i++) {
+        ProcessBlock(estimator, txs, height);
+    }
+    FeeCalculation fee_calc;
+    while (state.KeepRunning()) {
+        estimator.estimateSmartFee(2, &fee_calc, false /* conservative */);
+        estimator.estimateSmartFee(6, &fee_calc, false /* conservative */);
+        estimator.estimateSmartFee(24, &fee_calc, true /* conservative */);
+    }
+}
+
+BENCHMARK(FeeEstimatorProcessBlock, 1000);
+BENCHMARK(FeeEstimatorEstimateSmartFee, 100);
@@ -131,4 +131,73 @@ static void MempoolEviction(benchmark::State& state)
     }
 }
 
+/** Make count transactions of padded size, the first spending a confirmed output and each of
+ *  the others an output of the transaction parent_of(i) before it. */
+template <typename ParentOf>
+static std::vector<CTransactionRef> MakePackage(uint32_t seed, size_t count, ParentOf parent_of)
+{
+    std::vector<CTransactionRef> txs;
+    for (size_t i = 0; i < count; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        if (i == 0) {
+            tx.vin[0].prevout.n = seed;
+        } else {
+            tx.vin[0].prevout = COutPoint(txs[parent_of(i)]->GetHash(), i);
+        }
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(100, 0x51);
+        tx.vout.resize(count);
+        for (CTxOut& out : tx.vout) {
+            out.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            out.nValue = COIN;
+        }
+        txs.push_back(MakeTransactionRef(tx));
+    }
+    return txs;
+}
+
+/** Fill a mempool with packages of the given shape, then trim it to a quarter of its size. */
+template <typename ParentOf>
+static void MempoolEvictionPackages(benchmark::State& state, size_t packages, size_t package_size, ParentOf parent_of)
+{
+    std::vector<std::vector<CTransactionRef>> txs;
+    for (size_t i = 0; i < packages; i++) {
+        txs.push_back(MakePackage(i, package_size, parent_of));
+    }
+
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < txs.size(); i++) {
+            for (size_t j = 0; j < txs[i].size(); j++) {
+                // Vary the feerates between and within packages.
+                AddTx(txs[i][j], 1000 + 37 * ((i * 7 + j * 13) % 97), pool);
+            }
+        }
+        pool.TrimToSize(pool.DynamicMemoryUsage() / 4);
+        pool.clear();
+    }
+}
+
+// A spam wave of unrelated transactions
+static void MempoolEvictionSingles(benchmark::State& state)
+{
+    MempoolEvictionPackages(state, 1000, 1, [](size_t i) { return i - 1; });
+}
+
+// Chains of 25, the longest the default limits allow
+static void MempoolEvictionChains(benchmark::State& state)
+{
+    MempoolEvictionPackages(state, 40, 25, [](size_t i) { return i - 1; });
+}
+
+// A parent with 24 children each, as in batched payouts spent by their recipients
+static void MempoolEvictionFanOut(benchmark::State& state)
+{
+    MempoolEvictionPackages(state, 40, 25, [](size_t) { return size_t{0}; });
+}
+
 BENCHMARK(MempoolEviction, 41000);
+BENCHMARK(MempoolEvictionSingles, 10);
+BENCHMARK(MempoolEvictionChains, 10);
+BENCHMARK(MempoolEvictionFanOut, 10);
@@ -0,0 +1,61 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <primitives/transaction.h>
+#include <pubkey.h>
+#include <script/interpreter.h>
+#include <script/standard.h>
+
+/** A consolidation of many P2PKH outputs, with signature-sized scriptSigs. */
+static CTransaction BuildConsolidation(uint32_t inputs)
+{
+    CMutableTransaction mtx;
+    for (uint32_t i = 0; i < inputs; i++) {
+        mtx.vin.emplace_back(COutPoint(uint256(), i));
+        mtx.vin.back().scriptSig = CScript() << std::vector<unsigned char>(72) << std::vector<unsigned char>(33);
+    }
+    mtx.vout.emplace_back(1000 * inputs, GetScriptForDestination(CKeyID()));
+    return CTransaction(mtx);
+}
+
+static const uint32_t INPUTS = 5000;
+// Hashing every input of the transaction takes seconds, so a spread of them is
+// hashed per iteration.
+static const uint32_t INPUTS_HASHED = 50;
+
+static void SighashLegacy(benchmark::State& state, bool precompute)
+{
+    const CTransaction tx = BuildConsolidation(INPUTS);
+    const CScript scriptCode = GetScriptForDestination(CKeyID());
+    const PrecomputedTransactionData txdata(tx);
+    assert(txdata.m_legacy_ready);
+    while (state.KeepRunning()) {
+        for (uint32_t i = 0; i < INPUTS_HASHED; i++) {
+            SignatureHash(scriptCode, tx, i * (INPUTS / INPUTS_HASHED), SIGHASH_ALL, 0, SigVersion::BASE, precompute ? &txdata : nullptr);
+        }
+    }
+}
+
+static void SighashLegacy5000Inputs(benchmark::State& state)
+{
+    SighashLegacy(state, false);
+}
+
+static void SighashLegacy5000InputsPrecomputed(benchmark::State& state)
+{
+    SighashLegacy(state, true);
+}
+
+static void PrecomputeSighash5000Inputs(benchmark::State& state)
+{
+    const CTransaction tx = BuildConsolidation(INPUTS);
+    while (state.KeepRunning()) {
+        PrecomputedTransactionData txdata(tx);
+    }
+}
+
+BENCHMARK(SighashLegacy5000Inputs, 5);
+BENCHMARK(SighashLegacy5000InputsPrecomputed, 5);
+BENCHMARK(PrecomputeSighash5000Inputs, 50);
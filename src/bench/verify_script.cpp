@@ -49,8 +49,74 @@ static CMutableTransaction BuildSpendingTransaction(const CScript& scriptSig, co
     return txSpend;
 }
 
-// Microbenchmark for verification of a basic P2WPKH script. Can be easily
-// modified to measure performance of other types of scripts.
+static CKey BenchKey(unsigned char n)
+{
+    std::array<unsigned char, 32> vchKey{};
+    vchKey[31] = n;
+    CKey key;
+    key.Set(vchKey.begin(), vchKey.end(), true);
+    return key;
+}
+
+static std::vector<unsigned char> BenchSign(const CKey& key, const uint256& hash)
+{
+    std::vector<unsigned char> sig;
+    key.Sign(hash, sig);
+    sig.push_back(static_cast<unsigned char>(SIGHASH_ALL));
+    return sig;
+}
+
+/** Takes every signature to be valid, to measure the interpreter without ECDSA. */
+class AcceptingSignatureChecker : public BaseSignatureChecker
+{
+public:
+    bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode, SigVersion sigversion) const override
+    {
+        return true;
+    }
+};
+
+// Verify the spend of txCredit's output by txSpend, with the script interpreter and
+// the consensus library if it is built, or only the interpreter without checking
+// signatures.
+static void VerifySpendBench(benchmark::State& state, const CMutableTransaction& txCredit, const CMutableTransaction& txSpend, int flags, bool check_signatures = true)
+{
+    if (!check_signatures) {
+        const AcceptingSignatureChecker checker;
+        while (state.KeepRunning()) {
+            ScriptError err;
+            bool success = VerifyScript(txSpend.vin[0].scriptSig, txCredit.vout[0].scriptPubKey, &txSpend.vin[0].scriptWitness, flags, checker, &err);
+            assert(err == SCRIPT_ERR_OK);
+            assert(success);
+        }
+        return;
+    }
+    while (state.KeepRunning()) {
+        ScriptError err;
+        bool success = VerifyScript(
+            txSpend.vin[0].scriptSig,
+            txCredit.vout[0].scriptPubKey,
+            &txSpend.vin[0].scriptWitness,
+            flags,
+            MutableTransactionSignatureChecker(&txSpend, 0, txCredit.vout[0].nValue),
+            &err);
+        assert(err == SCRIPT_ERR_OK);
+        assert(success);
+
+#if defined(HAVE_CONSENSUS_LIB)
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << txSpend;
+        int csuccess = bitcoinconsensus_verify_script_with_amount(
+            txCredit.vout[0].scriptPubKey.data(),
+            txCredit.vout[0].scriptPubKey.size(),
+            txCredit.vout[0].nValue,
+            (const unsigned char*)stream.data(), stream.size(), 0, flags, nullptr);
+        assert(csuccess == 1);
+#endif
+    }
+}
+
+// Microbenchmark for verification of a basic P2WPKH script.
 static void VerifyScriptBench(benchmark::State& state)
 {
     const int flags = SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_P2SH;
@@ -81,29 +147,56 @@ static void VerifyScriptBench(benchmark::State& state)
     witness.stack.push_back(ToByteVector(pubkey));
 
     // Benchmark.
-    while (state.KeepRunning()) {
-        ScriptError err;
-        bool success = VerifyScript(
-            txSpend.vin[0].scriptSig,
-            txCredit.vout[0].scriptPubKey,
-            &txSpend.vin[0].scriptWitness,
-            flags,
-            MutableTransactionSignatureChecker(&txSpend, 0, txCredit.vout[0].nValue),
-            &err);
-        assert(err == SCRIPT_ERR_OK);
-        assert(success);
+    VerifySpendBench(state, txCredit, txSpend, flags);
+}
 
-#if defined(HAVE_CONSENSUS_LIB)
-        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-        stream << txSpend;
-        int csuccess = bitcoinconsensus_verify_script_with_amount(
-            txCredit.vout[0].scriptPubKey.data(),
-            txCredit.vout[0].scriptPubKey.size(),
-            txCredit.vout[0].nValue,
-            (const unsigned char*)stream.data(), stream.size(), 0, flags, nullptr);
-        assert(csuccess == 1);
-#endif
+static void VerifyScriptP2PKH(benchmark::State& state)
+{
+    const CKey key = BenchKey(1);
+    const CPubKey pubkey = key.GetPubKey();
+    const CMutableTransaction txCredit = BuildCreditingTransaction(GetScriptForDestination(pubkey.GetID()));
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), txCredit);
+    const uint256 hash = SignatureHash(txCredit.vout[0].scriptPubKey, txSpend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    txSpend.vin[0].scriptSig = CScript() << BenchSign(key, hash) << ToByteVector(pubkey);
+
+    VerifySpendBench(state, txCredit, txSpend, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG);
+}
+
+// 2-of-3 multisig, as P2SH or P2WSH
+static void VerifyScriptMultisig(benchmark::State& state, bool witness, bool check_signatures = true)
+{
+    const std::vector<CKey> keys = {BenchKey(1), BenchKey(2), BenchKey(3)};
+    const CScript multisig = GetScriptForMultisig(2, {keys[0].GetPubKey(), keys[1].GetPubKey(), keys[2].GetPubKey()});
+    const CScript scriptPubKey = witness ? GetScriptForDestination(WitnessV0ScriptHash(multisig)) : GetScriptForDestination(CScriptID(multisig));
+    const CMutableTransaction txCredit = BuildCreditingTransaction(scriptPubKey);
+    CMutableTransaction txSpend = BuildSpendingTransaction(CScript(), txCredit);
+    const uint256 hash = SignatureHash(multisig, txSpend, 0, SIGHASH_ALL, txCredit.vout[0].nValue, witness ? SigVersion::WITNESS_V0 : SigVersion::BASE);
+    if (witness) {
+        txSpend.vin[0].scriptWitness.stack = {{}, BenchSign(keys[0], hash), BenchSign(keys[2], hash), ToByteVector(multisig)};
+    } else {
+        txSpend.vin[0].scriptSig = CScript() << OP_0 << BenchSign(keys[0], hash) << BenchSign(keys[2], hash) << ToByteVector(multisig);
     }
+
+    VerifySpendBench(state, txCredit, txSpend, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_DERSIG | SCRIPT_VERIFY_NULLDUMMY, check_signatures);
+}
+
+static void VerifyScriptP2SHMultisig(benchmark::State& state)
+{
+    VerifyScriptMultisig(state, false);
+}
+
+static void VerifyScriptP2WSHMultisig(benchmark::State& state)
+{
+    VerifyScriptMultisig(state, true);
+}
+
+static void VerifyScriptP2SHMultisigNoECDSA(benchmark::State& state)
+{
+    VerifyScriptMultisig(state, false, false);
 }
 
 BENCHMARK(VerifyScriptBench, 6300);
+BENCHMARK(VerifyScriptP2PKH, 6300);
+BENCHMARK(VerifyScriptP2SHMultisig, 3000);
+BENCHMARK(VerifyScriptP2WSHMultisig, 3000);
+BENCHMARK(VerifyScriptP2SHMultisigNoECDSA, 300000);
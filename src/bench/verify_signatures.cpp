@@ -0,0 +1,77 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <key.h>
+#include <keystore.h>
+#include <script/sigcache.h>
+#include <script/sign.h>
+#include <script/standard.h>
+#include <validation.h>
+
+#include <vector>
+
+static const uint32_t INPUTS = 100;
+
+/** A transaction spending P2PKH outputs of as many keys as it has inputs, and its script checks. */
+struct SignedTransaction {
+    std::vector<CTxOut> outs;
+    CTransaction tx;
+    PrecomputedTransactionData txdata;
+
+    static CMutableTransaction Build(std::vector<CTxOut>& outs)
+    {
+        CMutableTransaction mtx;
+        CBasicKeyStore keystore;
+        for (uint32_t i = 0; i < INPUTS; i++) {
+            CKey key;
+            key.MakeNewKey(true);
+            keystore.AddKey(key);
+            outs.emplace_back(1000, GetScriptForDestination(key.GetPubKey().GetID()));
+            mtx.vin.emplace_back(COutPoint(uint256(), i));
+        }
+        mtx.vout.emplace_back(1000 * INPUTS, CScript() << OP_1);
+        for (uint32_t i = 0; i < INPUTS; i++) {
+            SignSignature(keystore, outs[i].scriptPubKey, mtx, i, 1000, SIGHASH_ALL);
+        }
+        return mtx;
+    }
+
+    SignedTransaction() : tx(Build(outs)), txdata(tx)
+    {
+        InitSignatureCache();
+    }
+
+    std::vector<CScriptCheck> Checks()
+    {
+        std::vector<CScriptCheck> checks;
+        for (uint32_t i = 0; i < INPUTS; i++) {
+            checks.emplace_back(outs[i], tx, i, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC, false, &txdata);
+        }
+        return checks;
+    }
+};
+
+static void VerifyScriptChecksOneByOne(benchmark::State& state)
+{
+    SignedTransaction signed_tx;
+    std::vector<CScriptCheck> checks = signed_tx.Checks();
+    while (state.KeepRunning()) {
+        for (CScriptCheck& check : checks) {
+            assert(check());
+        }
+    }
+}
+
+static void VerifyScriptChecksBatch(benchmark::State& state)
+{
+    SignedTransaction signed_tx;
+    std::vector<CScriptCheck> checks = signed_tx.Checks();
+    while (state.KeepRunning()) {
+        assert(RunChecks(checks));
+    }
+}
+
+BENCHMARK(VerifyScriptChecksOneByOne, 5);
+BENCHMARK(VerifyScriptChecksBatch, 5);
@@ -18,6 +18,48 @@
 #define LN2SQUARED 0.4804530139182014246671025263266649717305529515945455
 #define LN2 0.6931471805599453094172321214581765680755001343602552
 
+/** Number of hash functions evaluated together when looking up a prepared element. */
+static const unsigned int BLOOM_HASH_LANES = 4;
+
+static std::vector<MurmurHash3Prepared> PrepareScriptPushes(const CScript& script)
+{
+    std::vector<MurmurHash3Prepared> pushes;
+    CScript::const_iterator pc = script.begin();
+    std::vector<unsigned char> data;
+    while (pc < script.end())
+    {
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode, data))
+            break;
+        if (data.size() != 0)
+            pushes.emplace_back(data);
+    }
+    return pushes;
+}
+
+static std::vector<unsigned char> SerializeOutPoint(const COutPoint& outpoint)
+{
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << outpoint;
+    return std::vector<unsigned char>(stream.begin(), stream.end());
+}
+
+CBloomTxElements::CBloomTxElements(const CTransactionRef& txIn) :
+    tx(txIn),
+    txid(std::vector<unsigned char>(txIn->GetHash().begin(), txIn->GetHash().end()))
+{
+    vout_pushes.reserve(tx->vout.size());
+    for (const CTxOut& txout : tx->vout) {
+        vout_pushes.push_back(PrepareScriptPushes(txout.scriptPubKey));
+    }
+    vin_prevouts.reserve(tx->vin.size());
+    vin_pushes.reserve(tx->vin.size());
+    for (const CTxIn& txin : tx->vin) {
+        vin_prevouts.emplace_back(SerializeOutPoint(txin.prevout));
+        vin_pushes.push_back(PrepareScriptPushes(txin.scriptSig));
+    }
+}
+
 CBloomFilter::CBloomFilter(const unsigned int nElements, const double nFPRate, const unsigned int nTweakIn, unsigned char nFlagsIn) :
     /**
      * The ideal size for a bloom filter with a given number of elements and false positive rate is:
@@ -101,6 +143,31 @@ bool CBloomFilter::contains(const uint256& hash) const
     return contains(data);
 }
 
+bool CBloomFilter::contains(const MurmurHash3Prepared& element) const
+{
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    uint32_t seeds[BLOOM_HASH_LANES];
+    uint32_t hashes[BLOOM_HASH_LANES];
+    for (unsigned int i = 0; i < nHashFuncs; i += BLOOM_HASH_LANES)
+    {
+        const unsigned int n = std::min(BLOOM_HASH_LANES, nHashFuncs - i);
+        for (unsigned int j = 0; j < n; j++) {
+            // Same seeds as Hash()
+            seeds[j] = (i + j) * 0xFBA4C795 + nTweak;
+        }
+        element.Hash(seeds, hashes, n);
+        for (unsigned int j = 0; j < n; j++) {
+            unsigned int nIndex = hashes[j] % (vData.size() * 8);
+            if (!(vData[nIndex >> 3] & (1 << (7 & nIndex))))
+                return false;
+        }
+    }
+    return true;
+}
+
 void CBloomFilter::clear()
 {
     vData.assign(vData.size(),0);
@@ -189,6 +256,59 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx)
     return false;
 }
 
+bool CBloomFilter::IsRelevantAndUpdate(const CBloomTxElements& elements)
+{
+    // Mirrors IsRelevantAndUpdate(const CTransaction&) above, including the order in which
+    // matched outpoints are inserted, so both return the same result and leave the same filter.
+    bool fFound = false;
+    if (isFull)
+        return true;
+    if (isEmpty)
+        return false;
+    const CTransaction& tx = *elements.tx;
+    const uint256& hash = tx.GetHash();
+    if (contains(elements.txid))
+        fFound = true;
+
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    {
+        for (const MurmurHash3Prepared& data : elements.vout_pushes[i])
+        {
+            if (contains(data))
+            {
+                fFound = true;
+                if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL)
+                    insert(COutPoint(hash, i));
+                else if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY)
+                {
+                    std::vector<std::vector<unsigned char> > vSolutions;
+                    txnouttype type = Solver(tx.vout[i].scriptPubKey, vSolutions);
+                    if (type == TX_PUBKEY || type == TX_MULTISIG) {
+                        insert(COutPoint(hash, i));
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    if (fFound)
+        return true;
+
+    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    {
+        if (contains(elements.vin_prevouts[i]))
+            return true;
+        for (const MurmurHash3Prepared& data : elements.vin_pushes[i])
+        {
+            if (contains(data))
+                return true;
+        }
+    }
+
+    return false;
+}
+
 void CBloomFilter::UpdateEmptyFull()
 {
     bool full = true;
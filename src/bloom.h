@@ -5,12 +5,12 @@
 #ifndef BITCOIN_BLOOM_H
 #define BITCOIN_BLOOM_H
 
+#include <hash.h>
+#include <primitives/transaction.h>
 #include <serialize.h>
 
 #include <vector>
 
-class COutPoint;
-class CTransaction;
 class uint256;
 
 //! 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%
@@ -30,6 +30,27 @@ enum bloomflags
     BLOOM_UPDATE_MASK = 3,
 };
 
+/**
+ * The data elements of a transaction that CBloomFilter::IsRelevantAndUpdate looks up: its txid, the
+ * pushdata of every output and input script and the outpoints it spends. Scripts are parsed and
+ * hash inputs prepared once, so the same transaction can be matched against the filters of many
+ * BIP37 peers without repeating that work for each of them.
+ */
+class CBloomTxElements
+{
+public:
+    const CTransactionRef tx;
+    const MurmurHash3Prepared txid;
+    //! Non-empty pushdata of each output's scriptPubKey, in script order
+    std::vector<std::vector<MurmurHash3Prepared>> vout_pushes;
+    //! Serialized prevout of each input
+    std::vector<MurmurHash3Prepared> vin_prevouts;
+    //! Non-empty pushdata of each input's scriptSig, in script order
+    std::vector<std::vector<MurmurHash3Prepared>> vin_pushes;
+
+    explicit CBloomTxElements(const CTransactionRef& txIn);
+};
+
 /**
  * BloomFilter is a probabilistic filter which SPV clients provide
  * so that we can filter the transactions we send them.
@@ -83,6 +104,7 @@ public:
     bool contains(const std::vector<unsigned char>& vKey) const;
     bool contains(const COutPoint& outpoint) const;
     bool contains(const uint256& hash) const;
+    bool contains(const MurmurHash3Prepared& element) const;
 
     void clear();
     void reset(const unsigned int nNewTweak);
@@ -94,6 +116,9 @@ public:
     //! Also adds any outputs which match the filter to the filter (to match their spending txes)
     bool IsRelevantAndUpdate(const CTransaction& tx);
 
+    //! Same as IsRelevantAndUpdate(tx), but matches data that was extracted from tx in advance
+    bool IsRelevantAndUpdate(const CBloomTxElements& elements);
+
     //! Checks for empty and full filters to avoid wasting cpu
     void UpdateEmptyFull();
 };
@@ -16,6 +16,20 @@
 template <typename T>
 class CCheckQueueControl;
 
+/**
+ * Run a batch of checks taken from a CCheckQueue, returning whether they all pass.
+ * Types of checks that are faster to do many at a time overload this for vectors
+ * of them, to be found by argument-dependent lookup.
+ */
+template <typename T>
+bool RunChecks(std::vector<T>& vChecks)
+{
+    for (T& check : vChecks) {
+        if (!check()) return false;
+    }
+    return true;
+}
+
 /**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -116,9 +130,8 @@ private:
                 fOk = fAllOk;
             }
             // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
+            if (fOk)
+                fOk = RunChecks(vChecks);
             vChecks.clear();
         } while (true);
     }
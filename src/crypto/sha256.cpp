@@ -24,11 +24,21 @@ namespace sha256d64_sse41
 void Transform_4way(unsigned char* out, const unsigned char* in);
 }
 
+namespace sha256_sse41
+{
+void Transform_4way(uint32_t* s, const unsigned char* const* chunks);
+}
+
 namespace sha256d64_avx2
 {
 void Transform_8way(unsigned char* out, const unsigned char* in);
 }
 
+namespace sha256_avx2
+{
+void Transform_8way(uint32_t* s, const unsigned char* const* chunks);
+}
+
 namespace sha256d64_shani
 {
 void Transform_2way(unsigned char* out, const unsigned char* in);
@@ -37,6 +47,7 @@ void Transform_2way(unsigned char* out, const unsigned char* in);
 namespace sha256_shani
 {
 void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+void Transform_2way(uint32_t* s, const unsigned char* const* chunks);
 }
 
 // Internal implementation code.
@@ -416,6 +427,11 @@ void TransformD64(unsigned char* out, const unsigned char* in)
 
 typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
 typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+/** Transforms one block of each of several lanes, whose states are stored one after the other. */
+typedef void (*TransformMultiType)(uint32_t*, const unsigned char* const*);
+
+/** The most lanes a TransformMulti has. */
+const size_t MAX_TRANSFORM_LANES = 8;
 
 template<TransformType tr>
 void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
@@ -461,6 +477,72 @@ TransformD64Type TransformD64 = sha256::TransformD64;
 TransformD64Type TransformD64_2way = nullptr;
 TransformD64Type TransformD64_4way = nullptr;
 TransformD64Type TransformD64_8way = nullptr;
+TransformMultiType TransformMulti = nullptr;
+size_t TransformMultiLanes = 1;
+
+/** A message being double-SHA256'd in a lane of SHA256DMulti. */
+struct LaneJob
+{
+    //! Where the next block is, while there are full blocks of the message left
+    const unsigned char* data;
+    size_t full_blocks;
+    //! The padded end of the message, or, in the second pass, the padded first hash
+    unsigned char tail[128];
+    size_t tail_blocks;
+    size_t tail_pos;
+    bool second_pass;
+    unsigned char* out;
+
+    void Start(uint32_t* s, const unsigned char* in, size_t len, unsigned char* outIn)
+    {
+        sha256::Initialize(s);
+        data = in;
+        full_blocks = len / 64;
+        const size_t rem = len % 64;
+        tail_blocks = rem + 9 <= 64 ? 1 : 2;
+        memcpy(tail, in + 64 * full_blocks, rem);
+        tail[rem] = 0x80;
+        memset(tail + rem + 1, 0, 64 * tail_blocks - rem - 9);
+        WriteBE64(tail + 64 * tail_blocks - 8, ((uint64_t)len) << 3);
+        tail_pos = 0;
+        second_pass = false;
+        out = outIn;
+    }
+
+    const unsigned char* Next() const
+    {
+        return full_blocks ? data : tail + 64 * tail_pos;
+    }
+
+    /** Move past the block that was just transformed into s. Returns true once the message is done. */
+    bool Advance(uint32_t* s)
+    {
+        if (full_blocks) {
+            data += 64;
+            --full_blocks;
+        } else {
+            ++tail_pos;
+        }
+        if (full_blocks || tail_pos < tail_blocks) return false;
+        if (!second_pass) {
+            for (int i = 0; i < 8; i++) {
+                WriteBE32(tail + 4 * i, s[i]);
+            }
+            tail[32] = 0x80;
+            memset(tail + 33, 0, 23);
+            WriteBE64(tail + 56, 256);
+            tail_blocks = 1;
+            tail_pos = 0;
+            second_pass = true;
+            sha256::Initialize(s);
+            return false;
+        }
+        for (int i = 0; i < 8; i++) {
+            WriteBE32(out + 4 * i, s[i]);
+        }
+        return true;
+    }
+};
 
 bool SelfTest() {
     // Input state (equal to the initial SHA256 state)
@@ -544,6 +626,20 @@ bool SelfTest() {
         if (!std::equal(out, out + 256, result_d64)) return false;
     }
 
+    // Test TransformMulti, if available, with lane i transforming the i+1'th block.
+    if (TransformMulti) {
+        uint32_t states[8 * MAX_TRANSFORM_LANES];
+        const unsigned char* chunks[MAX_TRANSFORM_LANES];
+        for (size_t i = 0; i < TransformMultiLanes; ++i) {
+            std::copy(result[i], result[i] + 8, states + 8 * i);
+            chunks[i] = data + 1 + 64 * i;
+        }
+        TransformMulti(states, chunks);
+        for (size_t i = 0; i < TransformMultiLanes; ++i) {
+            if (!std::equal(states + 8 * i, states + 8 * i + 8, result[i + 1])) return false;
+        }
+    }
+
     return true;
 }
 
@@ -608,6 +704,8 @@ std::string SHA256AutoDetect()
         Transform = sha256_shani::Transform;
         TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
         TransformD64_2way = sha256d64_shani::Transform_2way;
+        TransformMulti = sha256_shani::Transform_2way;
+        TransformMultiLanes = 2;
         ret = "shani(1way,2way)";
         have_sse4 = false; // Disable SSE4/AVX2;
         have_avx2 = false;
@@ -622,6 +720,8 @@ std::string SHA256AutoDetect()
 #endif
 #if defined(ENABLE_SSE41) && !defined(BUILD_BITCOIN_INTERNAL)
         TransformD64_4way = sha256d64_sse41::Transform_4way;
+        TransformMulti = sha256_sse41::Transform_4way;
+        TransformMultiLanes = 4;
         ret += ",sse41(4way)";
 #endif
     }
@@ -629,6 +729,8 @@ std::string SHA256AutoDetect()
 #if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
     if (have_avx2 && have_avx && enabled_avx) {
         TransformD64_8way = sha256d64_avx2::Transform_8way;
+        TransformMulti = sha256_avx2::Transform_8way;
+        TransformMultiLanes = 8;
         ret += ",avx2(8way)";
     }
 #endif
@@ -728,3 +830,55 @@ void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
         --blocks;
     }
 }
+
+void SHA256DMulti(unsigned char* out, const unsigned char* const* in, const size_t* lengths, size_t count)
+{
+    const size_t lanes = TransformMulti ? TransformMultiLanes : 1;
+    uint32_t states[8 * MAX_TRANSFORM_LANES];
+    LaneJob jobs[MAX_TRANSFORM_LANES];
+    bool busy[MAX_TRANSFORM_LANES];
+    const unsigned char* chunks[MAX_TRANSFORM_LANES];
+    static const unsigned char idle_block[64] = {0};
+
+    // Every lane takes the next message as soon as it is done with one.
+    size_t next = 0;
+    size_t active = 0;
+    for (size_t lane = 0; lane < lanes; lane++) {
+        busy[lane] = next < count;
+        if (busy[lane]) {
+            jobs[lane].Start(states + 8 * lane, in[next], lengths[next], out + 32 * next);
+            ++next;
+            ++active;
+        }
+    }
+    while (active > 1) {
+        for (size_t lane = 0; lane < lanes; lane++) {
+            chunks[lane] = busy[lane] ? jobs[lane].Next() : idle_block;
+        }
+        TransformMulti(states, chunks);
+        for (size_t lane = 0; lane < lanes; lane++) {
+            if (!busy[lane] || !jobs[lane].Advance(states + 8 * lane)) continue;
+            if (next < count) {
+                jobs[lane].Start(states + 8 * lane, in[next], lengths[next], out + 32 * next);
+                ++next;
+            } else {
+                busy[lane] = false;
+                --active;
+            }
+        }
+    }
+
+    // Without multi-way transforms, or once a single message is left, go one block at a time.
+    for (size_t lane = 0; lane < lanes; lane++) {
+        while (busy[lane]) {
+            Transform(states + 8 * lane, jobs[lane].Next(), 1);
+            if (!jobs[lane].Advance(states + 8 * lane)) continue;
+            if (next < count) {
+                jobs[lane].Start(states + 8 * lane, in[next], lengths[next], out + 32 * next);
+                ++next;
+            } else {
+                busy[lane] = false;
+            }
+        }
+    }
+}
@@ -38,4 +38,13 @@ std::string SHA256AutoDetect();
  */
 void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
 
+/** Compute the double-SHA256's of multiple messages of any length, several at a time
+ *  where the CPU allows.
+ *  output:  pointer to a count*32 byte output buffer
+ *  inputs:  pointers to the messages
+ *  lengths: the lengths of the messages
+ *  count:   the number of messages
+ */
+void SHA256DMulti(unsigned char* output, const unsigned char* const* inputs, const size_t* lengths, size_t count);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
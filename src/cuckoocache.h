@@ -387,9 +387,10 @@ public:
      * @post one of the following: All previously inserted elements and e are
      * now in the table, one previously inserted element is evicted from the
      * table, the entry attempted to be inserted is evicted.
+     * @returns false if an element was evicted, true otherwise
      *
      */
-    inline void insert(Element e)
+    inline bool insert(Element e)
     {
         epoch_check();
         uint32_t last_loc = invalid();
@@ -401,7 +402,7 @@ public:
             if (table[loc] == e) {
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
-                return;
+                return true;
             }
         for (uint8_t depth = 0; depth < depth_limit; ++depth) {
             // First try to insert to an empty slot, if one exists
@@ -411,7 +412,7 @@ public:
                 table[loc] = std::move(e);
                 please_keep(loc);
                 epoch_flags[loc] = last_epoch;
-                return;
+                return true;
             }
             /** Swap with the element at the location that was
             * not the last one looked at. Example:
@@ -437,6 +438,7 @@ public:
             // Recompute the locs -- unfortunately happens one too many times!
             locs = compute_hashes(e);
         }
+        return false;
     }
 
     /* contains iterates through the hash locations for a given element
@@ -475,6 +477,34 @@ public:
             }
         return false;
     }
+
+    /** capacity returns the number of slots in the table, as returned by setup. */
+    uint32_t capacity() const
+    {
+        return size;
+    }
+
+    /** count_live returns the number of elements that are neither erased nor
+     * garbage collected. It scans the whole table, so it is linear in the size.
+     */
+    uint32_t count_live() const
+    {
+        uint32_t count = 0;
+        for (uint32_t i = 0; i < size; ++i)
+            count += !collection_flags.bit_is_set(i);
+        return count;
+    }
+
+    /** for_each_live calls fn on each element that is neither erased nor
+     * garbage collected, in table order.
+     */
+    template <typename Callable>
+    void for_each_live(Callable fn) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                fn(table[i]);
+    }
 };
 } // namespace CuckooCache
 
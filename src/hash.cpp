@@ -68,6 +68,77 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
     return h1;
 }
 
+static inline uint32_t MurmurHash3MixBlock(uint32_t k1)
+{
+    k1 *= 0xcc9e2d51;
+    k1 = ROTL32(k1, 15);
+    k1 *= 0x1b873593;
+    return k1;
+}
+
+static inline uint32_t MurmurHash3Finalize(uint32_t h1, uint32_t size)
+{
+    h1 ^= size;
+    h1 ^= h1 >> 16;
+    h1 *= 0x85ebca6b;
+    h1 ^= h1 >> 13;
+    h1 *= 0xc2b2ae35;
+    h1 ^= h1 >> 16;
+    return h1;
+}
+
+MurmurHash3Prepared::MurmurHash3Prepared(const std::vector<unsigned char>& vDataToHash) :
+    m_tail(0), m_size(vDataToHash.size())
+{
+    const size_t nblocks = vDataToHash.size() / 4;
+    m_blocks.reserve(nblocks);
+    for (size_t i = 0; i < nblocks; ++i) {
+        m_blocks.push_back(MurmurHash3MixBlock(ReadLE32(vDataToHash.data() + i * 4)));
+    }
+
+    // A missing tail mixes to zero, which leaves the state unchanged when folded in.
+    const uint8_t* tail = vDataToHash.data() + nblocks * 4;
+    uint32_t k1 = 0;
+    switch (vDataToHash.size() & 3) {
+        case 3:
+            k1 ^= tail[2] << 16;
+        case 2:
+            k1 ^= tail[1] << 8;
+        case 1:
+            k1 ^= tail[0];
+    }
+    m_tail = MurmurHash3MixBlock(k1);
+}
+
+uint32_t MurmurHash3Prepared::Hash(uint32_t seed) const
+{
+    uint32_t h1 = seed;
+    for (const uint32_t k1 : m_blocks) {
+        h1 ^= k1;
+        h1 = ROTL32(h1, 13);
+        h1 = h1 * 5 + 0xe6546b64;
+    }
+    h1 ^= m_tail;
+    return MurmurHash3Finalize(h1, m_size);
+}
+
+void MurmurHash3Prepared::Hash(const uint32_t* seeds, uint32_t* hashes_out, size_t n) const
+{
+    for (size_t j = 0; j < n; ++j) {
+        hashes_out[j] = seeds[j];
+    }
+    for (const uint32_t k1 : m_blocks) {
+        for (size_t j = 0; j < n; ++j) {
+            uint32_t h1 = hashes_out[j] ^ k1;
+            h1 = ROTL32(h1, 13);
+            hashes_out[j] = h1 * 5 + 0xe6546b64;
+        }
+    }
+    for (size_t j = 0; j < n; ++j) {
+        hashes_out[j] = MurmurHash3Finalize(hashes_out[j] ^ m_tail, m_size);
+    }
+}
+
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64])
 {
     unsigned char num[4];
@@ -202,6 +202,28 @@ uint256 SerializeHash(const T& obj, int nType=SER_GETHASH, int nVersion=PROTOCOL
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
 
+/**
+ * A MurmurHash3 input prepared for hashing under many seeds, as bloom filters do with one seed per
+ * hash function. MurmurHash3 mixes every 4-byte block of its input without involving the seed, so
+ * that work is done once at construction and Hash() only runs the seed-dependent rounds.
+ */
+class MurmurHash3Prepared
+{
+private:
+    std::vector<uint32_t> m_blocks;
+    uint32_t m_tail;
+    uint32_t m_size;
+
+public:
+    explicit MurmurHash3Prepared(const std::vector<unsigned char>& vDataToHash);
+
+    /** Returns MurmurHash3(seed, data). */
+    uint32_t Hash(uint32_t seed) const;
+
+    /** Hashes under n seeds at once; the per-seed rounds are independent and vectorize well. */
+    void Hash(const uint32_t* seeds, uint32_t* hashes_out, size_t n) const;
+};
+
 void BIP32Hash(const ChainCode &chainCode, unsigned int nChild, unsigned char header, const unsigned char data[32], unsigned char output[64]);
 
 #endif // BITCOIN_HASH_H
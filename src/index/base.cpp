@@ -41,9 +41,9 @@ bool BaseIndex::DB::ReadBestBlock(CBlockLocator& locator) const
     return success;
 }
 
-bool BaseIndex::DB::WriteBestBlock(const CBlockLocator& locator)
+void BaseIndex::DB::WriteBestBlock(CDBBatch& batch, const CBlockLocator& locator)
 {
-    return Write(DB_BEST_BLOCK, locator);
+    batch.Write(DB_BEST_BLOCK, locator);
 }
 
 BaseIndex::~BaseIndex()
@@ -89,10 +89,9 @@ void BaseIndex::ThreadSync()
 {
     const CBlockIndex* pindex = m_best_block_index.load();
     if (!m_synced) {
-        auto& consensus_params = Params().GetConsensus();
-
         int64_t last_log_time = 0;
         int64_t last_locator_write_time = 0;
+        std::vector<const CBlockIndex*> batch;
         while (true) {
             if (m_interrupt) {
                 WriteBestBlock(pindex);
@@ -108,32 +107,34 @@ void BaseIndex::ThreadSync()
                     m_synced = true;
                     break;
                 }
-                pindex = pindex_next;
+                // Only batch a run of blocks that directly extend each other, so that a fork
+                // switch is always handled at the start of a batch.
+                batch.assign(1, pindex_next);
+                while (batch.size() < GetSyncBatchSize()) {
+                    const CBlockIndex* pindex_more = chainActive.Next(batch.back());
+                    if (!pindex_more) break;
+                    batch.push_back(pindex_more);
+                }
             }
 
             int64_t current_time = GetTime();
             if (last_log_time + SYNC_LOG_INTERVAL < current_time) {
                 LogPrintf("Syncing %s with block chain from height %d\n",
-                          GetName(), pindex->nHeight);
+                          GetName(), batch.front()->nHeight);
                 last_log_time = current_time;
             }
 
-            if (last_locator_write_time + SYNC_LOCATOR_WRITE_INTERVAL < current_time) {
+            if (pindex && last_locator_write_time + SYNC_LOCATOR_WRITE_INTERVAL < current_time) {
                 WriteBestBlock(pindex);
                 last_locator_write_time = current_time;
             }
 
-            CBlock block;
-            if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
-                FatalError("%s: Failed to read block %s from disk",
-                           __func__, pindex->GetBlockHash().ToString());
-                return;
-            }
-            if (!WriteBlock(block, pindex)) {
-                FatalError("%s: Failed to write block %s to index database",
-                           __func__, pindex->GetBlockHash().ToString());
+            if (!SyncBlocks(batch)) {
+                FatalError("%s: Failed to write blocks %d-%d to %s",
+                           __func__, batch.front()->nHeight, batch.back()->nHeight, GetName());
                 return;
             }
+            pindex = batch.back();
         }
     }
 
@@ -144,10 +145,46 @@ void BaseIndex::ThreadSync()
     }
 }
 
+bool BaseIndex::SyncBlocks(const std::vector<const CBlockIndex*>& block_indexes)
+{
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    for (const CBlockIndex* pindex : block_indexes) {
+        CBlock block;
+        if (!ReadBlockFromDiskWithStoredTxHashes(block, pindex, consensus_params)) {
+            return error("%s: Failed to read block %s from disk",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!WriteBlock(block, pindex)) {
+            return error("%s: Failed to write block %s to index database",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+    }
+    return true;
+}
+
+bool BaseIndex::Commit(const CBlockLocator& locator)
+{
+    CDBBatch batch(GetDB());
+    if (!CommitInternal(batch)) {
+        return false;
+    }
+    GetDB().WriteBestBlock(batch, locator);
+    return GetDB().WriteBatch(batch);
+}
+
+bool BaseIndex::CommitInternal(CDBBatch& batch)
+{
+    return true;
+}
+
 bool BaseIndex::WriteBestBlock(const CBlockIndex* block_index)
 {
-    LOCK(cs_main);
-    if (!GetDB().WriteBestBlock(chainActive.GetLocator(block_index))) {
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        locator = chainActive.GetLocator(block_index);
+    }
+    if (!Commit(locator)) {
         return error("%s: Failed to write locator to disk", __func__);
     }
     return true;
@@ -224,7 +261,7 @@ void BaseIndex::ChainStateFlushed(const CBlockLocator& locator)
         return;
     }
 
-    if (!GetDB().WriteBestBlock(locator)) {
+    if (!Commit(locator)) {
         error("%s: Failed to write locator to disk", __func__);
     }
 }
@@ -32,7 +32,7 @@ protected:
         bool ReadBestBlock(CBlockLocator& locator) const;
 
         /// Write block locator of the chain that the txindex is in sync with.
-        bool WriteBestBlock(const CBlockLocator& locator);
+        void WriteBestBlock(CDBBatch& batch, const CBlockLocator& locator);
     };
 
 private:
@@ -54,6 +54,9 @@ private:
     /// over and the sync thread exits.
     void ThreadSync();
 
+    /// Write the current chain block locator and other index state to the DB.
+    bool Commit(const CBlockLocator& locator);
+
     /// Write the current chain block locator to the DB.
     bool WriteBestBlock(const CBlockIndex* block_index);
 
@@ -69,6 +72,18 @@ protected:
     /// Write update index entries for a newly connected block.
     virtual bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) { return true; }
 
+    /// Write update index entries for a run of consecutive blocks during the initial sync. The
+    /// default reads each block from disk and passes it to WriteBlock; indexes whose per-block work
+    /// is expensive may override this to spread it over several threads.
+    virtual bool SyncBlocks(const std::vector<const CBlockIndex*>& block_indexes);
+
+    /// Maximum number of blocks handed to SyncBlocks at once.
+    virtual size_t GetSyncBatchSize() const { return 1; }
+
+    /// Virtual method called internally by Commit that can be overridden to atomically
+    /// commit more index state.
+    virtual bool CommitInternal(CDBBatch& batch);
+
     virtual DB& GetDB() const = 0;
 
     /// Get the name of the index for display in logs.
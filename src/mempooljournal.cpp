@@ -0,0 +1,256 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mempooljournal.h>
+
+#include <clientversion.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <logging.h>
+#include <random.h>
+#include <serialize.h>
+#include <streams.h>
+#include <txmempool.h>
+#include <util/system.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <limits>
+
+std::unique_ptr<CMempoolJournal> g_mempool_journal;
+
+static const uint64_t MEMPOOL_JOURNAL_VERSION = 1;
+/** The header holds the version and the id of the journal. */
+static const uint64_t MEMPOOL_JOURNAL_HEADER_SIZE = 16;
+/** Each record is preceded by the size and checksum of its payload. */
+static const size_t MEMPOOL_JOURNAL_RECORD_HEADER_SIZE = 8;
+
+static uint32_t RecordChecksum(const CDataStream& payload)
+{
+    const uint256 hash = Hash(payload.begin(), payload.end());
+    return ReadLE32(hash.begin());
+}
+
+static void SerializeRecord(CDataStream& payload, const MempoolJournalRecord& record)
+{
+    payload << static_cast<uint8_t>(record.type);
+    switch (record.type) {
+    case MempoolJournalRecord::ADD:
+        payload << record.tx << record.time;
+        break;
+    case MempoolJournalRecord::REMOVE:
+        payload << record.txid << record.for_block;
+        break;
+    case MempoolJournalRecord::PRIORITISE:
+        payload << record.txid << record.delta;
+        break;
+    }
+}
+
+/** Returns false if the payload does not hold a known record. */
+static bool UnserializeRecord(CDataStream& payload, MempoolJournalRecord& record)
+{
+    uint8_t type;
+    payload >> type;
+    switch (type) {
+    case MempoolJournalRecord::ADD:
+        payload >> record.tx >> record.time;
+        record.txid = record.tx->GetHash();
+        break;
+    case MempoolJournalRecord::REMOVE:
+        payload >> record.txid >> record.for_block;
+        break;
+    case MempoolJournalRecord::PRIORITISE:
+        payload >> record.txid >> record.delta;
+        break;
+    default:
+        return false;
+    }
+    record.type = static_cast<MempoolJournalRecord::Type>(type);
+    return payload.empty();
+}
+
+CMempoolJournal::CMempoolJournal(CTxMemPool& pool, const fs::path& path) : m_pool(pool), m_path(path) {}
+
+CMempoolJournal::~CMempoolJournal()
+{
+    m_conn_added.disconnect();
+    m_conn_removed.disconnect();
+    LOCK(m_file_mutex);
+    if (m_file) fclose(m_file);
+}
+
+void CMempoolJournal::TransactionAdded(CTransactionRef tx)
+{
+    // The mempool entry is not available yet. The time is that of the entry, except for
+    // transactions loaded from disk, which are added before the journal is started.
+    MempoolJournalRecord record;
+    record.type = MempoolJournalRecord::ADD;
+    record.txid = tx->GetHash();
+    record.tx = std::move(tx);
+    record.time = GetTime();
+    LOCK(m_pending_mutex);
+    m_pending.push_back(std::move(record));
+}
+
+void CMempoolJournal::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    MempoolJournalRecord record;
+    record.type = MempoolJournalRecord::REMOVE;
+    record.txid = tx->GetHash();
+    record.for_block = reason == MemPoolRemovalReason::BLOCK;
+    LOCK(m_pending_mutex);
+    m_pending.push_back(std::move(record));
+}
+
+void CMempoolJournal::Prioritise(const uint256& txid)
+{
+    // Record the total rather than the change, so that replaying it is harmless if the mempool
+    // dump already includes it.
+    MempoolJournalRecord record;
+    record.type = MempoolJournalRecord::PRIORITISE;
+    record.txid = txid;
+    m_pool.ApplyDelta(txid, record.delta);
+    LOCK(m_pending_mutex);
+    m_pending.push_back(std::move(record));
+}
+
+bool CMempoolJournal::Start()
+{
+    m_conn_added = m_pool.NotifyEntryAdded.connect(std::bind(&CMempoolJournal::TransactionAdded, this, std::placeholders::_1));
+    m_conn_removed = m_pool.NotifyEntryRemoved.connect(std::bind(&CMempoolJournal::TransactionRemoved, this, std::placeholders::_1, std::placeholders::_2));
+    LOCK(m_file_mutex);
+    return Rotate();
+}
+
+bool CMempoolJournal::Compact()
+{
+    LOCK(m_file_mutex);
+    if (!m_file) return DumpMempool(0, 0);
+    return Rotate();
+}
+
+bool CMempoolJournal::Rotate()
+{
+    uint64_t id;
+    do {
+        id = GetRand(std::numeric_limits<uint64_t>::max());
+    } while (id == 0 || id == m_id);
+
+    // Nothing is written to the old journal from here on, so everything in it precedes the dump.
+    // Records still pending will go to the new journal.
+    if (!DumpMempool(id, MEMPOOL_JOURNAL_HEADER_SIZE)) {
+        return false;
+    }
+
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+    const fs::path path_new = m_path.string() + ".new";
+    FILE* file = fsbridge::fopen(path_new, "wb");
+    if (!file) {
+        LogPrintf("Failed to create mempool journal %s\n", path_new.string());
+        return false;
+    }
+    unsigned char header[MEMPOOL_JOURNAL_HEADER_SIZE];
+    WriteLE64(header, MEMPOOL_JOURNAL_VERSION);
+    WriteLE64(header + 8, id);
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header) || fflush(file) != 0 || !FileCommit(file)) {
+        LogPrintf("Failed to write mempool journal %s\n", path_new.string());
+        fclose(file);
+        return false;
+    }
+    fclose(file);
+    if (!RenameOver(path_new, m_path)) {
+        LogPrintf("Failed to rename mempool journal %s\n", path_new.string());
+        return false;
+    }
+
+    m_file = fsbridge::fopen(m_path, "ab");
+    if (!m_file) {
+        LogPrintf("Failed to open mempool journal %s\n", m_path.string());
+        return false;
+    }
+    m_id = id;
+    m_size = MEMPOOL_JOURNAL_HEADER_SIZE;
+    return true;
+}
+
+void CMempoolJournal::Flush()
+{
+    bool write_ok = true;
+    {
+        LOCK(m_file_mutex);
+        if (!m_file) return;
+
+        std::vector<MempoolJournalRecord> records;
+        {
+            LOCK(m_pending_mutex);
+            records.swap(m_pending);
+        }
+        if (records.empty()) return;
+
+        CDataStream payload(SER_DISK, CLIENT_VERSION);
+        for (const MempoolJournalRecord& record : records) {
+            payload.clear();
+            SerializeRecord(payload, record);
+            unsigned char record_header[MEMPOOL_JOURNAL_RECORD_HEADER_SIZE];
+            WriteLE32(record_header, payload.size());
+            WriteLE32(record_header + 4, RecordChecksum(payload));
+            if (fwrite(record_header, 1, sizeof(record_header), m_file) != sizeof(record_header) ||
+                fwrite(payload.data(), 1, payload.size(), m_file) != payload.size()) {
+                write_ok = false;
+                break;
+            }
+            m_size += sizeof(record_header) + payload.size();
+        }
+        write_ok = write_ok && fflush(m_file) == 0 && FileCommit(m_file);
+        if (write_ok && m_size <= std::max(MEMPOOL_JOURNAL_MIN_COMPACT_SIZE, MEMPOOL_JOURNAL_COMPACT_FACTOR * m_pool.GetTotalTxSize())) {
+            return;
+        }
+    }
+
+    // Either the journal is too large, or records may be missing from it; dump the mempool so
+    // that nothing depends on this journal anymore.
+    if (!write_ok) LogPrintf("Failed to write mempool journal, dumping mempool\n");
+    Compact();
+}
+
+bool ReadMempoolJournal(const fs::path& path, uint64_t id, uint64_t offset, std::vector<MempoolJournalRecord>& records)
+{
+    if (id == 0 || offset < MEMPOOL_JOURNAL_HEADER_SIZE) return false;
+
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) return false;
+
+    unsigned char header[MEMPOOL_JOURNAL_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file.Get()) != sizeof(header) ||
+        ReadLE64(header) != MEMPOOL_JOURNAL_VERSION || ReadLE64(header + 8) != id) {
+        return false;
+    }
+    if (fseek(file.Get(), offset, SEEK_SET) != 0) return false;
+
+    CDataStream payload(SER_DISK, CLIENT_VERSION);
+    while (true) {
+        unsigned char record_header[MEMPOOL_JOURNAL_RECORD_HEADER_SIZE];
+        if (fread(record_header, 1, sizeof(record_header), file.Get()) != sizeof(record_header)) break;
+        const uint32_t size = ReadLE32(record_header);
+        if (size == 0 || size > MAX_SIZE) break;
+        payload.clear();
+        payload.resize(size);
+        if (fread(payload.data(), 1, size, file.Get()) != size) break;
+        if (RecordChecksum(payload) != ReadLE32(record_header + 4)) break;
+
+        MempoolJournalRecord record;
+        try {
+            if (!UnserializeRecord(payload, record)) break;
+        } catch (const std::exception&) {
+            break;
+        }
+        records.push_back(std::move(record));
+    }
+    return true;
+}
@@ -0,0 +1,118 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MEMPOOLJOURNAL_H
+#define BITCOIN_MEMPOOLJOURNAL_H
+
+#include <amount.h>
+#include <fs.h>
+#include <primitives/transaction.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/signals2/connection.hpp>
+
+class CTxMemPool;
+enum class MemPoolRemovalReason;
+
+/** Default for -mempooljournal */
+static const bool DEFAULT_MEMPOOL_JOURNAL = true;
+/** How often, in seconds, pending journal records are written out */
+static const int64_t MEMPOOL_JOURNAL_FLUSH_INTERVAL = 2;
+/** The journal is compacted once it is larger than this... */
+static const uint64_t MEMPOOL_JOURNAL_MIN_COMPACT_SIZE = 16 * 1000 * 1000;
+/** ...and larger than this multiple of the size of the mempool's transactions */
+static const uint64_t MEMPOOL_JOURNAL_COMPACT_FACTOR = 3;
+
+/** A change to the mempool, as recorded in the journal. */
+struct MempoolJournalRecord {
+    enum Type : uint8_t {
+        //! tx entered the mempool at time
+        ADD = 1,
+        //! The transaction txid left the mempool, for a block if for_block
+        REMOVE = 2,
+        //! The fee delta of txid was set to delta
+        PRIORITISE = 3,
+    };
+
+    Type type;
+    CTransactionRef tx;
+    uint256 txid;
+    int64_t time{0};
+    bool for_block{false};
+    CAmount delta{0};
+};
+
+/**
+ * Append-only log of the changes made to the mempool since it was last dumped to mempool.dat, so
+ * that a node that did not shut down cleanly still gets its mempool back on restart.
+ *
+ * Changes are collected in memory as the mempool makes them and written out, and synced, every
+ * MEMPOOL_JOURNAL_FLUSH_INTERVAL seconds; a crash loses at most the changes of that interval.
+ * Every journal has a random id. Each mempool.dat records the id of the journal that continues it
+ * and the offset in it from which on records are to be replayed, so that a dump and the journal
+ * cannot be combined wrongly, whichever of the two a crash leaves behind. Replaying records that
+ * precede the dump is harmless, as replay keeps only the last change to each transaction.
+ *
+ * Once the journal grows past MEMPOOL_JOURNAL_MIN_COMPACT_SIZE and MEMPOOL_JOURNAL_COMPACT_FACTOR
+ * times the size of the mempool, it is compacted: the mempool is dumped and a new, empty journal is
+ * started.
+ */
+class CMempoolJournal
+{
+public:
+    CMempoolJournal(CTxMemPool& pool, const fs::path& path);
+    ~CMempoolJournal();
+
+    /**
+     * Start recording the changes made to the mempool, which should have been loaded by now. This
+     * dumps the mempool and starts a new journal.
+     */
+    bool Start();
+
+    /** Record a change of the fee delta of a transaction; its new total is taken from the mempool. */
+    void Prioritise(const uint256& txid);
+
+    /** Write out the pending records, compacting the journal if it has grown too large. */
+    void Flush();
+
+    /** Dump the mempool and start a new journal. Without the journal started, this only dumps. */
+    bool Compact();
+
+private:
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+    /** Dump the mempool, to be continued by a new journal, and start that journal. */
+    bool Rotate() EXCLUSIVE_LOCKS_REQUIRED(m_file_mutex);
+
+    CTxMemPool& m_pool;
+    const fs::path m_path;
+
+    Mutex m_pending_mutex;
+    std::vector<MempoolJournalRecord> m_pending GUARDED_BY(m_pending_mutex);
+
+    Mutex m_file_mutex;
+    FILE* m_file GUARDED_BY(m_file_mutex){nullptr};
+    uint64_t m_id GUARDED_BY(m_file_mutex){0};
+    uint64_t m_size GUARDED_BY(m_file_mutex){0};
+
+    boost::signals2::scoped_connection m_conn_added;
+    boost::signals2::scoped_connection m_conn_removed;
+};
+
+/**
+ * Read the records of the journal at path from the given offset on, if its id matches. Reading
+ * stops at the first record that is incomplete or corrupt, such as one cut short by a crash.
+ * Returns false if there is no such journal.
+ */
+bool ReadMempoolJournal(const fs::path& path, uint64_t id, uint64_t offset, std::vector<MempoolJournalRecord>& records);
+
+/** The mempool journal, if -persistmempool and -mempooljournal are set. */
+extern std::unique_ptr<CMempoolJournal> g_mempool_journal;
+
+#endif // BITCOIN_MEMPOOLJOURNAL_H
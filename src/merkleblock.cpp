@@ -10,8 +10,10 @@
 #include <util/strencodings.h>
 
 
-CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std::set<uint256>* txids)
+CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std::set<uint256>* txids, const std::vector<CBloomTxElements>* block_elements)
 {
+    assert(!block_elements || block_elements->size() == block.vtx.size());
+
     header = block.GetBlockHeader();
 
     std::vector<bool> vMatch;
@@ -25,7 +27,7 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std:
         const uint256& hash = block.vtx[i]->GetHash();
         if (txids && txids->count(hash)) {
             vMatch.push_back(true);
-        } else if (filter && filter->IsRelevantAndUpdate(*block.vtx[i])) {
+        } else if (filter && (block_elements ? filter->IsRelevantAndUpdate((*block_elements)[i]) : filter->IsRelevantAndUpdate(*block.vtx[i]))) {
             vMatch.push_back(true);
             vMatchedTxn.emplace_back(i, hash);
         } else {
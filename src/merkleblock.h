@@ -150,10 +150,17 @@ public:
      * Note that this will call IsRelevantAndUpdate on the filter for each transaction,
      * thus the filter will likely be modified.
      */
-    CMerkleBlock(const CBlock& block, CBloomFilter& filter) : CMerkleBlock(block, &filter, nullptr) { }
+    CMerkleBlock(const CBlock& block, CBloomFilter& filter) : CMerkleBlock(block, &filter, nullptr, nullptr) { }
+
+    /**
+     * Same as above, but matches against bloom filter data extracted from the block's
+     * transactions in advance (one entry per transaction, in block order), which can be shared
+     * between all peers that request the block.
+     */
+    CMerkleBlock(const CBlock& block, CBloomFilter& filter, const std::vector<CBloomTxElements>& block_elements) : CMerkleBlock(block, &filter, nullptr, &block_elements) { }
 
     // Create from a CBlock, matching the txids in the set
-    CMerkleBlock(const CBlock& block, const std::set<uint256>& txids) : CMerkleBlock(block, nullptr, &txids) { }
+    CMerkleBlock(const CBlock& block, const std::set<uint256>& txids) : CMerkleBlock(block, nullptr, &txids, nullptr) { }
 
     CMerkleBlock() {}
 
@@ -167,7 +174,7 @@ public:
 
 private:
     // Combined constructor to consolidate code
-    CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std::set<uint256>* txids);
+    CMerkleBlock(const CBlock& block, CBloomFilter* filter, const std::set<uint256>* txids, const std::vector<CBloomTxElements>* block_elements);
 };
 
 #endif // BITCOIN_MERKLEBLOCK_H
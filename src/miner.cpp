@@ -19,6 +19,7 @@
 #include <policy/policy.h>
 #include <pow.h>
 #include <primitives/transaction.h>
+#include <scheduler.h>
 #include <script/standard.h>
 #include <timedata.h>
 #include <util/moneystr.h>
@@ -49,11 +50,16 @@ BlockAssembler::Options::Options() {
     nBlockMaxWeight = DEFAULT_BLOCK_MAX_WEIGHT;
 }
 
+static size_t ClampBlockMaxWeight(size_t nBlockMaxWeight)
+{
+    // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
+    return std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, nBlockMaxWeight));
+}
+
 BlockAssembler::BlockAssembler(const CChainParams& params, const Options& options) : chainparams(params)
 {
     blockMinFeeRate = options.blockMinFeeRate;
-    // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
-    nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
+    nBlockMaxWeight = ClampBlockMaxWeight(options.nBlockMaxWeight);
 }
 
 static BlockAssembler::Options DefaultOptions()
@@ -138,7 +144,11 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    if (mempool.IsTrackingClusters()) {
+        addChunkTxs(nPackagesSelected);
+    } else {
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -427,6 +437,63 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+// With cluster tracking, the mempool keeps every cluster of connected transactions linearized and
+// split into chunks of non-increasing feerate, so that taking chunks in feerate order never takes a
+// chunk before the earlier chunks of its cluster. There is no ancestor state to update as we go;
+// the only bookkeeping is that once a chunk is skipped, the later chunks of its cluster may spend
+// from it and are skipped too.
+void BlockAssembler::addChunkTxs(int &nPackagesSelected)
+{
+    std::set<uint64_t> skippedClusters;
+
+    // Limit the number of attempts to add transactions to the block when it is
+    // close to full, as in addPackageTxs.
+    const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+    int64_t nConsecutiveFailed = 0;
+
+    for (const CTxMemPool::ClusterChunk& chunk : mempool.GetLinearizedChunks()) {
+        if (chunk.fee < blockMinFeeRate.GetFee(chunk.size)) {
+            // Everything else we might consider has a lower fee rate
+            return;
+        }
+        if (skippedClusters.count(chunk.cluster)) continue;
+
+        const std::vector<CTxMemPool::txiter>& linearization = mempool.GetClusterLinearization(chunk.cluster);
+        CTxMemPool::setEntries package;
+        int64_t packageSigOpsCost = 0;
+        for (size_t i = chunk.begin; i < chunk.end; ++i) {
+            package.insert(linearization[i]);
+            packageSigOpsCost += linearization[i]->GetSigOpCost();
+        }
+
+        if (!TestPackage(chunk.size, packageSigOpsCost)) {
+            skippedClusters.insert(chunk.cluster);
+            ++nConsecutiveFailed;
+            if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockWeight >
+                    nBlockMaxWeight - 4000) {
+                // Give up if we're close to full and haven't succeeded in a while
+                break;
+            }
+            continue;
+        }
+
+        // Test if all tx's are Final
+        if (!TestPackageTransactions(package)) {
+            skippedClusters.insert(chunk.cluster);
+            continue;
+        }
+
+        // This chunk will make it in; reset the failed counter.
+        nConsecutiveFailed = 0;
+
+        // The linearization already puts parents first.
+        for (size_t i = chunk.begin; i < chunk.end; ++i) {
+            AddToBlock(linearization[i]);
+        }
+        ++nPackagesSelected;
+    }
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -445,3 +512,230 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+std::unique_ptr<BlockTemplateCache> g_block_template_cache;
+
+BlockTemplateCache::BlockTemplateCache(const CChainParams& params, CScheduler& scheduler) :
+    m_params(params),
+    m_scheduler(scheduler),
+    m_block_max_weight(ClampBlockMaxWeight(DefaultOptions().nBlockMaxWeight)),
+    m_block_min_fee_rate(DefaultOptions().blockMinFeeRate)
+{
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateCache::GetTemplate(const CBlockIndex* pindexPrev, unsigned int& transactions_updated_out)
+{
+    LOCK(m_cs);
+    if (!m_active) {
+        // First request: start maintaining a template from now on.
+        m_active = true;
+        ScheduleRefresh(0);
+        return nullptr;
+    }
+    if (!m_published || m_published->block.hashPrevBlock != pindexPrev->GetBlockHash()) {
+        return nullptr;
+    }
+    transactions_updated_out = m_published_transactions_updated;
+    return MakeUnique<CBlockTemplate>(*m_published);
+}
+
+void BlockTemplateCache::UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload)
+{
+    if (!m_active) return;
+    LOCK(m_cs);
+    m_needs_rebuild = true;
+    ScheduleRefresh(0);
+}
+
+void BlockTemplateCache::TransactionAddedToMempool(const CTransactionRef& ptx)
+{
+    if (!m_active) return;
+    LOCK(m_cs);
+    m_pending.emplace_back(ptx, true);
+    ScheduleRefresh(BLOCK_TEMPLATE_REFRESH_DELAY);
+}
+
+void BlockTemplateCache::TransactionRemovedFromMempool(const CTransactionRef& ptx)
+{
+    if (!m_active) return;
+    LOCK(m_cs);
+    m_pending.emplace_back(ptx, false);
+    ScheduleRefresh(BLOCK_TEMPLATE_REFRESH_DELAY);
+}
+
+bool BlockTemplateCache::AddTransaction(const CTransaction& tx)
+{
+    if (m_working_txids.count(tx.GetHash())) return false;
+
+    CTxMemPool::txiter it = mempool.mapTx.find(tx.GetHash());
+    if (it == mempool.mapTx.end()) return false; // already removed again
+
+    // Same selection rules as BlockAssembler, for a package that is just this transaction.
+    if (CFeeRate(it->GetModifiedFee(), it->GetTxSize()) < m_block_min_fee_rate) {
+        // Only a rebuild could include it, together with a child paying for it.
+        return false;
+    }
+    bool can_append = m_block_weight + WITNESS_SCALE_FACTOR * it->GetTxSize() < m_block_max_weight &&
+        m_block_sigops_cost + it->GetSigOpCost() < MAX_BLOCK_SIGOPS_COST &&
+        IsFinalTx(it->GetTx(), m_working_prev->nHeight + 1, m_lock_time_cutoff) &&
+        (m_include_witness || !it->GetTx().HasWitness());
+    for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(it)) {
+        if (!m_working_txids.count(parent->GetTx().GetHash())) can_append = false;
+    }
+    if (!can_append) {
+        m_needs_rebuild = true;
+        return false;
+    }
+
+    m_working->block.vtx.push_back(it->GetSharedTx());
+    m_working->vTxFees.push_back(it->GetFee());
+    m_working->vTxSigOpsCost.push_back(it->GetSigOpCost());
+    m_working_txids.insert(it->GetTx().GetHash());
+    m_block_weight += it->GetTxWeight();
+    m_block_sigops_cost += it->GetSigOpCost();
+    m_fees += it->GetFee();
+    return true;
+}
+
+bool BlockTemplateCache::RemoveTransaction(const CTransaction& tx)
+{
+    if (!m_working_txids.count(tx.GetHash())) return false;
+    // Removed and added back before this refresh (e.g. by a reorg), so it is still valid here.
+    if (mempool.exists(tx.GetHash())) return false;
+
+    // Drop the transaction and everything in the template that depends on it.
+    std::set<uint256> removed{tx.GetHash()};
+    std::vector<CTransactionRef>& vtx = m_working->block.vtx;
+    for (size_t i = 1; i < vtx.size(); ) {
+        const uint256& hash = vtx[i]->GetHash();
+        bool remove = removed.count(hash);
+        for (size_t j = 0; !remove && j < vtx[i]->vin.size(); ++j) {
+            remove = removed.count(vtx[i]->vin[j].prevout.hash);
+        }
+        if (!remove) {
+            ++i;
+            continue;
+        }
+        removed.insert(hash);
+        m_working_txids.erase(hash);
+        m_block_weight -= GetTransactionWeight(*vtx[i]);
+        m_block_sigops_cost -= m_working->vTxSigOpsCost[i];
+        m_fees -= m_working->vTxFees[i];
+        vtx.erase(vtx.begin() + i);
+        m_working->vTxFees.erase(m_working->vTxFees.begin() + i);
+        m_working->vTxSigOpsCost.erase(m_working->vTxSigOpsCost.begin() + i);
+    }
+    // The freed space may fit transactions that were left out.
+    m_needs_rebuild = true;
+    return true;
+}
+
+void BlockTemplateCache::ScheduleRefresh(int64_t delta_ms)
+{
+    if (m_refresh_scheduled) return;
+    m_refresh_scheduled = true;
+    m_scheduler.scheduleFromNow(std::bind(&BlockTemplateCache::Refresh, this), delta_ms);
+}
+
+void BlockTemplateCache::UpdateCoinbase()
+{
+    // Recreate the coinbase outputs from scratch, as the witness commitment depends on the
+    // transactions in the block.
+    CMutableTransaction coinbase(*m_working->block.vtx[0]);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = m_fees + GetBlockSubsidy(m_working_prev->nHeight + 1, m_params.GetConsensus());
+    coinbase.vin[0].scriptWitness.SetNull();
+    m_working->block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+    m_working->vchCoinbaseCommitment = GenerateCoinbaseCommitment(m_working->block, m_working_prev, m_params.GetConsensus());
+    m_working->vTxFees[0] = -m_fees;
+}
+
+bool BlockTemplateCache::Rebuild()
+{
+    const CBlockIndex* pindexPrev = chainActive.Tip();
+    m_last_rebuild = GetTime();
+    try {
+        m_working = BlockAssembler(m_params).CreateNewBlock(CScript() << OP_TRUE);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        m_working.reset();
+        return false;
+    }
+    if (!m_working) return false;
+    assert(m_working->block.hashPrevBlock == pindexPrev->GetBlockHash());
+
+    m_working_prev = pindexPrev;
+    m_lock_time_cutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                         ? pindexPrev->GetMedianTimePast()
+                         : m_working->block.GetBlockTime();
+    m_include_witness = IsWitnessEnabled(pindexPrev, m_params.GetConsensus());
+
+    // Same accounting as BlockAssembler, including the space reserved for the coinbase.
+    m_working_txids.clear();
+    m_block_weight = 4000;
+    m_block_sigops_cost = 400;
+    m_fees = -m_working->vTxFees[0];
+    for (size_t i = 1; i < m_working->block.vtx.size(); ++i) {
+        m_working_txids.insert(m_working->block.vtx[i]->GetHash());
+        m_block_weight += GetTransactionWeight(*m_working->block.vtx[i]);
+        m_block_sigops_cost += m_working->vTxSigOpsCost[i];
+    }
+    m_needs_rebuild = false;
+    return true;
+}
+
+void BlockTemplateCache::Refresh()
+{
+    int64_t nTimeStart = GetTimeMicros();
+    bool rebuilt = false;
+
+    LOCK2(cs_main, mempool.cs);
+    LOCK(m_cs);
+    m_refresh_scheduled = false;
+
+    // Apply the mempool changes signalled since the last refresh. A rebuild below starts over
+    // from the mempool anyway, so they only matter for a working template on the current tip.
+    std::vector<std::pair<CTransactionRef, bool>> pending;
+    pending.swap(m_pending);
+    if (m_working && m_working_prev == chainActive.Tip()) {
+        bool changed = false;
+        for (const auto& change : pending) {
+            changed |= change.second ? AddTransaction(*change.first) : RemoveTransaction(*change.first);
+        }
+        if (changed) {
+            UpdateCoinbase();
+            m_working_changed = true;
+        }
+    }
+
+    if (!m_working || m_working_prev != chainActive.Tip() ||
+        (m_needs_rebuild && GetTime() - m_last_rebuild >= BLOCK_TEMPLATE_REBUILD_INTERVAL)) {
+        if (!Rebuild()) {
+            ScheduleRefresh(BLOCK_TEMPLATE_REBUILD_INTERVAL * 1000);
+            return;
+        }
+        // CreateNewBlock already checked the new template.
+        rebuilt = true;
+    } else if (m_needs_rebuild) {
+        // Keep serving the incrementally updated template until a rebuild is due.
+        ScheduleRefresh((m_last_rebuild + BLOCK_TEMPLATE_REBUILD_INTERVAL - GetTime()) * 1000);
+    }
+    if (!rebuilt && !m_working_changed) return;
+
+    if (!rebuilt) {
+        CValidationState state;
+        if (!TestBlockValidity(state, m_params, m_working->block, chainActive.Tip(), false, false)) {
+            LogPrintf("%s: TestBlockValidity failed: %s\n", __func__, FormatStateMessage(state));
+            m_working.reset();
+            ScheduleRefresh(BLOCK_TEMPLATE_REFRESH_DELAY);
+            return;
+        }
+    }
+
+    m_published = MakeUnique<const CBlockTemplate>(*m_working);
+    m_published_transactions_updated = mempool.GetTransactionsUpdated();
+    m_working_changed = false;
+
+    LogPrint(BCLog::BENCH, "BlockTemplateCache::Refresh() %s: %u txs in %.2fms\n",
+             rebuilt ? "rebuild" : "update", m_working->block.vtx.size() - 1, 0.001 * (GetTimeMicros() - nTimeStart));
+}
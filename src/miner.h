@@ -8,8 +8,10 @@
 
 #include <optional.h>
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
 #include <validation.h>
+#include <validationinterface.h>
 
 #include <memory>
 #include <stdint.h>
@@ -19,11 +21,16 @@
 
 class CBlockIndex;
 class CChainParams;
+class CScheduler;
 class CScript;
 
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Delay in milliseconds between a mempool change and refreshing the cached block template, so bursts are handled together */
+static const int64_t BLOCK_TEMPLATE_REFRESH_DELAY = 100;
+/** Minimum number of seconds between rebuilding the cached block template from the whole mempool */
+static const int64_t BLOCK_TEMPLATE_REBUILD_INTERVAL = 5;
 
 struct CBlockTemplate
 {
@@ -176,6 +183,9 @@ private:
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
     void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+    /** Add transactions by taking the mempool's linearized cluster chunks in feerate order, when
+      * the mempool tracks clusters. Increments nPackagesSelected for each chunk added. */
+    void addChunkTxs(int &nPackagesSelected) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
@@ -198,6 +208,87 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
 };
 
+/**
+ * Keeps a validated block template for the current tip up to date as the chain and mempool change,
+ * so getblocktemplate can hand out a copy instead of assembling a block from the mempool on every
+ * call.
+ *
+ * Mempool changes are queued as they are signalled and applied to a working template by a refresh
+ * scheduled shortly after: a new transaction is appended if its unconfirmed parents are already in
+ * the template and it fits, and a removed transaction is dropped together with anything in the
+ * template spending it. The refresh then checks the working template with TestBlockValidity and
+ * publishes it. Only the refresh takes cs_main; the signal handlers just take the cache's own lock.
+ * Transactions that could not be appended, and space freed by removals, are picked up by a full
+ * rebuild with BlockAssembler, which happens when the tip changes and otherwise at most every
+ * BLOCK_TEMPLATE_REBUILD_INTERVAL seconds.
+ *
+ * Nothing is maintained until the first template is requested, so nodes that do not mine pay
+ * nothing for it.
+ */
+class BlockTemplateCache final : public CValidationInterface
+{
+public:
+    BlockTemplateCache(const CChainParams& params, CScheduler& scheduler);
+
+    /**
+     * Get a copy of the cached template if it builds on pindexPrev, along with the mempool's
+     * transactions-updated counter it reflects. Returns nullptr if there is none (yet).
+     */
+    std::unique_ptr<CBlockTemplate> GetTemplate(const CBlockIndex* pindexPrev, unsigned int& transactions_updated_out);
+
+    /**
+     * Apply queued mempool changes and publish the result, rebuilding the template when the tip
+     * changed or a rebuild is due. Runs on the scheduler; public so tests can drive it directly.
+     */
+    void Refresh();
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex *pindexNew, const CBlockIndex *pindexFork, bool fInitialDownload) override;
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override;
+    void TransactionRemovedFromMempool(const CTransactionRef& ptx) override;
+
+private:
+    const CChainParams& m_params;
+    CScheduler& m_scheduler;
+    const uint64_t m_block_max_weight;
+    const CFeeRate m_block_min_fee_rate;
+
+    mutable CCriticalSection m_cs;
+    std::atomic<bool> m_active{false};
+    bool m_refresh_scheduled GUARDED_BY(m_cs) = false;
+    /** Set when the working template is known to be worse than what a rebuild would give. */
+    bool m_needs_rebuild GUARDED_BY(m_cs) = true;
+    int64_t m_last_rebuild GUARDED_BY(m_cs) = 0;
+
+    /** Template being updated as the mempool changes, and its chain context and totals. */
+    std::unique_ptr<CBlockTemplate> m_working GUARDED_BY(m_cs);
+    std::set<uint256> m_working_txids GUARDED_BY(m_cs);
+    const CBlockIndex* m_working_prev GUARDED_BY(m_cs) = nullptr;
+    int64_t m_lock_time_cutoff GUARDED_BY(m_cs) = 0;
+    bool m_include_witness GUARDED_BY(m_cs) = false;
+    uint64_t m_block_weight GUARDED_BY(m_cs) = 0;
+    int64_t m_block_sigops_cost GUARDED_BY(m_cs) = 0;
+    CAmount m_fees GUARDED_BY(m_cs) = 0;
+    bool m_working_changed GUARDED_BY(m_cs) = false;
+    /** Mempool changes not applied to the working template yet: (transaction, true if added). */
+    std::vector<std::pair<CTransactionRef, bool>> m_pending GUARDED_BY(m_cs);
+
+    /** Last validated template, handed out by GetTemplate. */
+    std::unique_ptr<const CBlockTemplate> m_published GUARDED_BY(m_cs);
+    unsigned int m_published_transactions_updated GUARDED_BY(m_cs) = 0;
+
+    void ScheduleRefresh(int64_t delta_ms) EXCLUSIVE_LOCKS_REQUIRED(m_cs);
+    bool Rebuild() EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_cs);
+    /** Append a transaction added to the mempool to the working template, if it fits. */
+    bool AddTransaction(const CTransaction& tx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs, m_cs);
+    /** Drop a transaction removed from the mempool, and its spenders, from the working template. */
+    bool RemoveTransaction(const CTransaction& tx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs, m_cs);
+    void UpdateCoinbase() EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_cs);
+};
+
+/** Block template cache used by getblocktemplate; set up during init. */
+extern std::unique_ptr<BlockTemplateCache> g_block_template_cache;
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
@@ -441,6 +441,7 @@ CNode* CConnman::ConnectNode(CAddress addrConnect, const char *pszDest, bool fCo
     uint64_t nonce = GetDeterministicRandomizer(RANDOMIZER_ID_LOCALHOSTNONCE).Write(id).Finalize();
     CAddress addr_bind = GetBindAddress(hSocket);
     CNode* pnode = new CNode(id, nLocalServices, GetBestHeight(), hSocket, addrConnect, CalculateKeyedNetGroup(addrConnect), nonce, addr_bind, pszDest ? pszDest : "", false);
+    pnode->m_recv_buffer_pool = &m_recv_buffer_pool;
     pnode->AddRef();
 
     return pnode;
@@ -566,7 +567,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
         // get current incomplete message, or create a new one
         if (vRecvMsg.empty() ||
             vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION, m_recv_buffer_pool));
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -660,6 +661,11 @@ int CNetMessage::readHeader(const char *pch, unsigned int nBytes)
     // switch state to reading message data
     in_data = true;
 
+    if (m_buffer_pool) {
+        CSerializeData buffer = m_buffer_pool->Get(hdr.nMessageSize);
+        vRecv.swap(buffer);
+    }
+
     return nCopy;
 }
 
@@ -680,6 +686,15 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     return nCopy;
 }
 
+CNetMessage::~CNetMessage()
+{
+    if (m_buffer_pool) {
+        CSerializeData buffer;
+        vRecv.swap(buffer);
+        m_buffer_pool->Put(std::move(buffer));
+    }
+}
+
 const uint256& CNetMessage::GetMessageHash() const
 {
     assert(complete());
@@ -688,7 +703,7 @@ const uint256& CNetMessage::GetMessageHash() const
     return data_hash;
 }
 
-size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend)
+size_t CConnman::SocketSendData(CNode *pnode) EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend)
 {
     auto it = pnode->vSendMsg.begin();
     size_t nSentSize = 0;
@@ -736,6 +751,10 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
         assert(pnode->nSendOffset == 0);
         assert(pnode->nSendSize == 0);
     }
+    for (auto sent = pnode->vSendMsg.begin(); sent != it; ++sent) {
+        // Only message headers are drawn from the pool, so only small buffers are worth keeping.
+        if (sent->capacity() <= NET_BUFFER_SMALL_SIZE) m_send_buffer_pool.Put(std::move(*sent));
+    }
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
     return nSentSize;
 }
@@ -961,6 +980,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
     CAddress addr_bind = GetBindAddress(hSocket);
 
     CNode* pnode = new CNode(id, nLocalServices, GetBestHeight(), hSocket, addr, CalculateKeyedNetGroup(addr), nonce, addr_bind, "", true);
+    pnode->m_recv_buffer_pool = &m_recv_buffer_pool;
     pnode->AddRef();
     pnode->fWhitelisted = whitelisted;
     pnode->m_prefer_evict = bannedlevel > 0;
@@ -2695,7 +2715,7 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
 
-    std::vector<unsigned char> serializedHeader;
+    std::vector<unsigned char> serializedHeader = m_send_buffer_pool.Get(CMessageHeader::HEADER_SIZE);
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
     uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
     CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
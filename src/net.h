@@ -15,6 +15,7 @@
 #include <hash.h>
 #include <limitedmap.h>
 #include <netaddress.h>
+#include <netbufferpool.h>
 #include <policy/feerate.h>
 #include <protocol.h>
 #include <random.h>
@@ -53,6 +54,16 @@ static const unsigned int MAX_LOCATOR_SZ = 101;
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
 /** Maximum length of incoming protocol messages (no message over 4 MB is currently acceptable). */
 static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 4 * 1000 * 1000;
+/** Number of small, tx and block sized buffers kept for reuse by received messages */
+static const size_t RECV_BUFFER_POOL_SMALL = 256;
+static const size_t RECV_BUFFER_POOL_TX = 64;
+static const size_t RECV_BUFFER_POOL_BLOCK = 2;
+/** Number of buffers kept for reuse by the headers of sent messages */
+static const size_t SEND_BUFFER_POOL_SMALL = 1024;
+
+typedef CNetBufferPool<CSerializeData> CNetRecvBufferPool;
+typedef CNetBufferPool<std::vector<unsigned char>> CNetSendBufferPool;
+
 /** Maximum length of strSubVer in `version` message */
 static const unsigned int MAX_SUBVERSION_LENGTH = 256;
 /** Maximum number of automatic outgoing nodes */
@@ -300,6 +311,9 @@ public:
     uint64_t GetTotalBytesRecv();
     uint64_t GetTotalBytesSent();
 
+    CNetRecvBufferPool::Stats GetRecvBufferPoolStats(CNetRecvBufferPool::SizeClass size_class) const { return m_recv_buffer_pool.GetStats(size_class); }
+    CNetSendBufferPool::Stats GetSendBufferPoolStats(CNetSendBufferPool::SizeClass size_class) const { return m_send_buffer_pool.GetStats(size_class); }
+
     void SetBestHeight(int height);
     int GetBestHeight() const;
 
@@ -357,7 +371,7 @@ private:
 
     NodeId GetNewNodeId();
 
-    size_t SocketSendData(CNode *pnode) const;
+    size_t SocketSendData(CNode *pnode);
     void DumpAddresses();
 
     // Network stats
@@ -389,6 +403,11 @@ private:
     unsigned int nSendBufferMaxSize{0};
     unsigned int nReceiveFloodSize{0};
 
+    /** Storage for received message payloads, recycled once messages are processed */
+    CNetRecvBufferPool m_recv_buffer_pool{RECV_BUFFER_POOL_SMALL, RECV_BUFFER_POOL_TX, RECV_BUFFER_POOL_BLOCK};
+    /** Storage for sent message headers, recycled once they are written to the socket */
+    CNetSendBufferPool m_send_buffer_pool{SEND_BUFFER_POOL_SMALL, 0, 0};
+
     std::vector<ListenSocket> vhListenSocket;
     std::atomic<bool> fNetworkActive{true};
     bool fAddressesInitialized{false};
@@ -593,14 +612,21 @@ public:
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
 
-    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
+    CNetRecvBufferPool* m_buffer_pool; // where vRecv's storage comes from and goes back to, if set
+
+    CNetMessage(const CMessageHeader::MessageStartChars& pchMessageStartIn, int nTypeIn, int nVersionIn, CNetRecvBufferPool* buffer_pool = nullptr) : hdrbuf(nTypeIn, nVersionIn), hdr(pchMessageStartIn), vRecv(nTypeIn, nVersionIn) {
         hdrbuf.resize(24);
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
         nTime = 0;
+        m_buffer_pool = buffer_pool;
     }
 
+    CNetMessage(CNetMessage&&) = default;
+    CNetMessage& operator=(CNetMessage&&) = default;
+    ~CNetMessage();
+
     bool complete() const
     {
         if (!in_data)
@@ -762,6 +788,7 @@ private:
     const int nMyStartingHeight;
     int nSendVersion{0};
     std::list<CNetMessage> vRecvMsg;  // Used only by SocketHandler thread
+    CNetRecvBufferPool* m_recv_buffer_pool{nullptr}; // Set by CConnman, used for vRecvMsg
 
     mutable CCriticalSection cs_addrName;
     std::string addrName GUARDED_BY(cs_addrName);
@@ -9,9 +9,11 @@
 #include <banman.h>
 #include <arith_uint256.h>
 #include <blockencodings.h>
+#include <blockfilter.h>
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <hash.h>
+#include <index/blockfilterindex.h>
 #include <validation.h>
 #include <merkleblock.h>
 #include <netmessagemaker.h>
@@ -64,6 +66,13 @@ static constexpr int STALE_RELAY_AGE_LIMIT = 30 * 24 * 60 * 60;
 /// Age after which a block is considered historical for purposes of rate
 /// limiting block relay. Set to one week, denominated in seconds.
 static constexpr int HISTORICAL_BLOCK_AGE = 7 * 24 * 60 * 60;
+/** Weight (as 1/N) given to each new sample in the per-peer block delivery interval average. */
+static constexpr int64_t BLOCK_INTERVAL_AVG_WEIGHT = 8;
+/** A block in flight from a peer is re-requested from a faster peer once it has been outstanding for
+ *  this many times the original peer's average delivery interval, and it is holding back the download window. */
+static constexpr int64_t BLOCK_REASSIGN_INTERVAL_FACTOR = 4;
+/** ...but never before it has been outstanding for this long, in microseconds. */
+static constexpr int64_t BLOCK_REASSIGN_MIN_AGE = 1000000;
 
 struct COrphanTx {
     // When modifying, adapt the copy of this definition in tests/DoS_tests.
@@ -90,10 +99,17 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
 /** Maximum number of inventory items to send per transmission.
  *  Limits the impact of low-fee transaction floods. */
 static constexpr unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTERVAL;
+/** Number of relayed transactions whose bloom filter match data is kept for reuse by other
+ *  BIP37 peers. */
+static constexpr unsigned int MAX_BLOOM_TX_ELEMENTS_CACHE = 1000;
 /** Average delay between feefilter broadcasts in seconds. */
 static constexpr unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
 /** Maximum feefilter broadcast delay after significant change. */
 static constexpr unsigned int MAX_FEEFILTER_CHANGE_DELAY = 5 * 60;
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static constexpr uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static constexpr uint32_t MAX_GETCFHEADERS_SIZE = 2000;
 
 // Internal stuff
 namespace {
@@ -135,6 +151,7 @@ namespace {
         uint256 hash;
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
+        int64_t nTimeRequested;                                  //!< When the block was requested (in microseconds).
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight GUARDED_BY(cs_main);
@@ -160,6 +177,12 @@ namespace {
     /** Expiration-time ordered list of (expire time, relay map entry) pairs. */
     std::deque<std::pair<int64_t, MapRelay::iterator>> vRelayExpiration GUARDED_BY(cs_main);
 
+    /** Bloom filter match data of recently relayed transactions, shared between BIP37 peers. */
+    typedef std::map<uint256, std::shared_ptr<const CBloomTxElements>> MapBloomTxElements;
+    MapBloomTxElements mapBloomTxElements GUARDED_BY(cs_main);
+    /** Insertion ordered list of mapBloomTxElements entries, oldest first. */
+    std::deque<MapBloomTxElements::iterator> vBloomTxElementsOrder GUARDED_BY(cs_main);
+
     std::atomic<int64_t> nTimeBestReceived(0); // Used only to inform the wallet of when we last received a block
 
     struct IteratorComparator
@@ -225,6 +248,10 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Moving average of the time between consecutive block deliveries from this peer (in microseconds), or 0.
+    int64_t m_block_interval_avg;
+    //! When this peer last delivered a block we requested (in microseconds), or 0.
+    int64_t m_last_block_delivery;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -292,6 +319,8 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        m_block_interval_avg = 0;
+        m_last_block_delivery = 0;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
@@ -389,7 +418,7 @@ static bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlock
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, GetTimeMicros(), std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -405,6 +434,49 @@ static bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlock
     return true;
 }
 
+/** Update the delivery rate estimate of a peer that just delivered a block we requested from it. */
+static void RecordBlockDelivery(NodeId nodeid, const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid) {
+        return;
+    }
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+
+    // With several blocks pipelined, the time since the previous delivery (rather than since the
+    // request) is the time the peer spent serving this block.
+    const int64_t nNow = GetTimeMicros();
+    const int64_t nInterval = std::max<int64_t>(nNow - std::max(itInFlight->second.second->nTimeRequested, state->m_last_block_delivery), 1);
+    if (state->m_block_interval_avg == 0) {
+        state->m_block_interval_avg = nInterval;
+    } else {
+        state->m_block_interval_avg += (nInterval - state->m_block_interval_avg) / BLOCK_INTERVAL_AVG_WEIGHT;
+    }
+    state->m_last_block_delivery = nNow;
+}
+
+static int GetBlocksInTransitTarget(const CNode* node, const CNodeState* state)
+{
+    return ComputeBlocksInTransitTarget(state->m_block_interval_avg, node->nMinPingUsecTime);
+}
+
+/** Whether a block in flight from another peer has been outstanding long enough, compared to how
+ *  fast that peer normally delivers and how fast the requesting peer does, to be re-requested. */
+static bool ShouldReassignBlock(const CNodeState* state, const CNodeState* stateOther, const QueuedBlock& queued, int64_t nNow)
+{
+    if (state->m_block_interval_avg == 0) {
+        // We don't know that the requesting peer would do any better.
+        return false;
+    }
+    if (stateOther->m_block_interval_avg != 0 && state->m_block_interval_avg * 2 > stateOther->m_block_interval_avg) {
+        // Not substantially faster than the peer that has the block in flight.
+        return false;
+    }
+    const int64_t nAge = nNow - queued.nTimeRequested;
+    const int64_t nExpected = std::max(stateOther->m_block_interval_avg, state->m_block_interval_avg);
+    return nAge > BLOCK_REASSIGN_MIN_AGE && nAge > BLOCK_REASSIGN_INTERVAL_FACTOR * nExpected;
+}
+
 /** Check whether the last unknown block a peer advertised is not yet known. */
 static void ProcessBlockAvailability(NodeId nodeid) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     CNodeState *state = State(nodeid);
@@ -506,7 +578,9 @@ static bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex) EXCLUSIV
 }
 
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
+ *  at most count entries. If the first in-flight block holding back the download window was requested
+ *  from a peer much slower than this one (see ShouldReassignBlock), all blocks in the window in flight
+ *  from that peer are added as well. */
 static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     if (count == 0)
@@ -544,6 +618,7 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
     int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
+    NodeId reassign_from = -1;
     while (pindexWalk->nHeight < nMaxHeight) {
         // Read up to 128 (or more, if more blocks than that are needed) successors of pindexWalk (towards
         // pindexBestKnownBlock) into vToFetch. We fetch 128, because CBlockIndex::GetAncestor may be as expensive
@@ -586,9 +661,26 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
                 if (vBlocks.size() == count) {
                     return;
                 }
-            } else if (waitingfor == -1) {
-                // This is the first already-in-flight block.
-                waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+            } else {
+                const auto& inflight = mapBlocksInFlight[pindex->GetBlockHash()];
+                if (waitingfor == -1) {
+                    // This is the first already-in-flight block.
+                    waitingfor = inflight.first;
+                    if (waitingfor != nodeid && ShouldReassignBlock(state, State(waitingfor), *inflight.second, GetTimeMicros())) {
+                        LogPrint(BCLog::NET, "Reassigning blocks in flight from slow peer=%d to peer=%d, starting at %s (%d)\n",
+                            waitingfor, nodeid, pindex->GetBlockHash().ToString(), pindex->nHeight);
+                        reassign_from = waitingfor;
+                        waitingfor = nodeid;
+                    }
+                }
+                if (inflight.first == reassign_from) {
+                    // The peer holding back the window would hold it back again with its other
+                    // blocks, so all of them in the window are requested from this peer instead.
+                    vBlocks.push_back(pindex);
+                    if (vBlocks.size() == count) {
+                        return;
+                    }
+                }
             }
         }
     }
@@ -596,6 +688,20 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
 
 } // namespace
 
+int ComputeBlocksInTransitTarget(int64_t block_interval_usec, int64_t ping_usec)
+{
+    if (block_interval_usec <= 0) {
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    }
+    if (ping_usec <= 0 || ping_usec == std::numeric_limits<int64_t>::max()) {
+        ping_usec = 0;
+    }
+    // Enough requests to keep the peer busy while a new request travels to it, doubled so that
+    // rate fluctuations don't drain the pipeline.
+    const int64_t nTarget = 2 * (1 + ping_usec / block_interval_usec);
+    return (int)std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(nTarget, MAX_BLOCKS_IN_TRANSIT_PER_PEER_ADAPTIVE));
+}
+
 // This function is used for testing the stale tip eviction logic, see
 // denialofservice_tests.cpp
 void UpdateLastBlockAnnounceTime(NodeId node, int64_t time_in_seconds)
@@ -667,6 +773,7 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     stats.nMisbehavior = state->nMisbehavior;
     stats.nSyncHeight = state->pindexBestKnownBlock ? state->pindexBestKnownBlock->nHeight : -1;
     stats.nCommonHeight = state->pindexLastCommonBlock ? state->pindexLastCommonBlock->nHeight : -1;
+    stats.nBlockIntervalUsec = state->m_block_interval_avg;
     for (const QueuedBlock& queue : state->vBlocksInFlight) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
@@ -911,6 +1018,46 @@ static std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block GUARDED_BY(cs_most_recent_block);
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
 static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block);
+// Bloom filter match data for most_recent_block, built on the first filtered request for it
+static std::shared_ptr<const std::vector<CBloomTxElements>> most_recent_block_bloom_elements GUARDED_BY(cs_most_recent_block);
+
+/**
+ * Get the bloom filter match data of the most recent block, which every BIP37 peer asks for
+ * shortly after it is announced. Returns nullptr if pblock is no longer the most recent block.
+ */
+static std::shared_ptr<const std::vector<CBloomTxElements>> GetMostRecentBlockBloomElements(const std::shared_ptr<const CBlock>& pblock)
+{
+    {
+        LOCK(cs_most_recent_block);
+        if (most_recent_block != pblock) return nullptr;
+        if (most_recent_block_bloom_elements) return most_recent_block_bloom_elements;
+    }
+
+    auto block_elements = std::make_shared<std::vector<CBloomTxElements>>();
+    block_elements->reserve(pblock->vtx.size());
+    for (const CTransactionRef& tx : pblock->vtx) {
+        block_elements->emplace_back(tx);
+    }
+
+    LOCK(cs_most_recent_block);
+    if (most_recent_block == pblock) most_recent_block_bloom_elements = block_elements;
+    return block_elements;
+}
+
+/** Get the bloom filter match data of a transaction being relayed, preparing it if needed. */
+static std::shared_ptr<const CBloomTxElements> GetRelayBloomTxElements(const CTransactionRef& tx) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    auto it = mapBloomTxElements.find(tx->GetHash());
+    if (it != mapBloomTxElements.end()) return it->second;
+
+    if (vBloomTxElementsOrder.size() >= MAX_BLOOM_TX_ELEMENTS_CACHE) {
+        mapBloomTxElements.erase(vBloomTxElementsOrder.front());
+        vBloomTxElementsOrder.pop_front();
+    }
+    it = mapBloomTxElements.emplace(tx->GetHash(), std::make_shared<const CBloomTxElements>(tx)).first;
+    vBloomTxElementsOrder.push_back(it);
+    return it->second;
+}
 
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
@@ -935,6 +1082,7 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         most_recent_block_hash = hashBlock;
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
+        most_recent_block_bloom_elements.reset();
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
     }
 
@@ -1204,7 +1352,7 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
         } else {
             // Send block from disk
             std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
+            if (!ReadBlockFromDiskWithStoredTxHashes(*pblockRead, pindex, consensusParams))
                 assert(!"cannot load block from disk");
             pblock = pblockRead;
         }
@@ -1217,11 +1365,19 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
             {
                 bool sendMerkleBlock = false;
                 CMerkleBlock merkleBlock;
+                std::shared_ptr<const std::vector<CBloomTxElements>> block_elements;
+                if (pblock == a_recent_block) {
+                    block_elements = GetMostRecentBlockBloomElements(pblock);
+                }
                 {
                     LOCK(pfrom->cs_filter);
                     if (pfrom->pfilter) {
                         sendMerkleBlock = true;
-                        merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter);
+                        if (block_elements) {
+                            merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter, *block_elements);
+                        } else {
+                            merkleBlock = CMerkleBlock(*pblock, *pfrom->pfilter);
+                        }
                     }
                 }
                 if (sendMerkleBlock) {
@@ -1524,8 +1680,9 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
             } else {
                 std::vector<CInv> vGetData;
                 // Download as much as possible, from earliest to latest.
+                const int nTarget = GetBlocksInTransitTarget(pfrom, nodestate);
                 for (const CBlockIndex *pindex : reverse_iterate(vToFetch)) {
-                    if (nodestate->nBlocksInFlight >= MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+                    if (nodestate->nBlocksInFlight >= nTarget) {
                         // Can't download any more from this peer
                         break;
                     }
@@ -1644,6 +1801,217 @@ void static ProcessOrphanTx(CConnman* connman, std::set<uint256>& orphan_work_se
     }
 }
 
+/**
+ * Validation logic for compact filters request handling.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   filter_type     The filter type the request is for. Must be basic filters.
+ * @param[in]   start_height    The start height for the request
+ * @param[in]   stop_hash       The stop_hash for the request
+ * @param[in]   max_height_diff The maximum number of items permitted to request, as specified in BIP 157
+ * @param[out]  stop_index      The CBlockIndex for the stop_hash block, if the request can be serviced.
+ * @param[out]  filter_index    The filter index, if the request can be serviced.
+ * @return                      True if the request can be serviced.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, const CChainParams& chain_params,
+                                      BlockFilterType filter_type, uint32_t start_height,
+                                      const uint256& stop_hash, uint32_t max_height_diff,
+                                      const CBlockIndex*& stop_index,
+                                      BlockFilterIndex*& filter_index)
+{
+    const bool supported_filter_type =
+        (filter_type == BlockFilterType::BASIC &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        stop_index = LookupBlockIndex(stop_hash);
+
+        // Check that the stop block exists and the peer would be allowed to fetch it.
+        if (!stop_index || !BlockRequestAllowed(stop_index, chain_params.GetConsensus())) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with " /* Continued */
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1, max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    filter_index = GetBlockFilterIndex(filter_type);
+    if (!filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n", BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handle a cfilters request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, const CChainParams& chain_params,
+                               CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type, start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    for (const auto& filter : filters) {
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::CFILTER, filter));
+    }
+}
+
+/**
+ * Handle a cfheaders request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, const CChainParams& chain_params,
+                                CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type, start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex* const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!filter_index->LookupFilterHashRange(start_height, stop_index, filter_hashes)) {
+        LogPrint(BCLog::NET, "Failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::CFHEADERS,
+                                                                          filter_type_ser,
+                                                                          stop_index->GetBlockHash(),
+                                                                          prev_header,
+                                                                          filter_hashes));
+}
+
+/**
+ * Handle a getcfcheckpt request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, const CChainParams& chain_params,
+                                CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type, /*start_height=*/0, stop_hash,
+                                   /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+                                   stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex* block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type), block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::CFCHECKPT,
+                                                                          filter_type_ser,
+                                                                          stop_index->GetBlockHash(),
+                                                                          headers));
+}
+
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc, bool enable_bip61)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
@@ -2189,7 +2557,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
 
         CBlock block;
-        bool ret = ReadBlockFromDisk(block, pindex, chainparams.GetConsensus());
+        bool ret = ReadBlockFromDiskWithStoredTxHashes(block, pindex, chainparams.GetConsensus());
         assert(ret);
 
         SendBlockTransactions(block, req, pfrom, connman);
@@ -2679,6 +3047,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 // though the block was successfully read, and rely on the
                 // handling in ProcessNewBlock to ensure the block index is
                 // updated, reject messages go out, etc.
+                RecordBlockDelivery(pfrom->GetId(), resp.blockhash);
                 MarkBlockAsReceived(resp.blockhash); // it is now an empty pointer
                 fBlockRead = true;
                 // mapBlockSource is only used for sending reject messages and DoS scores,
@@ -2746,6 +3115,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
+            RecordBlockDelivery(pfrom->GetId(), hash);
             forceProcessing |= MarkBlockAsReceived(hash);
             // mapBlockSource is only used for sending reject messages and DoS scores,
             // so the race between here and cs_main in ProcessNewBlock is fine.
@@ -2955,6 +3325,21 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         return true;
     }
 
+    if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, chainparams, connman);
+        return true;
+    }
+
+    if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, chainparams, connman);
+        return true;
+    }
+
+    if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, chainparams, connman);
+        return true;
+    }
+
     if (strCommand == NetMsgType::NOTFOUND) {
         // We do not care about the NOTFOUND message, but logging an Unknown Command
         // message would be undesirable as we transmit it ourselves.
@@ -3242,18 +3627,15 @@ void PeerLogicValidation::CheckForStaleTipAndEvictPeers(const Consensus::Params
 namespace {
 class CompareInvMempoolOrder
 {
-    CTxMemPool *mp;
+    const std::vector<TxMempoolRelayInfo>& m_infos;
 public:
-    explicit CompareInvMempoolOrder(CTxMemPool *_mempool)
-    {
-        mp = _mempool;
-    }
+    explicit CompareInvMempoolOrder(const std::vector<TxMempoolRelayInfo>& infos) : m_infos(infos) {}
 
-    bool operator()(std::set<uint256>::iterator a, std::set<uint256>::iterator b)
+    bool operator()(size_t a, size_t b) const
     {
         /* As std::make_heap produces a max-heap, we want the entries with the
          * fewest ancestors/highest fee to sort later. */
-        return mp->CompareDepthAndScore(*b, *a);
+        return CTxMemPool::CompareDepthAndScore(m_infos[b], m_infos[a]);
     }
 };
 }
@@ -3464,7 +3846,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                     }
                     if (!fGotBlockFromCache) {
                         CBlock block;
-                        bool ret = ReadBlockFromDisk(block, pBestIndex, consensusParams);
+                        bool ret = ReadBlockFromDiskWithStoredTxHashes(block, pBestIndex, consensusParams);
                         assert(ret);
                         CBlockHeaderAndShortTxIDs cmpctblock(block, state.fWantsCmpctWitness);
                         connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
@@ -3586,9 +3968,19 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
             if (fSendTrickle) {
                 // Produce a vector with all candidates for sending
                 std::vector<std::set<uint256>::iterator> vInvTx;
+                std::vector<uint256> vInvHashes;
                 vInvTx.reserve(pto->setInventoryTxToSend.size());
+                vInvHashes.reserve(pto->setInventoryTxToSend.size());
                 for (std::set<uint256>::iterator it = pto->setInventoryTxToSend.begin(); it != pto->setInventoryTxToSend.end(); it++) {
                     vInvTx.push_back(it);
+                    vInvHashes.push_back(*it);
+                }
+                // Look all candidates up in one go, rather than taking the mempool lock for
+                // every comparison and every transaction sent.
+                std::vector<TxMempoolRelayInfo> vInvInfo = mempool.infoForRelay(vInvHashes);
+                std::vector<size_t> vInvHeap(vInvTx.size());
+                for (size_t i = 0; i < vInvHeap.size(); ++i) {
+                    vInvHeap[i] = i;
                 }
                 CAmount filterrate = 0;
                 {
@@ -3597,17 +3989,18 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                 }
                 // Topologically and fee-rate sort the inventory we send for privacy and priority reasons.
                 // A heap is used so that not all items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&mempool);
-                std::make_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
+                CompareInvMempoolOrder compareInvMempoolOrder(vInvInfo);
+                std::make_heap(vInvHeap.begin(), vInvHeap.end(), compareInvMempoolOrder);
                 // No reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much shorter delays.
                 unsigned int nRelayedTransactions = 0;
                 LOCK(pto->cs_filter);
-                while (!vInvTx.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
+                while (!vInvHeap.empty() && nRelayedTransactions < INVENTORY_BROADCAST_MAX) {
                     // Fetch the top element from the heap
-                    std::pop_heap(vInvTx.begin(), vInvTx.end(), compareInvMempoolOrder);
-                    std::set<uint256>::iterator it = vInvTx.back();
-                    vInvTx.pop_back();
+                    std::pop_heap(vInvHeap.begin(), vInvHeap.end(), compareInvMempoolOrder);
+                    const size_t index = vInvHeap.back();
+                    vInvHeap.pop_back();
+                    std::set<uint256>::iterator it = vInvTx[index];
                     uint256 hash = *it;
                     // Remove it from the to-be-sent set
                     pto->setInventoryTxToSend.erase(it);
@@ -3616,14 +4009,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                         continue;
                     }
                     // Not in the mempool anymore? don't bother sending it.
-                    auto txinfo = mempool.info(hash);
+                    TxMempoolInfo& txinfo = vInvInfo[index].info;
                     if (!txinfo.tx) {
                         continue;
                     }
                     if (filterrate && txinfo.feeRate.GetFeePerK() < filterrate) {
                         continue;
                     }
-                    if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
+                    if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*GetRelayBloomTxElements(txinfo.tx))) continue;
                     // Send
                     vInv.push_back(CInv(MSG_TX, hash));
                     nRelayedTransactions++;
@@ -3716,10 +4109,11 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        const int nBlocksInTransitTarget = GetBlocksInTransitTarget(pto, &state);
+        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !IsInitialBlockDownload()) && state.nBlocksInFlight < nBlocksInTransitTarget) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextBlocksToDownload(pto->GetId(), nBlocksInTransitTarget - state.nBlocksInFlight, vToDownload, staller, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
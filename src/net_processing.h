@@ -19,6 +19,8 @@ static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 /** Default for BIP61 (sending reject messages) */
 static constexpr bool DEFAULT_ENABLE_BIP61{true};
+/** Default for -peerblockfilters, serve BIP 157 compact block filters to peers */
+static constexpr bool DEFAULT_PEERBLOCKFILTERS{false};
 
 class PeerLogicValidation final : public CValidationInterface, public NetEventsInterface {
 private:
@@ -84,8 +86,17 @@ struct CNodeStateStats {
     int nSyncHeight = -1;
     int nCommonHeight = -1;
     std::vector<int> vHeightInFlight;
+    int64_t nBlockIntervalUsec = 0;
 };
 
+/**
+ * Size a peer's in-flight block window from its measured per-block delivery
+ * interval and round-trip time, so that enough requests are outstanding to
+ * cover one RTT of delivery (with headroom). Returns MAX_BLOCKS_IN_TRANSIT_PER_PEER
+ * until a delivery interval has been measured.
+ */
+int ComputeBlocksInTransitTarget(int64_t block_interval_usec, int64_t ping_usec);
+
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 
@@ -0,0 +1,124 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NETBUFFERPOOL_H
+#define BITCOIN_NETBUFFERPOOL_H
+
+#include <sync.h>
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/** Largest buffer kept in the small class: control messages such as ping, inv and headers of messages. */
+static const size_t NET_BUFFER_SMALL_SIZE = 1024;
+/** Largest buffer kept in the tx class. Standard transactions are at most 100 kB. */
+static const size_t NET_BUFFER_TX_SIZE = 128 * 1024;
+/** Largest buffer kept in the block class; twice the message size limit, as vectors grow geometrically. */
+static const size_t NET_BUFFER_BLOCK_SIZE = 8 * 1000 * 1000;
+
+/**
+ * Pool of network message buffers. A buffer is requested for the size of the message it will hold
+ * and handed back once the message is done with; returned buffers are kept in one of three size
+ * classes (control messages, transactions, blocks), up to a per-class limit, and handed out again
+ * instead of allocating. At high message rates this keeps the network threads out of the
+ * allocator, and received messages no longer grow their buffer by repeated reallocation.
+ *
+ * Buffers are cleared but not wiped when returned; only use this for data that is public anyway.
+ */
+template <typename Buffer>
+class CNetBufferPool
+{
+public:
+    enum SizeClass {
+        SMALL,
+        TX,
+        BLOCK,
+        NUM_SIZE_CLASSES
+    };
+
+    struct Stats {
+        //! Requests served with a pooled buffer
+        uint64_t reused;
+        //! Requests for which no pooled buffer was available
+        uint64_t allocated;
+        //! Buffers currently kept in the pool
+        size_t pooled;
+    };
+
+    /** Construct a pool keeping at most the given number of buffers in each size class. */
+    CNetBufferPool(size_t max_small, size_t max_tx, size_t max_block) :
+        m_max_count{max_small, max_tx, max_block}
+    {
+        for (int i = 0; i < NUM_SIZE_CLASSES; ++i) {
+            m_reused[i] = 0;
+            m_allocated[i] = 0;
+        }
+    }
+
+    static SizeClass GetSizeClass(size_t size)
+    {
+        if (size <= NET_BUFFER_SMALL_SIZE) return SMALL;
+        if (size <= NET_BUFFER_TX_SIZE) return TX;
+        return BLOCK;
+    }
+
+    /**
+     * Get an empty buffer for a message of the given size. The buffer's capacity is whatever it
+     * had when returned; it is not reserved up front, so a peer announcing a large message does
+     * not make us allocate for it before the data arrives.
+     */
+    Buffer Get(size_t size)
+    {
+        const SizeClass size_class = GetSizeClass(size);
+        {
+            LOCK(m_mutex);
+            std::vector<Buffer>& free = m_free[size_class];
+            if (!free.empty()) {
+                Buffer buffer = std::move(free.back());
+                free.pop_back();
+                ++m_reused[size_class];
+                return buffer;
+            }
+        }
+        ++m_allocated[size_class];
+        return Buffer();
+    }
+
+    /** Return a buffer to the pool. Buffers that do not fit in a size class are freed. */
+    void Put(Buffer&& buffer)
+    {
+        const size_t capacity = buffer.capacity();
+        if (capacity == 0 || capacity > NET_BUFFER_BLOCK_SIZE) return;
+        const SizeClass size_class = GetSizeClass(capacity);
+        buffer.clear();
+        LOCK(m_mutex);
+        std::vector<Buffer>& free = m_free[size_class];
+        if (free.size() < m_max_count[size_class]) {
+            free.push_back(std::move(buffer));
+        }
+    }
+
+    Stats GetStats(SizeClass size_class) const
+    {
+        Stats stats;
+        stats.reused = m_reused[size_class];
+        stats.allocated = m_allocated[size_class];
+        LOCK(m_mutex);
+        stats.pooled = m_free[size_class].size();
+        return stats;
+    }
+
+private:
+    const size_t m_max_count[NUM_SIZE_CLASSES];
+
+    mutable Mutex m_mutex;
+    std::vector<Buffer> m_free[NUM_SIZE_CLASSES] GUARDED_BY(m_mutex);
+
+    std::atomic<uint64_t> m_reused[NUM_SIZE_CLASSES];
+    std::atomic<uint64_t> m_allocated[NUM_SIZE_CLASSES];
+};
+
+#endif // BITCOIN_NETBUFFERPOOL_H
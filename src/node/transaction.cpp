@@ -10,7 +10,9 @@
 #include <validationinterface.h>
 #include <node/transaction.h>
 
+#include <algorithm>
 #include <future>
+#include <map>
 
 std::string TransactionErrorString(const TransactionError err)
 {
@@ -38,13 +40,14 @@ std::string TransactionErrorString(const TransactionError err)
     assert(false);
 }
 
-TransactionError BroadcastTransaction(const CTransactionRef tx, uint256& hashTx, std::string& err_string, const CAmount& highfee)
+/**
+ * Add a transaction to the mempool unless it is already there or in the chain. added is set when
+ * it was added; the wallets may then not have seen it yet.
+ */
+static TransactionError SubmitTransaction(const CTransactionRef& tx, std::string& err_string, const CAmount& highfee, bool& added) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
-    std::promise<void> promise;
-    hashTx = tx->GetHash();
-
-    { // cs_main scope
-    LOCK(cs_main);
+    added = false;
+    const uint256& hashTx = tx->GetHash();
     CCoinsViewCache &view = *pcoinsTip;
     bool fHaveChain = false;
     for (size_t o = 0; !fHaveChain && o < tx->vout.size(); o++) {
@@ -56,7 +59,7 @@ TransactionError BroadcastTransaction(const CTransactionRef tx, uint256& hashTx,
         // push to local node and sync with wallets
         CValidationState state;
         bool fMissingInputs;
-        if (!AcceptToMemoryPool(mempool, state, std::move(tx), &fMissingInputs,
+        if (!AcceptToMemoryPool(mempool, state, tx, &fMissingInputs,
                                 nullptr /* plTxnReplaced */, false /* bypass_limits */, highfee)) {
             if (state.IsInvalid()) {
                 err_string = FormatStateMessage(state);
@@ -68,18 +71,35 @@ TransactionError BroadcastTransaction(const CTransactionRef tx, uint256& hashTx,
                 err_string = FormatStateMessage(state);
                 return TransactionError::MEMPOOL_ERROR;
             }
-        } else {
-            // If wallet is enabled, ensure that the wallet has been made aware
-            // of the new transaction prior to returning. This prevents a race
-            // where a user might call sendrawtransaction with a transaction
-            // to/from their wallet, immediately call some wallet RPC, and get
-            // a stale result because callbacks have not yet been processed.
-            CallFunctionInValidationInterfaceQueue([&promise] {
-                promise.set_value();
-            });
         }
+        added = true;
     } else if (fHaveChain) {
         return TransactionError::ALREADY_IN_CHAIN;
+    }
+    return TransactionError::OK;
+}
+
+TransactionError BroadcastTransaction(const CTransactionRef tx, uint256& hashTx, std::string& err_string, const CAmount& highfee)
+{
+    std::promise<void> promise;
+    hashTx = tx->GetHash();
+
+    { // cs_main scope
+    LOCK(cs_main);
+    bool added;
+    const TransactionError err = SubmitTransaction(tx, err_string, highfee, added);
+    if (err != TransactionError::OK) {
+        return err;
+    }
+    if (added) {
+        // If wallet is enabled, ensure that the wallet has been made aware
+        // of the new transaction prior to returning. This prevents a race
+        // where a user might call sendrawtransaction with a transaction
+        // to/from their wallet, immediately call some wallet RPC, and get
+        // a stale result because callbacks have not yet been processed.
+        CallFunctionInValidationInterfaceQueue([&promise] {
+            promise.set_value();
+        });
     } else {
         // Make sure we don't block forever if re-sending
         // a transaction already in mempool.
@@ -101,3 +121,104 @@ TransactionError BroadcastTransaction(const CTransactionRef tx, uint256& hashTx,
 
     return TransactionError::OK;
 }
+
+/**
+ * Order a batch of transactions so that each comes after the transactions of the batch it spends
+ * from, keeping the given order otherwise. parents is set to the batch positions each transaction
+ * spends from.
+ */
+static std::vector<size_t> SortParentsFirst(const std::vector<CTransactionRef>& txs, std::vector<std::vector<size_t>>& parents)
+{
+    std::map<uint256, size_t> positions;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        positions.emplace(txs[i]->GetHash(), i);
+    }
+
+    parents.assign(txs.size(), std::vector<size_t>());
+    std::vector<std::vector<size_t>> children(txs.size());
+    std::vector<size_t> missing_parents(txs.size(), 0);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        for (const CTxIn& txin : txs[i]->vin) {
+            auto it = positions.find(txin.prevout.hash);
+            if (it == positions.end() || it->second == i) continue;
+            if (std::find(parents[i].begin(), parents[i].end(), it->second) != parents[i].end()) continue;
+            parents[i].push_back(it->second);
+            children[it->second].push_back(i);
+            ++missing_parents[i];
+        }
+    }
+
+    std::vector<size_t> order;
+    order.reserve(txs.size());
+    for (size_t i = 0; i < txs.size(); ++i) {
+        if (missing_parents[i] == 0) order.push_back(i);
+    }
+    for (size_t done = 0; done < order.size(); ++done) {
+        for (size_t child : children[order[done]]) {
+            if (--missing_parents[child] == 0) order.push_back(child);
+        }
+    }
+    // Transaction hashes commit to their inputs, so there are no cycles and every transaction
+    // has been ordered.
+    assert(order.size() == txs.size());
+    return order;
+}
+
+std::vector<TransactionError> BroadcastTransactions(const std::vector<CTransactionRef>& txs, std::vector<std::string>& err_strings, const CAmount& highfee)
+{
+    std::vector<TransactionError> errors(txs.size(), TransactionError::OK);
+    err_strings.assign(txs.size(), std::string());
+    std::vector<std::vector<size_t>> parents;
+    const std::vector<size_t> order = SortParentsFirst(txs, parents);
+
+    std::promise<void> promise;
+    { // cs_main scope
+    LOCK(cs_main);
+    bool any_added = false;
+    for (size_t i : order) {
+        bool parent_rejected = false;
+        for (size_t parent : parents[i]) {
+            if (errors[parent] != TransactionError::OK && errors[parent] != TransactionError::ALREADY_IN_CHAIN) {
+                parent_rejected = true;
+                break;
+            }
+        }
+        if (parent_rejected) {
+            errors[i] = TransactionError::MISSING_INPUTS;
+            continue;
+        }
+        bool added;
+        errors[i] = SubmitTransaction(txs[i], err_strings[i], highfee, added);
+        any_added |= added;
+    }
+    if (any_added) {
+        // As in BroadcastTransaction, but once for the whole batch.
+        CallFunctionInValidationInterfaceQueue([&promise] {
+            promise.set_value();
+        });
+    } else {
+        promise.set_value();
+    }
+    } // cs_main
+
+    promise.get_future().wait();
+
+    std::vector<CInv> invs;
+    for (size_t i = 0; i < txs.size(); ++i) {
+        if (errors[i] != TransactionError::OK) continue;
+        if (!g_connman) {
+            errors[i] = TransactionError::P2P_DISABLED;
+            continue;
+        }
+        invs.emplace_back(MSG_TX, txs[i]->GetHash());
+    }
+    if (!invs.empty()) {
+        g_connman->ForEachNode([&invs](CNode* pnode) {
+            for (const CInv& inv : invs) {
+                pnode->PushInventory(inv);
+            }
+        });
+    }
+
+    return errors;
+}
@@ -9,6 +9,9 @@
 #include <primitives/transaction.h>
 #include <uint256.h>
 
+#include <string>
+#include <vector>
+
 enum class TransactionError {
     OK, //!< No error
     MISSING_INPUTS,
@@ -34,4 +37,18 @@ std::string TransactionErrorString(const TransactionError error);
  */
 NODISCARD TransactionError BroadcastTransaction(CTransactionRef tx, uint256& txid, std::string& err_string, const CAmount& highfee);
 
+/**
+ * Broadcast a batch of transactions, which may spend each other's outputs and be in any order.
+ * Transactions are added to the mempool parents first, all under a single cs_main lock, and the
+ * caller waits for the wallets to catch up only once for the whole batch. A transaction spending
+ * an output of a transaction earlier rejected from the batch is not validated and reported as
+ * MISSING_INPUTS.
+ *
+ * @param[in]  txs the transactions to broadcast
+ * @param[out] &err_strings for each transaction, the error string if available
+ * @param[in]  highfee Reject txs with fees higher than this (if 0, accept any fee)
+ * return for each transaction, in the order of txs, the error
+ */
+std::vector<TransactionError> BroadcastTransactions(const std::vector<CTransactionRef>& txs, std::vector<std::string>& err_strings, const CAmount& highfee);
+
 #endif // BITCOIN_NODE_TRANSACTION_H
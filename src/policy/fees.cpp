@@ -38,6 +38,7 @@ std::string StringForFeeReason(FeeReason reason) {
         {FeeReason::PAYTXFEE, "PayTxFee set"},
         {FeeReason::FALLBACK, "Fallback fee"},
         {FeeReason::REQUIRED, "Minimum Required Fee"},
+        {FeeReason::MEMPOOL_PROJECTION, "Mempool projection"},
     };
     auto reason_string = fee_reason_strings.find(reason);
 
@@ -51,6 +52,7 @@ bool FeeModeFromString(const std::string& mode_string, FeeEstimateMode& fee_esti
         {"UNSET", FeeEstimateMode::UNSET},
         {"ECONOMICAL", FeeEstimateMode::ECONOMICAL},
         {"CONSERVATIVE", FeeEstimateMode::CONSERVATIVE},
+        {"MEMPOOL", FeeEstimateMode::MEMPOOL},
     };
     auto mode = fee_modes.find(mode_string);
 
@@ -80,13 +82,19 @@ private:
     // Track the historical moving average of this total over blocks
     std::vector<double> txCtAvg;
 
+    // The per-period averages below are stored period after period in one contiguous
+    // array, confAvg[Y * bucketCount + X], so that decaying them is a single pass over
+    // memory which the compiler can vectorize.
+    size_t bucketCount;
+    size_t periodCount;
+
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
-    std::vector<std::vector<double>> confAvg; // confAvg[Y][X]
+    std::vector<double> confAvg; // confAvg[Y * bucketCount + X]
 
     // Track moving avg of txs which have been evicted from the mempool
     // after failing to be confirmed within Y blocks
-    std::vector<std::vector<double>> failAvg; // failAvg[Y][X]
+    std::vector<double> failAvg; // failAvg[Y * bucketCount + X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
@@ -109,6 +117,9 @@ private:
 
     void resizeInMemoryCounters(size_t newbuckets);
 
+    /** Multiply every element of values by decay */
+    static void Decay(std::vector<double>& values, double decay);
+
 public:
     /**
      * Create new TxConfirmStats. This is called by BlockPolicyEstimator's
@@ -158,7 +169,7 @@ public:
                              EstimationResult *result = nullptr) const;
 
     /** Return the max number of confirms we're tracking */
-    unsigned int GetMaxConfirms() const { return scale * confAvg.size(); }
+    unsigned int GetMaxConfirms() const { return scale * periodCount; }
 
     /** Write state of estimation data to a file*/
     void Write(CAutoFile& fileout) const;
@@ -179,14 +190,10 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
     decay = _decay;
     assert(_scale != 0 && "_scale must be non-zero");
     scale = _scale;
-    confAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        confAvg[i].resize(buckets.size());
-    }
-    failAvg.resize(maxPeriods);
-    for (unsigned int i = 0; i < maxPeriods; i++) {
-        failAvg[i].resize(buckets.size());
-    }
+    bucketCount = buckets.size();
+    periodCount = maxPeriods;
+    confAvg.resize(periodCount * bucketCount);
+    failAvg.resize(periodCount * bucketCount);
 
     txCtAvg.resize(buckets.size());
     avg.resize(buckets.size());
@@ -220,25 +227,30 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
         return;
     int periodsToConfirm = (blocksToConfirm + scale - 1)/scale;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    for (size_t i = periodsToConfirm; i <= confAvg.size(); i++) {
-        confAvg[i - 1][bucketindex]++;
+    for (size_t i = periodsToConfirm; i <= periodCount; i++) {
+        confAvg[(i - 1) * bucketCount + bucketindex]++;
     }
     txCtAvg[bucketindex]++;
     avg[bucketindex] += val;
 }
 
-void TxConfirmStats::UpdateMovingAverages()
+void TxConfirmStats::Decay(std::vector<double>& values, double decay)
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay;
-        for (unsigned int i = 0; i < failAvg.size(); i++)
-            failAvg[i][j] = failAvg[i][j] * decay;
-        avg[j] = avg[j] * decay;
-        txCtAvg[j] = txCtAvg[j] * decay;
+    double* const data = values.data();
+    const size_t size = values.size();
+    for (size_t i = 0; i < size; i++) {
+        data[i] *= decay;
     }
 }
 
+void TxConfirmStats::UpdateMovingAverages()
+{
+    Decay(confAvg, decay);
+    Decay(failAvg, decay);
+    Decay(avg, decay);
+    Decay(txCtAvg, decay);
+}
+
 // returns -1 on error conditions
 double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
                                          double successBreakPoint, bool requireGreater,
@@ -284,9 +296,9 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
             newBucketRange = false;
         }
         curFarBucket = bucket;
-        nConf += confAvg[periodTarget - 1][bucket];
+        nConf += confAvg[(periodTarget - 1) * bucketCount + bucket];
         totalNum += txCtAvg[bucket];
-        failNum += failAvg[periodTarget - 1][bucket];
+        failNum += failAvg[(periodTarget - 1) * bucketCount + bucket];
         for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
             extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
         extraNum += oldUnconfTxs[bucket];
@@ -392,14 +404,33 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     return median;
 }
 
+/** The estimates file stores the per-period averages as one vector per period. */
+static std::vector<std::vector<double>> SplitPeriods(const std::vector<double>& values, size_t bucketCount)
+{
+    std::vector<std::vector<double>> periods;
+    for (auto it = values.begin(); it != values.end(); it += bucketCount) {
+        periods.emplace_back(it, it + bucketCount);
+    }
+    return periods;
+}
+
+static std::vector<double> JoinPeriods(const std::vector<std::vector<double>>& periods)
+{
+    std::vector<double> values;
+    for (const std::vector<double>& period : periods) {
+        values.insert(values.end(), period.begin(), period.end());
+    }
+    return values;
+}
+
 void TxConfirmStats::Write(CAutoFile& fileout) const
 {
     fileout << decay;
     fileout << scale;
     fileout << avg;
     fileout << txCtAvg;
-    fileout << confAvg;
-    fileout << failAvg;
+    fileout << SplitPeriods(confAvg, bucketCount);
+    fileout << SplitPeriods(failAvg, bucketCount);
 }
 
 void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets)
@@ -427,29 +458,36 @@ void TxConfirmStats::Read(CAutoFile& filein, int nFileVersion, size_t numBuckets
     if (txCtAvg.size() != numBuckets) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in tx count bucket count");
     }
-    filein >> confAvg;
-    maxPeriods = confAvg.size();
+    std::vector<std::vector<double>> fileConfAvg;
+    filein >> fileConfAvg;
+    maxPeriods = fileConfAvg.size();
     maxConfirms = scale * maxPeriods;
 
     if (maxConfirms <= 0 || maxConfirms > 6 * 24 * 7) { // one week
         throw std::runtime_error("Corrupt estimates file.  Must maintain estimates for between 1 and 1008 (one week) confirms");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (confAvg[i].size() != numBuckets) {
+        if (fileConfAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in feerate conf average bucket count");
         }
     }
 
-    filein >> failAvg;
-    if (maxPeriods != failAvg.size()) {
+    std::vector<std::vector<double>> fileFailAvg;
+    filein >> fileFailAvg;
+    if (maxPeriods != fileFailAvg.size()) {
         throw std::runtime_error("Corrupt estimates file. Mismatch in confirms tracked for failures");
     }
     for (unsigned int i = 0; i < maxPeriods; i++) {
-        if (failAvg[i].size() != numBuckets) {
+        if (fileFailAvg[i].size() != numBuckets) {
             throw std::runtime_error("Corrupt estimates file. Mismatch in one of failure average bucket counts");
         }
     }
 
+    bucketCount = numBuckets;
+    periodCount = maxPeriods;
+    confAvg = JoinPeriods(fileConfAvg);
+    failAvg = JoinPeriods(fileFailAvg);
+
     // Resize the current block variables which aren't stored in the data file
     // to match the number of confirms and buckets
     resizeInMemoryCounters(numBuckets);
@@ -497,8 +535,8 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     if (!inBlock && (unsigned int)blocksAgo >= scale) { // Only counts as a failure if not confirmed for entire period
         assert(scale != 0);
         unsigned int periodsAgo = blocksAgo / scale;
-        for (size_t i = 0; i < periodsAgo && i < failAvg.size(); i++) {
-            failAvg[i][bucketindex]++;
+        for (size_t i = 0; i < periodsAgo && i < periodCount; i++) {
+            failAvg[i * bucketCount + bucketindex]++;
         }
     }
 }
@@ -524,7 +562,7 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash, bool inBlock)
 }
 
 CBlockPolicyEstimator::CBlockPolicyEstimator()
-    : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), trackedTxs(0), untrackedTxs(0)
+    : nBestSeenHeight(0), firstRecordedHeight(0), historicalFirst(0), historicalBest(0), lastWrittenHeight(0), trackedTxs(0), untrackedTxs(0)
 {
     static_assert(MIN_BUCKET_FEERATE > 0, "Min feerate must be nonzero");
     size_t bucketIndex = 0;
@@ -707,6 +745,28 @@ CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThr
     return CFeeRate(llround(median));
 }
 
+CFeeRate CBlockPolicyEstimator::estimateSmartFeeWithMempool(int confTarget, FeeCalculation *feeCalc, bool conservative, const CTxMemPool& pool) const
+{
+    CFeeRate estimate = estimateSmartFee(confTarget, feeCalc, conservative);
+    {
+        LOCK(m_cs_fee_estimator);
+        if (confTarget <= 0 || (unsigned int)confTarget > longStats->GetMaxConfirms()) {
+            return estimate;
+        }
+    }
+
+    // The mempool calls into the estimator under its own lock, so it must not be called with ours held.
+    const CFeeRate projected = pool.GetProjectedFeeRate(confTarget);
+    if (projected > estimate) {
+        estimate = projected;
+        if (feeCalc) {
+            feeCalc->reason = FeeReason::MEMPOOL_PROJECTION;
+            feeCalc->returnedTarget = confTarget;
+        }
+    }
+    return estimate;
+}
+
 unsigned int CBlockPolicyEstimator::HighestTargetTracked(FeeEstimateHorizon horizon) const
 {
     LOCK(m_cs_fee_estimator);
@@ -970,6 +1030,7 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             longStats = std::move(fileLongStats);
 
             nBestSeenHeight = nFileBestSeenHeight;
+            lastWrittenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
         }
@@ -981,6 +1042,37 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
     return true;
 }
 
+bool CBlockPolicyEstimator::WriteFile(const fs::path& path, bool force)
+{
+    unsigned int height;
+    {
+        LOCK(m_cs_fee_estimator);
+        if (!force && nBestSeenHeight == lastWrittenHeight) return true;
+        // Taken before writing, so that a block processed meanwhile is written next time.
+        height = nBestSeenHeight;
+    }
+
+    const fs::path path_new = path.string() + ".new";
+    CAutoFile fileout(fsbridge::fopen(path_new, "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, path_new.string());
+        return false;
+    }
+    // Write holds the lock only while serializing; the file is synced without it.
+    if (!Write(fileout) || !FileCommit(fileout.Get())) {
+        return false;
+    }
+    fileout.fclose();
+    if (!RenameOver(path_new, path)) {
+        LogPrintf("%s: Failed to rename fee estimates file to %s\n", __func__, path.string());
+        return false;
+    }
+
+    LOCK(m_cs_fee_estimator);
+    lastWrittenHeight = height;
+    return true;
+}
+
 void CBlockPolicyEstimator::FlushUnconfirmed() {
     int64_t startclear = GetTimeMicros();
     LOCK(m_cs_fee_estimator);
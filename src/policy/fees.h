@@ -6,6 +6,7 @@
 #define BITCOIN_POLICY_FEES_H
 
 #include <amount.h>
+#include <fs.h>
 #include <policy/feerate.h>
 #include <uint256.h>
 #include <random.h>
@@ -22,6 +23,9 @@ class CTxMemPoolEntry;
 class CTxMemPool;
 class TxConfirmStats;
 
+/** Interval, in seconds, at which the fee estimates are written to disk while running */
+static const int64_t FEE_FLUSH_INTERVAL = 60 * 60;
+
 /* Identifier for each of the 3 different TxConfirmStats which will track
  * history over different time horizons. */
 enum class FeeEstimateHorizon {
@@ -43,6 +47,7 @@ enum class FeeReason {
     PAYTXFEE,
     FALLBACK,
     REQUIRED,
+    MEMPOOL_PROJECTION,
 };
 
 std::string StringForFeeReason(FeeReason reason);
@@ -52,6 +57,7 @@ enum class FeeEstimateMode {
     UNSET,        //!< Use default settings based on other criteria
     ECONOMICAL,   //!< Force estimateSmartFee to use non-conservative estimates
     CONSERVATIVE, //!< Force estimateSmartFee to use conservative estimates
+    MEMPOOL,      //!< Raise non-conservative estimates to what the current mempool requires
 };
 
 bool FeeModeFromString(const std::string& mode_string, FeeEstimateMode& fee_estimate_mode);
@@ -208,6 +214,12 @@ public:
      */
     CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
 
+    /** As estimateSmartFee, but no lower than the feerate needed to be mined within
+     *  confTarget blocks from the transactions currently in the mempool, so that the
+     *  estimate follows a sudden rise in demand before any blocks confirm it.
+     */
+    CFeeRate estimateSmartFeeWithMempool(int confTarget, FeeCalculation *feeCalc, bool conservative, const CTxMemPool& pool) const;
+
     /** Return a specific fee estimate calculation with a given success
      * threshold and time horizon, and optionally return detailed data about
      * calculation
@@ -220,6 +232,12 @@ public:
     /** Read estimation data from a file */
     bool Read(CAutoFile& filein);
 
+    /**
+     * Write estimation data to the file at path, replacing it atomically. Unless force is set,
+     * nothing is written if no block has been processed since the last write.
+     */
+    bool WriteFile(const fs::path& path, bool force = false);
+
     /** Empty mempool transactions on shutdown to record failure to confirm for txs still in mempool */
     void FlushUnconfirmed();
 
@@ -233,6 +251,8 @@ private:
     unsigned int firstRecordedHeight GUARDED_BY(m_cs_fee_estimator);
     unsigned int historicalFirst GUARDED_BY(m_cs_fee_estimator);
     unsigned int historicalBest GUARDED_BY(m_cs_fee_estimator);
+    /** nBestSeenHeight as of the last WriteFile */
+    unsigned int lastWrittenHeight GUARDED_BY(m_cs_fee_estimator);
 
     struct TxStatsInfo
     {
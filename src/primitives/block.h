@@ -91,12 +91,19 @@ public:
         *(static_cast<CBlockHeader*>(this)) = header;
     }
 
-    ADD_SERIALIZE_METHODS;
+    template <typename Stream>
+    void Serialize(Stream& s) const {
+        s << static_cast<const CBlockHeader&>(*this);
+        s << vtx;
+    }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        READWRITEAS(CBlockHeader, *this);
-        READWRITE(vtx);
+    /** The transactions are deserialized first, so that their hashes can be computed together. */
+    template <typename Stream>
+    void Unserialize(Stream& s) {
+        s >> static_cast<CBlockHeader&>(*this);
+        std::vector<CMutableTransaction> txs;
+        s >> txs;
+        vtx = MakeTransactionRefs(std::move(txs));
     }
 
     void SetNull()
@@ -5,7 +5,9 @@
 
 #include <primitives/transaction.h>
 
+#include <crypto/sha256.h>
 #include <hash.h>
+#include <streams.h>
 #include <tinyformat.h>
 #include <util/strencodings.h>
 
@@ -79,6 +81,7 @@ uint256 CTransaction::ComputeWitnessHash() const
 CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash{}, m_witness_hash{} {}
 CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
 CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
+CTransaction::CTransaction(CMutableTransaction&& tx, const uint256& hashIn, const uint256& witness_hash) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{hashIn}, m_witness_hash{witness_hash} {}
 
 CAmount CTransaction::GetValueOut() const
 {
@@ -113,3 +116,46 @@ std::string CTransaction::ToString() const
         str += "    " + tx_out.ToString() + "\n";
     return str;
 }
+
+std::vector<CTransactionRef> MakeTransactionRefs(std::vector<CMutableTransaction>&& txs)
+{
+    // Serialize the transactions one after the other, as they are hashed for their txids and
+    // then for the wtxids of those with a witness, and hash all of them at once. The buffer is
+    // sized up front, so that the serializer writes into it rather than inserting.
+    std::vector<size_t> offsets{0};
+    for (const CMutableTransaction& tx : txs) {
+        offsets.push_back(offsets.back() + GetSerializeSize(tx, SERIALIZE_TRANSACTION_NO_WITNESS));
+    }
+    for (const CMutableTransaction& tx : txs) {
+        if (tx.HasWitness()) offsets.push_back(offsets.back() + GetSerializeSize(tx, 0));
+    }
+    std::vector<unsigned char> data(offsets.back());
+    auto offset = offsets.cbegin();
+    for (const CMutableTransaction& tx : txs) {
+        CVectorWriter(SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS, data, *offset++) << tx;
+    }
+    for (const CMutableTransaction& tx : txs) {
+        if (tx.HasWitness()) CVectorWriter(SER_GETHASH, 0, data, *offset++) << tx;
+    }
+    const size_t count = offsets.size() - 1;
+    std::vector<const unsigned char*> inputs(count);
+    std::vector<size_t> lengths(count);
+    for (size_t i = 0; i < count; i++) {
+        inputs[i] = data.data() + offsets[i];
+        lengths[i] = offsets[i + 1] - offsets[i];
+    }
+    std::vector<uint256> hashes(count);
+    if (count > 0) {
+        SHA256DMulti(hashes[0].begin(), inputs.data(), lengths.data(), count);
+    }
+
+    std::vector<CTransactionRef> ret;
+    ret.reserve(txs.size());
+    auto witness_hash = hashes.cbegin() + txs.size();
+    for (size_t i = 0; i < txs.size(); i++) {
+        const uint256& hash = hashes[i];
+        const bool fWitness = txs[i].HasWitness();
+        ret.emplace_back(new CTransaction(std::move(txs[i]), hash, fWitness ? *witness_hash++ : hash));
+    }
+    return ret;
+}
@@ -177,6 +177,7 @@ public:
 };
 
 struct CMutableTransaction;
+struct CBlockTxHashes;
 
 /**
  * Basic transaction serialization format:
@@ -297,6 +298,13 @@ private:
     uint256 ComputeHash() const;
     uint256 ComputeWitnessHash() const;
 
+    /** Convert a CMutableTransaction into a CTransaction with hashes known to be its own. They are
+     *  not checked, so this is only for MakeTransactionRefs, which computes them for many
+     *  transactions at once, and for the hashes stored for blocks that were connected. */
+    CTransaction(CMutableTransaction &&tx, const uint256& hashIn, const uint256& witness_hash);
+    friend std::vector<std::shared_ptr<const CTransaction>> MakeTransactionRefs(std::vector<CMutableTransaction>&& txs);
+    friend struct CBlockTxHashes;
+
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
     CTransaction();
@@ -408,5 +416,7 @@ struct CMutableTransaction
 typedef std::shared_ptr<const CTransaction> CTransactionRef;
 static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
 template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
+/** Convert many CMutableTransactions into CTransactions, computing their hashes all together, which is faster. */
+std::vector<CTransactionRef> MakeTransactionRefs(std::vector<CMutableTransaction>&& txs);
 
 #endif // BITCOIN_PRIMITIVES_TRANSACTION_H
@@ -8,6 +8,8 @@
 #include <secp256k1.h>
 #include <secp256k1_recovery.h>
 
+#include <map>
+
 namespace
 {
 /* Global secp256k1_context object used for verification. */
@@ -183,6 +185,46 @@ bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchS
     return secp256k1_ecdsa_verify(secp256k1_context_verify, &sig, hash.begin(), &pubkey);
 }
 
+bool VerifySignatureBatch(const std::vector<CSignatureCheck>& checks, std::vector<bool>& valid)
+{
+    valid.assign(checks.size(), false);
+    std::vector<secp256k1_ecdsa_signature> sigs;
+    std::vector<secp256k1_pubkey> pubkeys;
+    std::vector<unsigned char> msgs;
+    std::vector<size_t> positions;
+    sigs.reserve(checks.size());
+    pubkeys.reserve(checks.size());
+    msgs.reserve(checks.size() * 32);
+    positions.reserve(checks.size());
+    std::map<CPubKey, secp256k1_pubkey> parsed;
+    for (size_t i = 0; i < checks.size(); i++) {
+        const CSignatureCheck& check = checks[i];
+        // Unparsable keys and signatures are left invalid, as Verify would return false.
+        if (!check.pubkey.IsValid()) continue;
+        auto it = parsed.find(check.pubkey);
+        if (it == parsed.end()) {
+            secp256k1_pubkey pubkey;
+            if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &pubkey, check.pubkey.begin(), check.pubkey.size())) continue;
+            it = parsed.emplace(check.pubkey, pubkey).first;
+        }
+        secp256k1_ecdsa_signature sig;
+        if (!ecdsa_signature_parse_der_lax(secp256k1_context_verify, &sig, check.sig.data(), check.sig.size())) continue;
+        secp256k1_ecdsa_signature_normalize(secp256k1_context_verify, &sig, &sig);
+        sigs.push_back(sig);
+        pubkeys.push_back(it->second);
+        msgs.insert(msgs.end(), check.hash.begin(), check.hash.end());
+        positions.push_back(i);
+    }
+    if (sigs.empty()) return checks.empty();
+
+    std::vector<int> results(sigs.size());
+    const size_t count = secp256k1_ecdsa_verify_batch(secp256k1_context_verify, results.data(), sigs.data(), msgs.data(), pubkeys.data(), sigs.size());
+    for (size_t i = 0; i < results.size(); i++) {
+        valid[positions[i]] = results[i];
+    }
+    return count == checks.size();
+}
+
 bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
     if (vchSig.size() != COMPACT_SIGNATURE_SIZE)
         return false;
@@ -203,6 +203,23 @@ public:
     bool Derive(CPubKey& pubkeyChild, ChainCode &ccChild, unsigned int nChild, const ChainCode& cc) const;
 };
 
+/** A signature for VerifySignatureBatch to check, together with many others. */
+struct CSignatureCheck {
+    CPubKey pubkey;
+    uint256 hash;
+    std::vector<unsigned char> sig;
+
+    CSignatureCheck(const CPubKey& pubkeyIn, const uint256& hashIn, const std::vector<unsigned char>& sigIn) : pubkey(pubkeyIn), hash(hashIn), sig(sigIn) {}
+};
+
+/**
+ * Verify DER signatures as CPubKey::Verify would one by one, setting valid to
+ * whether each is. Verifying many at once is faster, as their modular
+ * inversions are shared and a public key used more than once is parsed once.
+ * Returns whether all are valid.
+ */
+bool VerifySignatureBatch(const std::vector<CSignatureCheck>& checks, std::vector<bool>& valid);
+
 struct CExtPubKey {
     unsigned char nDepth;
     unsigned char vchFingerprint[4];
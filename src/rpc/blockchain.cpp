@@ -7,6 +7,7 @@
 
 #include <amount.h>
 #include <base58.h>
+#include <blockfilter.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -14,6 +15,7 @@
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <hash.h>
+#include <index/blockfilterindex.h>
 #include <index/txindex.h>
 #include <key_io.h>
 #include <policy/feerate.h>
@@ -23,6 +25,7 @@
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
+#include <script/sigcache.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
@@ -405,10 +408,8 @@ static std::string EntryDescriptionString()
            "    \"bip125-replaceable\" : true|false,  (boolean) Whether this transaction could be replaced due to BIP125 (replace-by-fee)\n";
 }
 
-static void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) EXCLUSIVE_LOCKS_REQUIRED(::mempool.cs)
+static void entryStateToJSON(UniValue &info, const CTxMemPoolEntry &e)
 {
-    AssertLockHeld(mempool.cs);
-
     UniValue fees(UniValue::VOBJ);
     fees.pushKV("base", ValueFromAmount(e.GetFee()));
     fees.pushKV("modified", ValueFromAmount(e.GetModifiedFee()));
@@ -427,6 +428,13 @@ static void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) EXCLUSIVE_LOCK
     info.pushKV("ancestorcount", e.GetCountWithAncestors());
     info.pushKV("ancestorsize", e.GetSizeWithAncestors());
     info.pushKV("ancestorfees", e.GetModFeesWithAncestors());
+}
+
+static void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) EXCLUSIVE_LOCKS_REQUIRED(::mempool.cs)
+{
+    AssertLockHeld(mempool.cs);
+
+    entryStateToJSON(info, e);
     info.pushKV("wtxid", mempool.vTxHashes[e.vTxHashesIdx].first.ToString());
     const CTransaction& tx = e.GetTx();
     std::set<std::string> setDepends;
@@ -465,15 +473,40 @@ static void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) EXCLUSIVE_LOCK
     info.pushKV("bip125-replaceable", rbfStatus);
 }
 
-UniValue mempoolToJSON(bool fVerbose)
+static void entryToJSON(UniValue &info, const CTxMemPoolSnapshot::Entry &e)
+{
+    entryStateToJSON(info, e.entry);
+    info.pushKV("wtxid", e.wtxid.ToString());
+
+    std::set<std::string> setDepends;
+    for (const uint256& parent : e.parents) {
+        setDepends.insert(parent.ToString());
+    }
+    UniValue depends(UniValue::VARR);
+    for (const std::string& dep : setDepends) {
+        depends.push_back(dep);
+    }
+    info.pushKV("depends", depends);
+
+    UniValue spent(UniValue::VARR);
+    for (const uint256& child : e.children) {
+        spent.push_back(child.ToString());
+    }
+    info.pushKV("spentby", spent);
+
+    info.pushKV("bip125-replaceable", e.bip125_replaceable);
+}
+
+UniValue mempoolToJSON(bool fVerbose, bool include_mempool_sequence)
 {
+    // Work from a snapshot, so that listing a large mempool does not hold up transaction acceptance
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = mempool.GetSnapshot();
     if (fVerbose)
     {
-        LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
-        for (const CTxMemPoolEntry& e : mempool.mapTx)
+        for (const CTxMemPoolSnapshot::Entry& e : snapshot->GetEntries())
         {
-            const uint256& hash = e.GetTx().GetHash();
+            const uint256& hash = e.entry.GetTx().GetHash();
             UniValue info(UniValue::VOBJ);
             entryToJSON(info, e);
             o.pushKV(hash.ToString(), info);
@@ -482,26 +515,28 @@ UniValue mempoolToJSON(bool fVerbose)
     }
     else
     {
-        std::vector<uint256> vtxid;
-        mempool.queryHashes(vtxid);
-
         UniValue a(UniValue::VARR);
-        for (const uint256& hash : vtxid)
-            a.push_back(hash.ToString());
+        for (const CTxMemPoolSnapshot::Entry& e : snapshot->GetEntries())
+            a.push_back(e.entry.GetTx().GetHash().ToString());
 
-        return a;
+        if (!include_mempool_sequence) return a;
+        UniValue o(UniValue::VOBJ);
+        o.pushKV("txids", a);
+        o.pushKV("mempool_sequence", snapshot->GetSequence());
+        return o;
     }
 }
 
 static UniValue getrawmempool(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() > 1)
+    if (request.fHelp || request.params.size() > 2)
         throw std::runtime_error(
             RPCHelpMan{"getrawmempool",
                 "\nReturns all transaction ids in memory pool as a json array of string transaction ids.\n"
                 "\nHint: use getmempoolentry to fetch a specific transaction from the mempool.\n",
                 {
                     {"verbose", RPCArg::Type::BOOL, /* default */ "false", "True for a json object, false for array of transaction ids"},
+                    {"mempool_sequence", RPCArg::Type::BOOL, /* default */ "false", "If verbose=false, returns a json object with transaction list and mempool sequence number attached, to follow with getmempooldelta."},
                 },
                 RPCResult{"for verbose = false",
             "[                     (json array of string)\n"
@@ -513,6 +548,14 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
             "  \"transactionid\" : {       (json object)\n"
             + EntryDescriptionString()
             + "  }, ...\n"
+            "}\n"
+            "\nResult: (for verbose = false and mempool_sequence = true):\n"
+            "{                           (json object)\n"
+            "  \"txids\" : [               (json array of string)\n"
+            "    \"transactionid\"         (string) The transaction id\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"mempool_sequence\" : n    (numeric) The mempool sequence number the list is current at\n"
             "}\n"
                 },
                 RPCExamples{
@@ -525,7 +568,81 @@ static UniValue getrawmempool(const JSONRPCRequest& request)
     if (!request.params[0].isNull())
         fVerbose = request.params[0].get_bool();
 
-    return mempoolToJSON(fVerbose);
+    bool include_mempool_sequence = false;
+    if (!request.params[1].isNull()) {
+        include_mempool_sequence = request.params[1].get_bool();
+    }
+    if (fVerbose && include_mempool_sequence) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbose results cannot contain mempool sequence values.");
+    }
+
+    return mempoolToJSON(fVerbose, include_mempool_sequence);
+}
+
+static UniValue getmempooldelta(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            RPCHelpMan{"getmempooldelta",
+                "\nReturns the transactions added to and removed from the memory pool after mempool sequence number since,\n"
+                "oldest first. Together with getrawmempool with mempool_sequence, this keeps a copy of the mempool's\n"
+                "transaction ids up to date without listing the whole mempool every time.\n"
+                "Only the last " + std::to_string(MEMPOOL_DELTA_LOG_SIZE) + " changes are kept; an error is returned if some of the\n"
+                "requested changes are no longer available, after which the copy should be taken again.\n",
+                {
+                    {"since", RPCArg::Type::NUM, RPCArg::Optional::NO, "The mempool sequence number the caller is current at"},
+                },
+                RPCResult{
+            "{\n"
+            "  \"mempool_sequence\" : n,     (numeric) The mempool sequence number after the changes\n"
+            "  \"changes\" : [               (json array of objects)\n"
+            "    {\n"
+            "      \"sequence\" : n,         (numeric) The mempool sequence number of the change\n"
+            "      \"txid\" : \"hex\",         (string) The transaction id\n"
+            "      \"added\" : true|false,   (boolean) Whether the transaction entered or left the mempool\n"
+            "      \"reason\" : \"str\"        (string, optional) Why the transaction left the mempool\n"
+            "    }, ...\n"
+            "  ]\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getmempooldelta", "1234")
+            + HelpExampleRpc("getmempooldelta", "1234")
+                },
+            }.ToString());
+
+    const int64_t since = request.params[0].get_int64();
+    if (since < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative mempool sequence");
+    }
+
+    std::vector<MempoolDelta> deltas;
+    uint64_t sequence;
+    {
+        LOCK(mempool.cs);
+        sequence = mempool.GetSequence();
+        if ((uint64_t)since > sequence) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Mempool sequence is ahead of the mempool");
+        }
+        if (!mempool.GetDeltas(since, deltas)) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Mempool changes since this sequence are no longer available, use getrawmempool");
+        }
+    }
+
+    UniValue changes(UniValue::VARR);
+    for (const MempoolDelta& delta : deltas) {
+        UniValue change(UniValue::VOBJ);
+        change.pushKV("sequence", delta.sequence);
+        change.pushKV("txid", delta.txid.GetHex());
+        change.pushKV("added", delta.added);
+        if (!delta.added) change.pushKV("reason", RemovalReasonToString(delta.reason));
+        changes.push_back(change);
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("mempool_sequence", sequence);
+    result.pushKV("changes", changes);
+    return result;
 }
 
 static UniValue getmempoolancestors(const JSONRPCRequest& request)
@@ -809,7 +926,7 @@ static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
     }
 
-    if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus())) {
+    if (!ReadBlockFromDiskWithStoredTxHashes(block, pblockindex, Params().GetConsensus())) {
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
         // non-whitelisted node sends us an unrequested long chain of valid
@@ -1496,6 +1613,7 @@ UniValue mempoolInfoToJSON()
     ret.pushKV("size", (int64_t) mempool.size());
     ret.pushKV("bytes", (int64_t) mempool.GetTotalTxSize());
     ret.pushKV("usage", (int64_t) mempool.DynamicMemoryUsage());
+    ret.pushKV("snapshotusage", (int64_t) mempool.SnapshotMemoryUsage());
     size_t maxmempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.pushKV("maxmempool", (int64_t) maxmempool);
     ret.pushKV("mempoolminfee", ValueFromAmount(std::max(mempool.GetMinFee(maxmempool), ::minRelayTxFee).GetFeePerK()));
@@ -1516,6 +1634,7 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
             "  \"size\": xxxxx,               (numeric) Current tx count\n"
             "  \"bytes\": xxxxx,              (numeric) Sum of all virtual transaction sizes as defined in BIP 141. Differs from actual serialized size because witness data is discounted\n"
             "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
+            "  \"snapshotusage\": xxxxx,      (numeric) Memory usage of the mempool copy kept for getrawmempool, not counted in usage or against maxmempool\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee rate in " + CURRENCY_UNIT + "/kB for tx to be accepted. Is the maximum of minrelaytxfee and minimum mempool fee\n"
             "  \"minrelaytxfee\": xxxxx       (numeric) Current minimum relay fee for transactions\n"
@@ -1530,6 +1649,135 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+static UniValue LatencyHistogramToJSON(const MempoolAcceptLatencyStats::Histogram& histogram)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("count", histogram.count);
+    ret.pushKV("totaltime", histogram.total_micros);
+    UniValue buckets(UniValue::VARR);
+    for (int i = 0; i < MEMPOOL_ACCEPT_LATENCY_BUCKETS; ++i) {
+        if (histogram.buckets[i] == 0) continue;
+        UniValue bucket(UniValue::VOBJ);
+        if (i < MEMPOOL_ACCEPT_LATENCY_BUCKETS - 1) {
+            bucket.pushKV("below", int64_t{1} << i);
+        }
+        bucket.pushKV("count", histogram.buckets[i]);
+        buckets.push_back(bucket);
+    }
+    ret.pushKV("histogram", buckets);
+    return ret;
+}
+
+static UniValue getmempoolacceptlatency(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            RPCHelpMan{"getmempoolacceptlatency",
+                "\nReturns how long attempts to add transactions to the memory pool have taken since startup.\n"
+                "Times are in microseconds. Histogram buckets that are empty are left out.\n",
+                {},
+                RPCResult{
+            "{\n"
+            "  \"accepted\": {               (json object) Attempts that accepted the transaction\n"
+            "    \"count\": xxxxx,            (numeric) Number of attempts\n"
+            "    \"totaltime\": xxxxx,        (numeric) Total time taken\n"
+            "    \"histogram\": [             (array) Attempts by time taken\n"
+            "      {\n"
+            "        \"below\": xxxxx,        (numeric) Upper bound (exclusive) of this bucket, each twice the previous. Absent for the last bucket\n"
+            "        \"count\": xxxxx         (numeric) Number of attempts in this bucket\n"
+            "      }, ...\n"
+            "    ]\n"
+            "  },\n"
+            "  \"rejected\": {...},          (json object) Attempts that did not, in the same format\n"
+            "  \"scriptchecks\": {...}       (json object) Script verification of transactions that got that far, in the same format\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getmempoolacceptlatency", "")
+            + HelpExampleRpc("getmempoolacceptlatency", "")
+                },
+            }.ToString());
+
+    const MempoolAcceptLatencyStats stats = GetMempoolAcceptLatencyStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("accepted", LatencyHistogramToJSON(stats.accepted));
+    ret.pushKV("rejected", LatencyHistogramToJSON(stats.rejected));
+    ret.pushKV("scriptchecks", LatencyHistogramToJSON(stats.script_checks));
+    return ret;
+}
+
+static UniValue getsigcacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            RPCHelpMan{"getsigcacheinfo",
+                "\nReturns the activity of the signature cache since startup or it was last resized, and how full it is.\n"
+                "Connecting a block erases the entries it finds, so a high block hit ratio shows that signatures\n"
+                "validated in the memory pool are not checked again.\n",
+                {},
+                RPCResult{
+            "{\n"
+            "  \"hits\": xxxxx,               (numeric) Lookups that found the signature\n"
+            "  \"misses\": xxxxx,             (numeric) Lookups that did not\n"
+            "  \"blockhits\": xxxxx,          (numeric) Lookups connecting blocks that found the signature\n"
+            "  \"blockmisses\": xxxxx,        (numeric) Lookups connecting blocks that did not\n"
+            "  \"insertions\": xxxxx,         (numeric) Signatures added\n"
+            "  \"evictions\": xxxxx,          (numeric) Entries pushed out to add others, as the cache was full\n"
+            "  \"entries\": xxxxx,            (numeric) Entries not erased yet\n"
+            "  \"capacity\": xxxxx,           (numeric) Entries the cache can store\n"
+            "  \"usage\": xxxxx,              (numeric) Fraction of the capacity in use\n"
+            "  \"shards\": xxxxx              (numeric) Number of separately locked parts of the cache\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getsigcacheinfo", "")
+            + HelpExampleRpc("getsigcacheinfo", "")
+                },
+            }.ToString());
+
+    const SignatureCacheStats stats = GetSignatureCacheStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("hits", stats.hits);
+    ret.pushKV("misses", stats.misses);
+    ret.pushKV("blockhits", stats.block_hits);
+    ret.pushKV("blockmisses", stats.block_misses);
+    ret.pushKV("insertions", stats.insertions);
+    ret.pushKV("evictions", stats.evictions);
+    ret.pushKV("entries", (uint64_t)stats.entries);
+    ret.pushKV("capacity", (uint64_t)stats.capacity);
+    ret.pushKV("usage", stats.capacity == 0 ? 0.0 : (double)stats.entries / stats.capacity);
+    ret.pushKV("shards", (uint64_t)stats.shards);
+    return ret;
+}
+
+static UniValue setsigcachesize(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            RPCHelpMan{"setsigcachesize",
+                "\nReplaces the signature cache with an empty one of the given size.\n"
+                "The signatures cached so far are dropped, so transactions in the memory pool have theirs checked again in blocks.\n",
+                {
+                    {"size", RPCArg::Type::NUM, RPCArg::Optional::NO, "The size of the signature cache in MiB, at most " + std::to_string(MAX_MAX_SIG_CACHE_SIZE)},
+                },
+                RPCResult{
+            "n    (numeric) The number of entries the cache can store\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("setsigcachesize", "64")
+            + HelpExampleRpc("setsigcachesize", "64")
+                },
+            }.ToString());
+
+    const int64_t size = request.params[0].get_int64();
+    if (size < 0 || size > MAX_MAX_SIG_CACHE_SIZE) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Size must be between 0 and %d", MAX_MAX_SIG_CACHE_SIZE));
+    }
+    const size_t nElems = ResizeSignatureCache((size_t)size << 20);
+    LogPrintf("Resized signature cache to %d MiB, able to store %zu elements\n", size, nElems);
+    return (uint64_t)nElems;
+}
+
 static UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -2302,6 +2550,84 @@ UniValue scantxoutset(const JSONRPCRequest& request)
     return result;
 }
 
+static UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2) {
+        throw std::runtime_error(
+            RPCHelpMan{"getblockfilter",
+                "\nRetrieve a BIP 157 content filter for a particular block.\n",
+                {
+                    {"blockhash", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The hash of the block"},
+                    {"filtertype", RPCArg::Type::STR, /*default*/ "basic", "The type name of the filter"},
+                },
+                RPCResult{
+            "{\n"
+            "  \"filter\" : (string) the hex-encoded filter data\n"
+            "  \"header\" : (string) the hex-encoded filter header\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+                },
+            }.ToString());
+    }
+
+    uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    std::string filtertype_name = "basic";
+    if (!request.params[1].isNull()) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    BlockFilterIndex* index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + filtertype_name);
+    }
+
+    const CBlockIndex* block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        block_index = LookupBlockIndex(block_hash);
+        if (!block_index) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_was_connected = block_index->IsValid(BLOCK_VALID_SCRIPTS);
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(block_index, filter) ||
+        !index->LookupFilterHeader(block_index, filter_header)) {
+        int err_code;
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            err_code = RPC_INVALID_ADDRESS_OR_KEY;
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            err_code = RPC_MISC_ERROR;
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            err_code = RPC_INTERNAL_ERROR;
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+
+        throw JSONRPCError(err_code, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", filter_header.GetHex());
+    return ret;
+}
+
 // clang-format off
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
@@ -2320,7 +2646,11 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
+    { "blockchain",         "getmempoolacceptlatency", &getmempoolacceptlatency, {} },
+    { "blockchain",         "getsigcacheinfo",        &getsigcacheinfo,        {} },
+    { "blockchain",         "setsigcachesize",        &setsigcachesize,        {"size"} },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose","mempool_sequence"} },
+    { "blockchain",         "getmempooldelta",        &getmempooldelta,        {"since"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
@@ -2329,6 +2659,7 @@ static const CRPCCommand commands[] =
 
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
     { "blockchain",         "scantxoutset",           &scantxoutset,           {"action", "scanobjects"} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash", "filtertype"} },
 
     /* Not shown in help */
     { "hidden",             "invalidateblock",        &invalidateblock,        {"blockhash"} },
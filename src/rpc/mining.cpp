@@ -11,6 +11,7 @@
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <key_io.h>
+#include <mempooljournal.h>
 #include <miner.h>
 #include <net.h>
 #include <policy/fees.h>
@@ -261,6 +262,9 @@ static UniValue prioritisetransaction(const JSONRPCRequest& request)
     }
 
     mempool.PrioritiseTransaction(hash, nAmount);
+    if (g_mempool_journal) {
+        g_mempool_journal->Prioritise(hash);
+    }
     return true;
 }
 
@@ -507,7 +511,17 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
-    if (pindexPrev != chainActive.Tip() ||
+    std::unique_ptr<CBlockTemplate> cached_template;
+    if (g_block_template_cache) {
+        cached_template = g_block_template_cache->GetTemplate(chainActive.Tip(), nTransactionsUpdatedLast);
+    }
+    if (cached_template) {
+        // Kept up to date and validated in the background as the mempool changes
+        pblocktemplate = std::move(cached_template);
+        pindexPrev = chainActive.Tip();
+        nStart = GetTime();
+    }
+    else if (pindexPrev != chainActive.Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
@@ -819,10 +833,13 @@ static UniValue estimatesmartfee(const JSONRPCRequest& request)
             "                   a longer history. A conservative estimate potentially returns a\n"
             "                   higher feerate and is more likely to be sufficient for the desired\n"
             "                   target, but is not as responsive to short term drops in the\n"
-            "                   prevailing fee market.  Must be one of:\n"
+            "                   prevailing fee market. \"MEMPOOL\" returns an economical estimate,\n"
+            "                   raised to the feerate needed to be mined within conf_target blocks\n"
+            "                   from the transactions currently in the mempool.  Must be one of:\n"
             "       \"UNSET\"\n"
             "       \"ECONOMICAL\"\n"
-            "       \"CONSERVATIVE\""},
+            "       \"CONSERVATIVE\"\n"
+            "       \"MEMPOOL\""},
                 },
                 RPCResult{
             "{\n"
@@ -845,18 +862,24 @@ static UniValue estimatesmartfee(const JSONRPCRequest& request)
     RPCTypeCheckArgument(request.params[0], UniValue::VNUM);
     unsigned int conf_target = ParseConfirmTarget(request.params[0]);
     bool conservative = true;
+    bool use_mempool = false;
     if (!request.params[1].isNull()) {
         FeeEstimateMode fee_mode;
         if (!FeeModeFromString(request.params[1].get_str(), fee_mode)) {
             throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid estimate_mode parameter");
         }
         if (fee_mode == FeeEstimateMode::ECONOMICAL) conservative = false;
+        if (fee_mode == FeeEstimateMode::MEMPOOL) {
+            conservative = false;
+            use_mempool = true;
+        }
     }
 
     UniValue result(UniValue::VOBJ);
     UniValue errors(UniValue::VARR);
     FeeCalculation feeCalc;
-    CFeeRate feeRate = ::feeEstimator.estimateSmartFee(conf_target, &feeCalc, conservative);
+    CFeeRate feeRate = use_mempool ? ::feeEstimator.estimateSmartFeeWithMempool(conf_target, &feeCalc, conservative, ::mempool)
+                                   : ::feeEstimator.estimateSmartFee(conf_target, &feeCalc, conservative);
     if (feeRate != CFeeRate(0)) {
         result.pushKV("feerate", ValueFromAmount(feeRate.GetFeePerK()));
     } else {
@@ -110,6 +110,8 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"inflight_target\": n,      (numeric) The number of blocks we aim to have in flight from this peer, sized from its delivery rate and ping time\n"
+            "    \"block_interval\": n,       (numeric) The average time in seconds between blocks delivered by this peer (if any were requested)\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "    \"minfeefilter\": n,         (numeric) The minimum fee rate for transactions this peer accepts\n"
             "    \"bytessent_per_msg\": {\n"
@@ -183,6 +185,10 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            const int64_t nMinPingUsec = stats.dMinPing < static_cast<double>(std::numeric_limits<int64_t>::max())/1e6 ? stats.dMinPing * 1e6 : 0;
+            obj.pushKV("inflight_target", ComputeBlocksInTransitTarget(statestats.nBlockIntervalUsec, nMinPingUsec));
+            if (statestats.nBlockIntervalUsec > 0)
+                obj.pushKV("block_interval", statestats.nBlockIntervalUsec / 1e6);
         }
         obj.pushKV("whitelisted", stats.fWhitelisted);
         obj.pushKV("minfeefilter", ValueFromAmount(stats.minFeeFilter));
@@ -373,6 +379,16 @@ static UniValue getaddednodeinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+template <typename Pool>
+static UniValue BufferPoolStatsToJSON(const typename Pool::Stats& stats)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("reused", stats.reused);
+    obj.pushKV("allocated", stats.allocated);
+    obj.pushKV("pooled", (uint64_t)stats.pooled);
+    return obj;
+}
+
 static UniValue getnettotals(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() > 0)
@@ -394,6 +410,19 @@ static UniValue getnettotals(const JSONRPCRequest& request)
             "    \"serve_historical_blocks\": true|false,  (boolean) True if serving historical blocks\n"
             "    \"bytes_left_in_cycle\": t,               (numeric) Bytes left in current time cycle\n"
             "    \"time_left_in_cycle\": t                 (numeric) Seconds left in current time cycle\n"
+            "  },\n"
+            "  \"bufferpool\":             (json object) Reuse of message buffers, by direction and size class\n"
+            "  {\n"
+            "    \"recv\":                 (json object) Payload buffers of received messages\n"
+            "    {\n"
+            "      \"small\": {             (json object) Control messages (the \"tx\" and \"block\" classes follow the same format)\n"
+            "        \"reused\": n,         (numeric) Buffers taken from the pool\n"
+            "        \"allocated\": n,      (numeric) Requests for which the pool was empty\n"
+            "        \"pooled\": n          (numeric) Buffers currently kept in the pool\n"
+            "      },\n"
+            "      ...\n"
+            "    },\n"
+            "    \"send\": { \"small\": {...} }  (json object) Header buffers of sent messages\n"
             "  }\n"
             "}\n"
                 },
@@ -418,6 +447,17 @@ static UniValue getnettotals(const JSONRPCRequest& request)
     outboundLimit.pushKV("bytes_left_in_cycle", g_connman->GetOutboundTargetBytesLeft());
     outboundLimit.pushKV("time_left_in_cycle", g_connman->GetMaxOutboundTimeLeftInCycle());
     obj.pushKV("uploadtarget", outboundLimit);
+
+    UniValue recvPool(UniValue::VOBJ);
+    recvPool.pushKV("small", BufferPoolStatsToJSON<CNetRecvBufferPool>(g_connman->GetRecvBufferPoolStats(CNetRecvBufferPool::SMALL)));
+    recvPool.pushKV("tx", BufferPoolStatsToJSON<CNetRecvBufferPool>(g_connman->GetRecvBufferPoolStats(CNetRecvBufferPool::TX)));
+    recvPool.pushKV("block", BufferPoolStatsToJSON<CNetRecvBufferPool>(g_connman->GetRecvBufferPoolStats(CNetRecvBufferPool::BLOCK)));
+    UniValue sendPool(UniValue::VOBJ);
+    sendPool.pushKV("small", BufferPoolStatsToJSON<CNetSendBufferPool>(g_connman->GetSendBufferPoolStats(CNetSendBufferPool::SMALL)));
+    UniValue bufferPool(UniValue::VOBJ);
+    bufferPool.pushKV("recv", recvPool);
+    bufferPool.pushKV("send", sendPool);
+    obj.pushKV("bufferpool", bufferPool);
     return obj;
 }
 
@@ -291,7 +291,7 @@ static UniValue gettxoutproof(const JSONRPCRequest& request)
     }
 
     CBlock block;
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+    if(!ReadBlockFromDiskWithStoredTxHashes(block, pblockindex, Params().GetConsensus()))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
     unsigned int ntxFound = 0;
@@ -1090,6 +1090,81 @@ static UniValue sendrawtransaction(const JSONRPCRequest& request)
     return txid.GetHex();
 }
 
+/** Most transactions sendrawtransactions takes at once. The whole batch is validated under cs_main. */
+static constexpr size_t MAX_SENDRAWTRANSACTIONS_BATCH = 100;
+
+static UniValue sendrawtransactions(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            RPCHelpMan{"sendrawtransactions",
+                "\nSubmits a batch of raw transactions (serialized, hex-encoded) to local node and network.\n"
+                "\nThe transactions may spend outputs of each other and be given in any order; they are added to the\n"
+                "mempool parents first, all in one pass. A transaction spending from one that was rejected is not\n"
+                "validated and fails with missing inputs. The other transactions are not affected by a failure.\n"
+                "\nSee sendrawtransaction call.\n",
+                {
+                    {"rawtxs", RPCArg::Type::ARR, RPCArg::Optional::NO, "An array of hex strings of raw transactions, at most " + std::to_string(MAX_SENDRAWTRANSACTIONS_BATCH) + ".",
+                        {
+                            {"rawtx", RPCArg::Type::STR_HEX, RPCArg::Optional::OMITTED, ""},
+                        },
+                        },
+                    {"allowhighfees", RPCArg::Type::BOOL, /* default */ "false", "Allow high fees"},
+                },
+                RPCResult{
+            "[                   (array) The result for each raw transaction in the input array, in the same order.\n"
+            " {\n"
+            "  \"txid\"           (string) The transaction hash in hex\n"
+            "  \"error\" : {      (json object) The error sendrawtransaction would have thrown (only present on failure)\n"
+            "    \"code\" : n,       (numeric) The error code\n"
+            "    \"message\" : \"str\" (string) The error message\n"
+            "  }\n"
+            " }\n"
+            "]\n"
+                },
+                RPCExamples{
+            "\nSend a transaction and one spending from it (signed hex)\n"
+            + HelpExampleCli("sendrawtransactions", "\"[\\\"signedparenthex\\\",\\\"signedchildhex\\\"]\"") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("sendrawtransactions", "[\"signedparenthex\", \"signedchildhex\"]")
+                },
+            }.ToString());
+
+    RPCTypeCheck(request.params, {UniValue::VARR, UniValue::VBOOL});
+
+    // parse all transactions before submitting any of them
+    const UniValue& rawtxs = request.params[0].get_array();
+    if (rawtxs.size() > MAX_SENDRAWTRANSACTIONS_BATCH) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Too many transactions, at most %u can be sent at once", MAX_SENDRAWTRANSACTIONS_BATCH));
+    }
+    std::vector<CTransactionRef> txs;
+    txs.reserve(rawtxs.size());
+    for (size_t i = 0; i < rawtxs.size(); ++i) {
+        CMutableTransaction mtx;
+        if (!DecodeHexTx(mtx, rawtxs[i].get_str())) {
+            throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+        }
+        txs.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    bool allowhighfees = false;
+    if (!request.params[1].isNull()) allowhighfees = request.params[1].get_bool();
+    const CAmount highfee{allowhighfees ? 0 : ::maxTxFee};
+    std::vector<std::string> err_strings;
+    const std::vector<TransactionError> errors = BroadcastTransactions(txs, err_strings, highfee);
+
+    UniValue result(UniValue::VARR);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", txs[i]->GetHash().GetHex());
+        if (errors[i] != TransactionError::OK) {
+            entry.pushKV("error", JSONRPCTransactionError(errors[i], err_strings[i]));
+        }
+        result.push_back(std::move(entry));
+    }
+    return result;
+}
+
 static UniValue testmempoolaccept(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2) {
@@ -2092,6 +2167,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "decoderawtransaction",         &decoderawtransaction,      {"hexstring","iswitness"} },
     { "rawtransactions",    "decodescript",                 &decodescript,              {"hexstring"} },
     { "rawtransactions",    "sendrawtransaction",           &sendrawtransaction,        {"hexstring","allowhighfees"} },
+    { "rawtransactions",    "sendrawtransactions",          &sendrawtransactions,       {"rawtxs","allowhighfees"} },
     { "rawtransactions",    "combinerawtransaction",        &combinerawtransaction,     {"txs"} },
     { "hidden",             "signrawtransaction",           &signrawtransaction,        {"hexstring","prevtxs","privkeys","sighashtype"} },
     { "rawtransactions",    "signrawtransactionwithkey",    &signrawtransactionwithkey, {"hexstring","privkeys","prevtxs","sighashtype"} },
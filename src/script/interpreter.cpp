@@ -10,6 +10,7 @@
 #include <crypto/sha256.h>
 #include <pubkey.h>
 #include <script/script.h>
+#include <streams.h>
 #include <uint256.h>
 
 typedef std::vector<unsigned char> valtype;
@@ -1182,6 +1183,9 @@ public:
     }
 };
 
+/** Size of an input with its script blanked out: prevout, an empty script and the nSequence */
+static constexpr size_t LEGACY_BLANKED_INPUT_SIZE = 36 + 1 + 4;
+
 template <class T>
 uint256 GetPrevoutHash(const T& txTo)
 {
@@ -1224,6 +1228,31 @@ PrecomputedTransactionData::PrecomputedTransactionData(const T& txTo)
         hashOutputs = GetOutputsHash(txTo);
         ready = true;
     }
+
+    if (txTo.vin.size() >= LEGACY_SIGHASH_CACHE_MIN_INPUTS) {
+        CVectorWriter writer(SER_GETHASH, 0, m_legacy_serialization, 0);
+        writer << txTo.nVersion;
+        WriteCompactSize(writer, txTo.vin.size());
+        m_legacy_inputs_offset = m_legacy_serialization.size();
+        for (const CTxIn& txin : txTo.vin) {
+            writer << txin.prevout << CScript() << txin.nSequence;
+        }
+        writer << txTo.vout << txTo.nLockTime;
+
+        m_legacy_midstates.reserve(txTo.vin.size());
+        CHashWriter ss(SER_GETHASH, 0);
+        ss.write((const char*)m_legacy_serialization.data(), m_legacy_inputs_offset);
+        for (size_t i = 0; i < txTo.vin.size(); i++) {
+            if (i > 0) ss.write((const char*)LegacyInputBegin(i - 1), LEGACY_BLANKED_INPUT_SIZE);
+            m_legacy_midstates.push_back(ss);
+        }
+        m_legacy_ready = true;
+    }
+}
+
+const unsigned char* PrecomputedTransactionData::LegacyInputBegin(size_t nInput) const
+{
+    return m_legacy_serialization.data() + m_legacy_inputs_offset + nInput * LEGACY_BLANKED_INPUT_SIZE;
 }
 
 // explicit instantiation
@@ -1294,6 +1323,17 @@ uint256 SignatureHash(const CScript& scriptCode, const T& txTo, unsigned int nIn
     // Wrapper to serialize only the necessary parts of the transaction being signed
     CTransactionSignatureSerializer<T> txTmp(txTo, scriptCode, nIn, nHashType);
 
+    if (cache && cache->m_legacy_ready && (nHashType & 0x1f) != SIGHASH_SINGLE && (nHashType & 0x1f) != SIGHASH_NONE && !(nHashType & SIGHASH_ANYONECANPAY)) {
+        // Resume from the inputs before this one, and take the ones after, the
+        // outputs and the locktime from the precomputed serialization.
+        CHashWriter ss(cache->m_legacy_midstates[nIn]);
+        txTmp.SerializeInput(ss, nIn);
+        const unsigned char* rest = cache->LegacyInputBegin(nIn + 1);
+        ss.write((const char*)rest, cache->m_legacy_serialization.data() + cache->m_legacy_serialization.size() - rest);
+        ss << nHashType;
+        return ss.GetHash();
+    }
+
     // Serialize and hash
     CHashWriter ss(SER_GETHASH, 0);
     ss << txTmp << nHashType;
@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_INTERPRETER_H
 #define BITCOIN_SCRIPT_INTERPRETER_H
 
+#include <hash.h>
 #include <script/script_error.h>
 #include <primitives/transaction.h>
 
@@ -119,13 +120,32 @@ enum
 
 bool CheckSignatureEncoding(const std::vector<unsigned char> &vchSig, unsigned int flags, ScriptError* serror);
 
+/** Transactions with at least this many inputs get their legacy SIGHASH_ALL hashing precomputed. */
+static const size_t LEGACY_SIGHASH_CACHE_MIN_INPUTS = 16;
+
 struct PrecomputedTransactionData
 {
     uint256 hashPrevouts, hashSequence, hashOutputs;
     bool ready = false;
 
+    /**
+     * Legacy signature hashes serialize the whole transaction for every input,
+     * with every other input's script blanked out. For SIGHASH_ALL, all but the
+     * input being signed serialize the same for every input, so they are
+     * serialized once here (m_legacy_serialization), along with the hash
+     * midstates up to the start of each input (m_legacy_midstates).
+     */
+    std::vector<CHashWriter> m_legacy_midstates;
+    std::vector<unsigned char> m_legacy_serialization;
+    //! Offset of the first input in m_legacy_serialization
+    size_t m_legacy_inputs_offset = 0;
+    bool m_legacy_ready = false;
+
     template <class T>
     explicit PrecomputedTransactionData(const T& tx);
+
+    //! Where input nInput starts in m_legacy_serialization (past the last input for the input count)
+    const unsigned char* LegacyInputBegin(size_t nInput) const;
 };
 
 enum class SigVersion
@@ -12,6 +12,11 @@
 #include <util/system.h>
 
 #include <cuckoocache.h>
+
+#include <array>
+#include <atomic>
+#include <memory>
+
 #include <boost/thread.hpp>
 
 namespace {
@@ -19,6 +24,9 @@ namespace {
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
  * twice for every transaction (once when accepted into memory pool, and
  * again when accepted into the block chain)
+ *
+ * The entries are spread over shards with a lock each, so that inserting
+ * an entry only excludes lookups of the entries in its shard.
  */
 class CSignatureCache
 {
@@ -26,8 +34,28 @@ private:
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
     typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
-    map_type setValid;
-    boost::shared_mutex cs_sigcache;
+
+    //! Aligned to a cache line, so that the lock and counters of one shard do
+    //! not share a cache line with those of the next.
+    struct alignas(64) Shard {
+        std::unique_ptr<map_type> setValid{new map_type()};
+        boost::shared_mutex cs_shard;
+        std::atomic<uint64_t> nHits{0};
+        std::atomic<uint64_t> nMisses{0};
+        //! Lookups that erase found entries, as done when connecting blocks
+        std::atomic<uint64_t> nBlockHits{0};
+        std::atomic<uint64_t> nBlockMisses{0};
+        std::atomic<uint64_t> nInsertions{0};
+        std::atomic<uint64_t> nEvictions{0};
+    };
+    std::array<Shard, SIGNATURE_CACHE_SHARDS> shards;
+
+    Shard& GetShard(const uint256& entry)
+    {
+        // The low bits of a byte only affect where the cuckoo cache puts an
+        // entry by less than a slot, so the shards fill evenly.
+        return shards[entry.begin()[24] % SIGNATURE_CACHE_SHARDS];
+    }
 
 public:
     CSignatureCache()
@@ -44,18 +72,51 @@ public:
     bool
     Get(const uint256& entry, const bool erase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
+        Shard& shard = GetShard(entry);
+        boost::shared_lock<boost::shared_mutex> lock(shard.cs_shard);
+        const bool found = shard.setValid->contains(entry, erase);
+        (found ? shard.nHits : shard.nMisses).fetch_add(1, std::memory_order_relaxed);
+        if (erase) (found ? shard.nBlockHits : shard.nBlockMisses).fetch_add(1, std::memory_order_relaxed);
+        return found;
     }
 
     void Set(uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.insert(entry);
+        Shard& shard = GetShard(entry);
+        boost::unique_lock<boost::shared_mutex> lock(shard.cs_shard);
+        if (!shard.setValid->insert(entry)) shard.nEvictions.fetch_add(1, std::memory_order_relaxed);
+        shard.nInsertions.fetch_add(1, std::memory_order_relaxed);
     }
-    uint32_t setup_bytes(size_t n)
+
+    /** Replace the shards with empty ones of about n bytes in total. Returns the number of elements storable. */
+    size_t setup_bytes(size_t n)
     {
-        return setValid.setup_bytes(n);
+        size_t nElems = 0;
+        for (Shard& shard : shards) {
+            boost::unique_lock<boost::shared_mutex> lock(shard.cs_shard);
+            shard.setValid.reset(new map_type());
+            shard.nHits = shard.nMisses = shard.nBlockHits = shard.nBlockMisses = shard.nInsertions = shard.nEvictions = 0;
+            nElems += shard.setValid->setup_bytes(n / SIGNATURE_CACHE_SHARDS);
+        }
+        return nElems;
+    }
+
+    SignatureCacheStats GetStats()
+    {
+        SignatureCacheStats stats;
+        stats.shards = SIGNATURE_CACHE_SHARDS;
+        for (Shard& shard : shards) {
+            boost::shared_lock<boost::shared_mutex> lock(shard.cs_shard);
+            stats.hits += shard.nHits;
+            stats.misses += shard.nMisses;
+            stats.block_hits += shard.nBlockHits;
+            stats.block_misses += shard.nBlockMisses;
+            stats.insertions += shard.nInsertions;
+            stats.evictions += shard.nEvictions;
+            stats.entries += shard.setValid->count_live();
+            stats.capacity += shard.setValid->capacity();
+        }
+        return stats;
     }
 };
 
@@ -73,13 +134,23 @@ static CSignatureCache signatureCache;
 void InitSignatureCache()
 {
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
-    // setup_bytes creates the minimum possible cache (2 elements).
+    // setup_bytes creates the minimum possible cache (2 elements per shard).
     size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
-    size_t nElems = signatureCache.setup_bytes(nMaxCacheSize);
+    size_t nElems = ResizeSignatureCache(nMaxCacheSize);
     LogPrintf("Using %zu MiB out of %zu/2 requested for signature cache, able to store %zu elements\n",
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+size_t ResizeSignatureCache(size_t nBytes)
+{
+    return signatureCache.setup_bytes(nBytes);
+}
+
+SignatureCacheStats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
@@ -92,3 +163,34 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
         signatureCache.Set(entry);
     return true;
 }
+
+bool BatchingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
+    if (signatureCache.Get(entry, !store))
+        return true;
+    if (store)
+        m_batch.m_cache_entries.emplace_back(m_batch.m_checks.size(), entry);
+    m_batch.m_checks.emplace_back(pubkey, sighash, vchSig);
+    return true;
+}
+
+void SignatureBatch::Truncate(size_t size)
+{
+    if (size >= m_checks.size()) return;
+    m_checks.erase(m_checks.begin() + size, m_checks.end());
+    while (!m_cache_entries.empty() && m_cache_entries.back().first >= size) {
+        m_cache_entries.pop_back();
+    }
+}
+
+bool SignatureBatch::Verify(std::vector<bool>& valid) const
+{
+    const bool all_valid = VerifySignatureBatch(m_checks, valid);
+    for (auto entry : m_cache_entries) {
+        if (valid[entry.first])
+            signatureCache.Set(entry.second);
+    }
+    return all_valid;
+}
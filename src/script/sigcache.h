@@ -6,6 +6,7 @@
 #ifndef BITCOIN_SCRIPT_SIGCACHE_H
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
+#include <pubkey.h>
 #include <script/interpreter.h>
 
 #include <vector>
@@ -16,8 +17,8 @@
 static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
-
-class CPubKey;
+// Number of separately locked parts of the signature cache
+static const size_t SIGNATURE_CACHE_SHARDS = 16;
 
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
@@ -42,7 +43,7 @@ public:
 
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
-private:
+protected:
     bool store;
 
 public:
@@ -51,6 +52,70 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
 };
 
+/**
+ * Signatures collected from scripts by BatchingTransactionSignatureChecker, to be
+ * verified together.
+ */
+class SignatureBatch
+{
+    friend class BatchingTransactionSignatureChecker;
+
+private:
+    std::vector<CSignatureCheck> m_checks;
+    //! Signature cache entries to add once verified, with the index of their check
+    std::vector<std::pair<size_t, uint256>> m_cache_entries;
+
+public:
+    size_t size() const { return m_checks.size(); }
+
+    /** Drop the signatures collected after the first size ones. */
+    void Truncate(size_t size);
+
+    /**
+     * Verify the signatures, setting valid to whether each is, and add the valid
+     * ones to the signature cache as they were collected to be. Returns whether
+     * all are valid.
+     */
+    bool Verify(std::vector<bool>& valid) const;
+};
+
+/**
+ * A signature checker that takes the signatures not in the signature cache to be
+ * valid, collecting them into a batch to verify afterwards. A script that passes
+ * with it is valid if the collected signatures are. Otherwise, as a failed
+ * signature check can change what a script does, it has to be run again with a
+ * CachingTransactionSignatureChecker to know whether it is valid.
+ */
+class BatchingTransactionSignatureChecker : public CachingTransactionSignatureChecker
+{
+private:
+    SignatureBatch& m_batch;
+
+public:
+    BatchingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn, SignatureBatch& batch) : CachingTransactionSignatureChecker(txToIn, nInIn, amountIn, storeIn, txdataIn), m_batch(batch) {}
+
+    bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
+};
+
+/** Signature cache activity since it was last resized, and how full it is. */
+struct SignatureCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    //! Lookups made connecting blocks, which erase the entries they find
+    uint64_t block_hits = 0;
+    uint64_t block_misses = 0;
+    uint64_t insertions = 0;
+    //! Insertions that pushed an entry out, as the cache was full
+    uint64_t evictions = 0;
+    //! Entries that are not erased yet
+    size_t entries = 0;
+    size_t capacity = 0;
+    size_t shards = 0;
+};
+
 void InitSignatureCache();
+/** Replace the signature cache with an empty one of about nBytes. Returns the number of entries it can store. */
+size_t ResizeSignatureCache(size_t nBytes);
+SignatureCacheStats GetSignatureCacheStats();
 
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
@@ -388,6 +388,33 @@ SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_ecdsa_verify(
     const secp256k1_pubkey *pubkey
 ) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4);
 
+/* LOCAL PATCH (Obsidian), not in upstream libsecp256k1: batch ECDSA verification. See README.md. */
+
+/** Verify a batch of ECDSA signatures.
+ *
+ *  Returns: the number of correct signatures
+ *  Args:    ctx:       a secp256k1 context object, initialized for verification.
+ *  Out:     valid:     pointer to an array of n ints, each set to 1 if the
+ *                      corresponding signature is correct and 0 if not (cannot be NULL)
+ *  In:      sigs:      pointer to an array of n signatures (cannot be NULL)
+ *           msgs32:    pointer to n 32-byte message hashes, one after the other (cannot be NULL)
+ *           pubkeys:   pointer to an array of n initialized public keys (cannot be NULL)
+ *           n:         the number of signatures
+ *
+ * Each signature is checked exactly as secp256k1_ecdsa_verify would check it,
+ * so only lower-S signatures are accepted. Inverting the s value takes a good
+ * part of the time of a verification, and here it is done for a whole batch at
+ * once, which makes verifying many signatures faster than one by one.
+ */
+SECP256K1_API size_t secp256k1_ecdsa_verify_batch(
+    const secp256k1_context* ctx,
+    int *valid,
+    const secp256k1_ecdsa_signature *sigs,
+    const unsigned char *msgs32,
+    const secp256k1_pubkey *pubkeys,
+    size_t n
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4) SECP256K1_ARG_NONNULL(5);
+
 /** Convert a signature to a normalized lower-S form.
  *
  *  Returns: 1 if sigin was not normalized, 0 if it already was.
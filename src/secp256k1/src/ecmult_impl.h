@@ -32,7 +32,12 @@
 #define WINDOW_A 5
 /** larger numbers may result in slightly better performance, at the cost of
     exponentially larger precomputed tables. */
-#ifdef USE_ENDOMORPHISM
+#if defined(ECMULT_WINDOW_SIZE)
+#  if ECMULT_WINDOW_SIZE < 2 || ECMULT_WINDOW_SIZE > 24
+#    error Set ECMULT_WINDOW_SIZE to an integer in range [2..24].
+#  endif
+#  define WINDOW_G ECMULT_WINDOW_SIZE
+#elif defined(USE_ENDOMORPHISM)
 /** Two tables for window size 15: 1.375 MiB. */
 #define WINDOW_G 15
 #else
@@ -44,6 +49,10 @@
 /** The number of entries a table with precomputed multiples needs to have. */
 #define ECMULT_TABLE_SIZE(w) (1 << ((w)-2))
 
+#ifdef USE_ECMULT_STATIC_VERIFY_TABLES
+#include "ecmult_static_pre_g.h"
+#endif
+
 /** Fill a table 'prej' with precomputed odd multiples of a. Prej will contain
  *  the values [1*a,3*a,...,(2*n-1)*a], so it space for n values. zr[0] will
  *  contain prej[0].z / a.z. The other zr[i] values = prej[i].z / prej[i-1].z.
@@ -162,12 +171,15 @@ static void secp256k1_ecmult_context_init(secp256k1_ecmult_context *ctx) {
 }
 
 static void secp256k1_ecmult_context_build(secp256k1_ecmult_context *ctx, const secp256k1_callback *cb) {
+#ifndef USE_ECMULT_STATIC_VERIFY_TABLES
     secp256k1_gej gj;
+#endif
 
     if (ctx->pre_g != NULL) {
         return;
     }
 
+#ifndef USE_ECMULT_STATIC_VERIFY_TABLES
     /* get the generator */
     secp256k1_gej_set_ge(&gj, &secp256k1_ge_const_g);
 
@@ -191,10 +203,19 @@ static void secp256k1_ecmult_context_build(secp256k1_ecmult_context *ctx, const
         secp256k1_ecmult_odd_multiples_table_storage_var(ECMULT_TABLE_SIZE(WINDOW_G), *ctx->pre_g_128, &g_128j, cb);
     }
 #endif
+#else
+    /* the tables were generated at build time, and are shared read-only by all contexts */
+    (void)cb;
+    ctx->pre_g = (secp256k1_ge_storage (*)[])secp256k1_ecmult_static_pre_g;
+#ifdef USE_ENDOMORPHISM
+    ctx->pre_g_128 = (secp256k1_ge_storage (*)[])secp256k1_ecmult_static_pre_g_128;
+#endif
+#endif
 }
 
 static void secp256k1_ecmult_context_clone(secp256k1_ecmult_context *dst,
                                            const secp256k1_ecmult_context *src, const secp256k1_callback *cb) {
+#ifndef USE_ECMULT_STATIC_VERIFY_TABLES
     if (src->pre_g == NULL) {
         dst->pre_g = NULL;
     } else {
@@ -211,6 +232,13 @@ static void secp256k1_ecmult_context_clone(secp256k1_ecmult_context *dst,
         memcpy(dst->pre_g_128, src->pre_g_128, size);
     }
 #endif
+#else
+    (void)cb;
+    dst->pre_g = src->pre_g;
+#ifdef USE_ENDOMORPHISM
+    dst->pre_g_128 = src->pre_g_128;
+#endif
+#endif
 }
 
 static int secp256k1_ecmult_context_is_built(const secp256k1_ecmult_context *ctx) {
@@ -218,9 +246,11 @@ static int secp256k1_ecmult_context_is_built(const secp256k1_ecmult_context *ctx
 }
 
 static void secp256k1_ecmult_context_clear(secp256k1_ecmult_context *ctx) {
+#ifndef USE_ECMULT_STATIC_VERIFY_TABLES
     free(ctx->pre_g);
 #ifdef USE_ENDOMORPHISM
     free(ctx->pre_g_128);
+#endif
 #endif
     secp256k1_ecmult_context_init(ctx);
 }
@@ -0,0 +1,85 @@
+/**********************************************************************
+ * Copyright (c) 2013, 2014, 2015 Thomas Daede, Cory Fields           *
+ * Distributed under the MIT software license, see the accompanying   *
+ * file COPYING or http://www.opensource.org/licenses/mit-license.php.*
+ **********************************************************************/
+
+#define USE_BASIC_CONFIG 1
+
+#include "basic-config.h"
+#include "include/secp256k1.h"
+#include "field_impl.h"
+#include "scalar_impl.h"
+#include "group_impl.h"
+#include "ecmult_impl.h"
+
+static void default_error_callback_fn(const char* str, void* data) {
+    (void)data;
+    fprintf(stderr, "[libsecp256k1] internal consistency check failed: %s\n", str);
+    abort();
+}
+
+static const secp256k1_callback default_error_callback = {
+    default_error_callback_fn,
+    NULL
+};
+
+static void print_table(FILE *fp, const char *name, const secp256k1_ge_storage *table, int n) {
+    int i;
+
+    fprintf(fp, "static const secp256k1_ge_storage %s[ECMULT_TABLE_SIZE(WINDOW_G)] = {\n", name);
+    for (i = 0; i != n; i++) {
+        fprintf(fp,"    SC(%uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu, %uu)", SECP256K1_GE_STORAGE_CONST_GET(table[i]));
+        fprintf(fp, i != n - 1 ? ",\n" : "\n");
+    }
+    fprintf(fp, "};\n");
+}
+
+int main(int argc, char **argv) {
+    const int n = ECMULT_TABLE_SIZE(WINDOW_G);
+    secp256k1_ge_storage *table;
+    secp256k1_gej gj;
+    int i;
+    FILE* fp;
+
+    (void)argc;
+    (void)argv;
+
+    fp = fopen("src/ecmult_static_pre_g.h","w");
+    if (fp == NULL) {
+        fprintf(stderr, "Could not open src/ecmult_static_pre_g.h for writing!\n");
+        return -1;
+    }
+
+    fprintf(fp, "#ifndef _SECP256K1_ECMULT_STATIC_PRE_G_\n");
+    fprintf(fp, "#define _SECP256K1_ECMULT_STATIC_PRE_G_\n");
+    fprintf(fp, "#include \"group.h\"\n");
+    fprintf(fp, "#if WINDOW_G != %d\n", WINDOW_G);
+    fprintf(fp, "#  error ecmult_static_pre_g.h was generated for another window size, rebuild it.\n");
+    fprintf(fp, "#endif\n");
+    fprintf(fp, "#define SC SECP256K1_GE_STORAGE_CONST\n");
+
+    table = (secp256k1_ge_storage *)checked_malloc(&default_error_callback, sizeof(*table) * n);
+
+    /* The odd multiples of the generator, as secp256k1_ecmult_context_build computes them. */
+    secp256k1_gej_set_ge(&gj, &secp256k1_ge_const_g);
+    secp256k1_ecmult_odd_multiples_table_storage_var(n, table, &gj, &default_error_callback);
+    print_table(fp, "secp256k1_ecmult_static_pre_g", table, n);
+
+    /* The odd multiples of 2^128 times the generator, used with the endomorphism optimization. */
+    for (i = 0; i < 128; i++) {
+        secp256k1_gej_double_var(&gj, &gj, NULL);
+    }
+    secp256k1_ecmult_odd_multiples_table_storage_var(n, table, &gj, &default_error_callback);
+    fprintf(fp, "#ifdef USE_ENDOMORPHISM\n");
+    print_table(fp, "secp256k1_ecmult_static_pre_g_128", table, n);
+    fprintf(fp, "#endif\n");
+
+    free(table);
+
+    fprintf(fp, "#undef SC\n");
+    fprintf(fp, "#endif\n");
+    fclose(fp);
+
+    return 0;
+}
@@ -307,6 +307,60 @@ int secp256k1_ecdsa_verify(const secp256k1_context* ctx, const secp256k1_ecdsa_s
             secp256k1_ecdsa_sig_verify(&ctx->ecmult_ctx, &r, &s, &q, &m));
 }
 
+/* LOCAL PATCH (Obsidian), not in upstream libsecp256k1: batch ECDSA verification. See README.md. */
+
+/* The number of signatures secp256k1_ecdsa_verify_batch inverts the s values of at once. */
+#define ECDSA_VERIFY_BATCH_CHUNK 64
+
+size_t secp256k1_ecdsa_verify_batch(const secp256k1_context* ctx, int *valid, const secp256k1_ecdsa_signature *sigs, const unsigned char *msgs32, const secp256k1_pubkey *pubkeys, size_t n) {
+    secp256k1_scalar r[ECDSA_VERIFY_BATCH_CHUNK];
+    secp256k1_scalar s[ECDSA_VERIFY_BATCH_CHUNK];
+    secp256k1_scalar before[ECDSA_VERIFY_BATCH_CHUNK];
+    size_t begin, i, count = 0;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(valid != NULL);
+    ARG_CHECK(sigs != NULL);
+    ARG_CHECK(msgs32 != NULL);
+    ARG_CHECK(pubkeys != NULL);
+
+    for (begin = 0; begin < n; begin += ECDSA_VERIFY_BATCH_CHUNK) {
+        size_t end = n - begin < ECDSA_VERIFY_BATCH_CHUNK ? n : begin + ECDSA_VERIFY_BATCH_CHUNK;
+        secp256k1_scalar acc, inv;
+
+        /* Multiply the s values together, remembering the product of those before each
+         * one, and invert the product. Signatures that fail the cheap checks are left out. */
+        secp256k1_scalar_set_int(&acc, 1);
+        for (i = begin; i < end; i++) {
+            secp256k1_ecdsa_signature_load(ctx, &r[i - begin], &s[i - begin], &sigs[i]);
+            valid[i] = !secp256k1_scalar_is_high(&s[i - begin]) && !secp256k1_scalar_is_zero(&s[i - begin]);
+            before[i - begin] = acc;
+            if (valid[i]) {
+                secp256k1_scalar_mul(&acc, &acc, &s[i - begin]);
+            }
+        }
+        secp256k1_scalar_inverse_var(&inv, &acc);
+
+        /* Going backwards, inv is the inverse of the product of the s values up to and
+         * including i, so multiplying it by the product of those before gives the inverse
+         * of s, and multiplying it by s gives the inverse for i - 1. */
+        for (i = end; i-- > begin;) {
+            secp256k1_scalar sn, m;
+            secp256k1_ge q;
+            if (!valid[i]) {
+                continue;
+            }
+            secp256k1_scalar_mul(&sn, &inv, &before[i - begin]);
+            secp256k1_scalar_mul(&inv, &inv, &s[i - begin]);
+            secp256k1_scalar_set_b32(&m, &msgs32[32 * i], NULL);
+            valid[i] = secp256k1_pubkey_load(ctx, &q, &pubkeys[i]) &&
+                       secp256k1_ecdsa_sig_verify_sinv(&ctx->ecmult_ctx, &r[i - begin], &sn, &q, &m);
+            count += valid[i];
+        }
+    }
+    return count;
+}
+
 static int nonce_function_rfc6979(unsigned char *nonce32, const unsigned char *msg32, const unsigned char *key32, const unsigned char *algo16, void *data, unsigned int counter) {
    unsigned char keydata[112];
    int keylen = 64;
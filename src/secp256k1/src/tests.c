@@ -3641,6 +3641,57 @@ void run_ecdsa_end_to_end(void) {
     }
 }
 
+/* LOCAL PATCH (Obsidian), not in upstream libsecp256k1: batch ECDSA verification. */
+void test_ecdsa_verify_batch(void) {
+    /* More signatures than are inverted at once, to have a partial second chunk. */
+    secp256k1_ecdsa_signature sigs[ECDSA_VERIFY_BATCH_CHUNK + 6];
+    secp256k1_pubkey pubkeys[ECDSA_VERIFY_BATCH_CHUNK + 6];
+    unsigned char msgs[32 * (ECDSA_VERIFY_BATCH_CHUNK + 6)];
+    int valid[ECDSA_VERIFY_BATCH_CHUNK + 6];
+    const size_t n = ECDSA_VERIFY_BATCH_CHUNK + 6;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        secp256k1_scalar msg, key;
+        unsigned char privkey[32];
+        random_scalar_order_test(&msg);
+        random_scalar_order_test(&key);
+        secp256k1_scalar_get_b32(privkey, &key);
+        secp256k1_scalar_get_b32(&msgs[32 * i], &msg);
+        CHECK(secp256k1_ec_pubkey_create(ctx, &pubkeys[i], privkey) == 1);
+        CHECK(secp256k1_ecdsa_sign(ctx, &sigs[i], &msgs[32 * i], privkey, NULL, NULL) == 1);
+    }
+    CHECK(secp256k1_ecdsa_verify_batch(ctx, valid, sigs, msgs, pubkeys, n) == n);
+    for (i = 0; i < n; i++) {
+        CHECK(valid[i] == 1);
+    }
+    CHECK(secp256k1_ecdsa_verify_batch(ctx, valid, sigs, msgs, pubkeys, 0) == 0);
+
+    /* A changed message, a high-S signature and a wrong key, in both chunks. */
+    msgs[32 * 3] ^= 1;
+    {
+        secp256k1_scalar r, s;
+        secp256k1_ecdsa_signature_load(ctx, &r, &s, &sigs[ECDSA_VERIFY_BATCH_CHUNK + 1]);
+        secp256k1_scalar_negate(&s, &s);
+        secp256k1_ecdsa_signature_save(&sigs[ECDSA_VERIFY_BATCH_CHUNK + 1], &r, &s);
+    }
+    pubkeys[ECDSA_VERIFY_BATCH_CHUNK - 1] = pubkeys[0];
+    CHECK(secp256k1_ecdsa_verify_batch(ctx, valid, sigs, msgs, pubkeys, n) == n - 3);
+    for (i = 0; i < n; i++) {
+        CHECK(valid[i] == secp256k1_ecdsa_verify(ctx, &sigs[i], &msgs[32 * i], &pubkeys[i]));
+    }
+    CHECK(valid[3] == 0);
+    CHECK(valid[ECDSA_VERIFY_BATCH_CHUNK - 1] == 0);
+    CHECK(valid[ECDSA_VERIFY_BATCH_CHUNK + 1] == 0);
+}
+
+void run_ecdsa_verify_batch(void) {
+    int i;
+    for (i = 0; i < count; i++) {
+        test_ecdsa_verify_batch();
+    }
+}
+
 int test_ecdsa_der_parse(const unsigned char *sig, size_t siglen, int certainly_der, int certainly_not_der) {
     static const unsigned char zeroes[32] = {0};
 #ifdef ENABLE_OPENSSL_TESTS
@@ -4515,6 +4566,7 @@ int main(int argc, char **argv) {
     run_ecdsa_der_parse();
     run_ecdsa_sign_verify();
     run_ecdsa_end_to_end();
+    run_ecdsa_verify_batch();
     run_ecdsa_edge_cases();
 #ifdef ENABLE_OPENSSL_TESTS
     run_ecdsa_openssl();
@@ -463,6 +463,12 @@ public:
         return (*this);
     }
 
+    //! Exchange the stream's storage with vchIn without copying, and rewind to its start
+    void swap(vector_type& vchIn) {
+        vch.swap(vchIn);
+        nReadPos = 0;
+    }
+
     void GetAndClear(CSerializeData &d) {
         d.insert(d.end(), begin(), end());
         clear();
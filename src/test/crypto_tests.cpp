@@ -562,4 +562,28 @@ BOOST_AUTO_TEST_CASE(sha256d64)
     }
 }
 
+BOOST_AUTO_TEST_CASE(sha256d_multi)
+{
+    // Messages of all lengths around the padding boundaries, and a few longer ones.
+    std::vector<std::vector<unsigned char>> messages;
+    for (size_t len = 0; len <= 130; ++len) {
+        messages.push_back(g_insecure_rand_ctx.randbytes(len));
+    }
+    for (int i = 0; i < 8; ++i) {
+        messages.push_back(g_insecure_rand_ctx.randbytes(InsecureRandRange(2000)));
+    }
+    for (size_t count = 0; count <= messages.size(); count += 1 + count / 8) {
+        std::vector<const unsigned char*> inputs;
+        std::vector<size_t> lengths;
+        std::vector<unsigned char> out1(32 * count), out2(32 * count);
+        for (size_t i = 0; i < count; ++i) {
+            inputs.push_back(messages[i].data());
+            lengths.push_back(messages[i].size());
+            CHash256().Write(messages[i].data(), messages[i].size()).Finalize(out1.data() + 32 * i);
+        }
+        SHA256DMulti(out2.data(), inputs.data(), lengths.data(), count);
+        BOOST_CHECK(out1 == out2);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -177,6 +177,31 @@ BOOST_AUTO_TEST_CASE(cuckoocache_erase_ok)
     test_cache_erase<CuckooCache::cache<uint256, SignatureCacheHasher>>(megabytes);
 }
 
+BOOST_AUTO_TEST_CASE(cuckoocache_count_live)
+{
+    SeedInsecureRand(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> set{};
+    const uint32_t size = set.setup_bytes(1 << 20);
+    BOOST_CHECK_EQUAL(set.capacity(), size);
+    BOOST_CHECK_EQUAL(set.count_live(), 0U);
+
+    // Below the epoch size, nothing is aged out
+    std::vector<uint256> hashes(size / 4);
+    for (uint256& hash : hashes) {
+        hash = InsecureRand256();
+        BOOST_CHECK(set.insert(hash));
+    }
+    BOOST_CHECK_EQUAL(set.count_live(), hashes.size());
+    // Inserting again keeps the element, and does not count it twice
+    BOOST_CHECK(set.insert(hashes[0]));
+    BOOST_CHECK_EQUAL(set.count_live(), hashes.size());
+
+    for (size_t i = 0; i < hashes.size() / 2; ++i) {
+        BOOST_CHECK(set.contains(hashes[i], true));
+    }
+    BOOST_CHECK_EQUAL(set.count_live(), hashes.size() - hashes.size() / 2);
+}
+
 template <typename Cache>
 static void test_cache_erase_parallel(size_t megabytes)
 {
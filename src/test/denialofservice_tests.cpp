@@ -6,13 +6,18 @@
 
 #include <banman.h>
 #include <chainparams.h>
+#include <consensus/merkle.h>
+#include <hash.h>
 #include <keystore.h>
+#include <miner.h>
 #include <net.h>
 #include <net_processing.h>
+#include <netmessagemaker.h>
 #include <pow.h>
 #include <script/sign.h>
 #include <serialize.h>
 #include <util/system.h>
+#include <util/time.h>
 #include <validation.h>
 
 #include <test/test_bitcoin.h>
@@ -445,4 +450,185 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     BOOST_CHECK(mapOrphanTransactions.empty());
 }
 
+BOOST_AUTO_TEST_CASE(blocks_in_transit_target)
+{
+    // Nothing measured yet: fixed default window
+    BOOST_CHECK_EQUAL(ComputeBlocksInTransitTarget(0, 0), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(ComputeBlocksInTransitTarget(0, 100000), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // Slow peer relative to its RTT: small window, but never below the minimum
+    BOOST_CHECK_EQUAL(ComputeBlocksInTransitTarget(1000000, 50000), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK_EQUAL(ComputeBlocksInTransitTarget(1000000, std::numeric_limits<int64_t>::max()), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // Fast peer with 200ms RTT delivering a block every 10ms: 2 * (1 + 20)
+    BOOST_CHECK_EQUAL(ComputeBlocksInTransitTarget(10000, 200000), 42);
+
+    // Very fast peer: capped
+    BOOST_CHECK_EQUAL(ComputeBlocksInTransitTarget(100, 500000), MAX_BLOCKS_IN_TRANSIT_PER_PEER_ADAPTIVE);
+}
+
+struct RegtestingSetup : public TestingSetup {
+    RegtestingSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
+};
+
+/** Hand a message to peerLogic as if node had sent it, and drop whatever is sent back. */
+static void ReceiveMessage(PeerLogicValidation& peerLogic, CNode& node, const CSerializedNetMsg& msg)
+{
+    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.data.size());
+    uint256 hash = Hash(msg.data.begin(), msg.data.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream hdrbuf(SER_NETWORK, INIT_PROTO_VERSION);
+    hdrbuf << hdr;
+
+    CNetMessage netmsg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION);
+    BOOST_CHECK_EQUAL(netmsg.readHeader(hdrbuf.data(), hdrbuf.size()), (int)hdrbuf.size());
+    if (!msg.data.empty()) {
+        BOOST_CHECK_EQUAL(netmsg.readData((const char*)msg.data.data(), msg.data.size()), (int)msg.data.size());
+    }
+    BOOST_CHECK(netmsg.complete());
+    {
+        LOCK(node.cs_vProcessMsg);
+        node.nProcessQueueSize += netmsg.vRecv.size() + CMessageHeader::HEADER_SIZE;
+        node.vProcessMsg.push_back(std::move(netmsg));
+    }
+    std::atomic<bool> interrupt(false);
+    peerLogic.ProcessMessages(&node, interrupt);
+    BOOST_CHECK(!node.fDisconnect);
+
+    LOCK(node.cs_vSend);
+    node.vSendMsg.clear();
+    node.nSendSize = 0;
+    node.fPauseSend = false;
+}
+
+static void SendMessages(PeerLogicValidation& peerLogic, CNode& node)
+{
+    {
+        LOCK2(cs_main, node.cs_sendProcessing);
+        BOOST_CHECK(peerLogic.SendMessages(&node));
+    }
+    LOCK(node.cs_vSend);
+    node.vSendMsg.clear();
+    node.nSendSize = 0;
+    node.fPauseSend = false;
+}
+
+static std::vector<int> HeightsInFlight(const CNode& node)
+{
+    CNodeStateStats stats;
+    BOOST_CHECK(GetNodeStateStats(node.GetId(), stats));
+    return stats.vHeightInFlight;
+}
+
+static int64_t BlockInterval(const CNode& node)
+{
+    CNodeStateStats stats;
+    BOOST_CHECK(GetNodeStateStats(node.GetId(), stats));
+    return stats.nBlockIntervalUsec;
+}
+
+// Test that blocks requested from a peer that does not deliver them are re-requested from a peer
+// whose delivery interval has been measured, without waiting for the stalling timeout.
+BOOST_FIXTURE_TEST_CASE(stalled_blocks_reassigned, RegtestingSetup)
+{
+    auto connman = MakeUnique<CConnman>(0x1337, 0x1337);
+    auto peerLogic = MakeUnique<PeerLogicValidation>(connman.get(), nullptr, scheduler, false);
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+
+    // A chain of 5 blocks on top of genesis that only the peers have
+    std::vector<CBlock> blocks;
+    {
+        LOCK(cs_main);
+        uint256 prev_hash = chainActive.Tip()->GetBlockHash();
+        uint32_t time = chainActive.Tip()->nTime;
+        for (int i = 0; i < 5; i++) {
+            CScript script_pub_key = CScript() << i << OP_TRUE;
+            CBlock block = BlockAssembler(Params()).CreateNewBlock(script_pub_key)->block;
+            block.hashPrevBlock = prev_hash;
+            block.nTime = ++time;
+            CMutableTransaction coinbase(*block.vtx[0]);
+            coinbase.vout.resize(1);
+            coinbase.vin[0].scriptWitness.SetNull();
+            block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+            block.hashMerkleRoot = BlockMerkleRoot(block);
+            while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, Params().GetConsensus())) {
+                ++block.nNonce;
+            }
+            prev_hash = block.GetHash();
+            blocks.push_back(block);
+        }
+    }
+    auto headers = [&](size_t begin, size_t end) {
+        std::vector<CBlock> ret;
+        for (size_t i = begin; i < end; i++) {
+            ret.push_back(blocks[i].GetBlockHeader());
+        }
+        return msgMaker.Make(NetMsgType::HEADERS, ret);
+    };
+
+    // Two inbound peers, fast and slow, that complete the version handshake
+    std::vector<std::unique_ptr<CNode>> nodes;
+    for (int i = 0; i < 2; i++) {
+        CAddress addr(ip(0xa0b0c001 + i), NODE_NONE);
+        nodes.emplace_back(new CNode(id++, ServiceFlags(NODE_NETWORK|NODE_WITNESS), 0, INVALID_SOCKET, addr, 0, 0, CAddress(), "", /*fInboundIn=*/ true));
+        CNode& node = *nodes.back();
+        peerLogic->InitializeNode(&node);
+        ReceiveMessage(*peerLogic, node, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERSION, PROTOCOL_VERSION, (uint64_t)(NODE_NETWORK|NODE_WITNESS), GetTime(),
+            CAddress(CService(), NODE_NONE), CAddress(CService(), NODE_NONE), (uint64_t)i, std::string(), 0, true));
+        ReceiveMessage(*peerLogic, node, msgMaker.Make(NetMsgType::VERACK));
+        BOOST_CHECK(node.fSuccessfullyConnected);
+    }
+    CNode& fast = *nodes[0];
+    CNode& slow = *nodes[1];
+
+    // The fast peer delivers the first block as soon as it is requested, which records its delivery interval
+    ReceiveMessage(*peerLogic, fast, headers(0, 1));
+    SendMessages(*peerLogic, fast);
+    BOOST_CHECK(HeightsInFlight(fast) == std::vector<int>({1}));
+    BOOST_CHECK_EQUAL(BlockInterval(fast), 0);
+    ReceiveMessage(*peerLogic, fast, msgMaker.Make(NetMsgType::BLOCK, blocks[0]));
+    BOOST_CHECK(HeightsInFlight(fast).empty());
+    BOOST_CHECK(BlockInterval(fast) > 0);
+    BOOST_CHECK(BlockInterval(fast) < 1000000);
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(chainActive.Height(), 1);
+    }
+
+    // The slow peer announces the rest first and gets all of it in flight
+    ReceiveMessage(*peerLogic, slow, headers(1, 5));
+    SendMessages(*peerLogic, slow);
+    BOOST_CHECK(HeightsInFlight(slow) == std::vector<int>({2, 3, 4, 5}));
+
+    // Requested just now, so the fast peer leaves them with the slow one
+    ReceiveMessage(*peerLogic, fast, headers(1, 5));
+    SendMessages(*peerLogic, fast);
+    BOOST_CHECK(HeightsInFlight(fast).empty());
+    BOOST_CHECK(HeightsInFlight(slow) == std::vector<int>({2, 3, 4, 5}));
+
+    // Once outstanding for longer than the minimum reassignment age (1s), they move to the fast peer
+    MilliSleep(1100);
+    SendMessages(*peerLogic, fast);
+    BOOST_CHECK(HeightsInFlight(fast) == std::vector<int>({2, 3, 4, 5}));
+    BOOST_CHECK(HeightsInFlight(slow).empty());
+
+    // A late delivery from the slow peer connects the block but doesn't count as a measured delivery
+    ReceiveMessage(*peerLogic, slow, msgMaker.Make(NetMsgType::BLOCK, blocks[1]));
+    BOOST_CHECK_EQUAL(BlockInterval(slow), 0);
+    BOOST_CHECK(HeightsInFlight(fast) == std::vector<int>({3, 4, 5}));
+    for (size_t i = 2; i < blocks.size(); i++) {
+        ReceiveMessage(*peerLogic, fast, msgMaker.Make(NetMsgType::BLOCK, blocks[i]));
+    }
+    BOOST_CHECK(HeightsInFlight(fast).empty());
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(chainActive.Height(), 5);
+    }
+
+    bool dummy;
+    for (const auto& node : nodes) {
+        peerLogic->FinalizeNode(node->GetId(), dummy);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -46,6 +46,25 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
 #undef T
 }
 
+BOOST_AUTO_TEST_CASE(murmurhash3_prepared)
+{
+    // A prepared input must hash like MurmurHash3 under any seed, for every tail length.
+    for (size_t size = 0; size < 42; ++size) {
+        std::vector<unsigned char> data(size);
+        for (auto& byte : data) byte = InsecureRandBits(8);
+        const MurmurHash3Prepared prepared(data);
+
+        uint32_t seeds[5];
+        uint32_t hashes[5];
+        for (auto& seed : seeds) seed = InsecureRand32();
+        prepared.Hash(seeds, hashes, 5);
+        for (size_t j = 0; j < 5; ++j) {
+            BOOST_CHECK_EQUAL(prepared.Hash(seeds[j]), MurmurHash3(seeds[j], data));
+            BOOST_CHECK_EQUAL(hashes[j], MurmurHash3(seeds[j], data));
+        }
+    }
+}
+
 /*
    SipHash-2-4 output with
    k = 00 01 02 ...
@@ -11,6 +11,7 @@
 #include <util/strencodings.h>
 #include <test/test_bitcoin.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -188,4 +189,41 @@ BOOST_AUTO_TEST_CASE(key_signature_tests)
     BOOST_CHECK(found_small);
 }
 
+BOOST_AUTO_TEST_CASE(key_signature_batch)
+{
+    std::vector<CKey> keys(3);
+    for (CKey& key : keys) {
+        key.MakeNewKey(true);
+    }
+    keys.emplace_back();
+    keys.back().MakeNewKey(false);
+
+    // Enough signatures for the batch to be verified in more than one go, with the keys repeated
+    std::vector<CSignatureCheck> checks;
+    for (int i = 0; i < 150; i++) {
+        const CKey& key = keys[i % keys.size()];
+        const uint256 hash = InsecureRand256();
+        std::vector<unsigned char> sig;
+        BOOST_CHECK(key.Sign(hash, sig));
+        checks.emplace_back(key.GetPubKey(), hash, sig);
+    }
+    std::vector<bool> valid;
+    BOOST_CHECK(VerifySignatureBatch(checks, valid));
+    BOOST_CHECK(std::count(valid.begin(), valid.end(), true) == 150);
+
+    // A wrong key, a wrong hash, a signature that does not parse and an invalid key
+    checks[3].pubkey = keys[0].GetPubKey();
+    checks[70].hash = InsecureRand256();
+    checks[100].sig.assign(10, 0);
+    checks[149].pubkey = CPubKey();
+    BOOST_CHECK(!VerifySignatureBatch(checks, valid));
+    for (size_t i = 0; i < checks.size(); i++) {
+        BOOST_CHECK_EQUAL(valid[i], checks[i].pubkey.Verify(checks[i].hash, checks[i].sig));
+        BOOST_CHECK_EQUAL(valid[i], i != 3 && i != 70 && i != 100 && i != 149);
+    }
+
+    BOOST_CHECK(VerifySignatureBatch({}, valid));
+    BOOST_CHECK(valid.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
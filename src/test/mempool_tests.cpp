@@ -590,6 +590,41 @@ inline CTransactionRef make_tx(std::vector<CAmount>&& output_values, std::vector
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolTrimOrderTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // A parent with a high and a low feerate child, and an unrelated transaction. Evicting the
+    // low feerate child raises the descendant score of the parent above that of the unrelated
+    // transaction, which must then go first.
+    CTransactionRef parent = make_tx(/* output_values */ {10 * COIN, 10 * COIN});
+    CTransactionRef child_high = make_tx(/* output_values */ {10 * COIN}, /* inputs */ {parent}, /* input_indices */ {0});
+    CTransactionRef child_low = make_tx(/* output_values */ {10 * COIN}, /* inputs */ {parent}, /* input_indices */ {1});
+    CTransactionRef unrelated = make_tx(/* output_values */ {5 * COIN});
+    const auto fee_per_byte = [](const CTransactionRef& tx, CAmount rate) { return rate * GetVirtualTransactionSize(*tx); };
+
+    pool.addUnchecked(entry.Fee(fee_per_byte(parent, 2)).FromTx(parent));
+    pool.addUnchecked(entry.Fee(fee_per_byte(child_high, 30)).FromTx(child_high));
+    const size_t usage_family = pool.DynamicMemoryUsage();
+    pool.addUnchecked(entry.Fee(fee_per_byte(unrelated, 15)).FromTx(unrelated));
+    const size_t usage_without_low = pool.DynamicMemoryUsage();
+    pool.addUnchecked(entry.Fee(fee_per_byte(child_low, 1)).FromTx(child_low));
+
+    // The parent scores 2 on its own, about 13 with both children and about 20 with the high
+    // feerate child only.
+    BOOST_CHECK(pool.mapTx.get<descendant_score>().begin()->GetTx().GetHash() == child_low->GetHash());
+
+    // Asking for more than the low feerate child frees, but less than the unrelated transaction
+    // also frees, removes exactly those two.
+    pool.TrimToSize(usage_without_low - (usage_without_low - usage_family) / 2);
+    BOOST_CHECK(!pool.exists(child_low->GetHash()));
+    BOOST_CHECK(!pool.exists(unrelated->GetHash()));
+    BOOST_CHECK(pool.exists(parent->GetHash()));
+    BOOST_CHECK(pool.exists(child_high->GetHash()));
+}
+
 BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
 {
     size_t ancestors, descendants;
@@ -749,4 +784,273 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 6ULL);
 }
 
+/** Chunks of the pool's linearized clusters, best first, as lists of txids */
+static std::vector<std::vector<uint256>> GetChunkTxids(CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
+{
+    std::vector<std::vector<uint256>> chunks;
+    for (const CTxMemPool::ClusterChunk& chunk : pool.GetLinearizedChunks()) {
+        const std::vector<CTxMemPool::txiter>& linearization = pool.GetClusterLinearization(chunk.cluster);
+        chunks.emplace_back();
+        for (size_t i = chunk.begin; i < chunk.end; ++i) {
+            chunks.back().push_back(linearization[i]->GetTx().GetHash());
+        }
+    }
+    return chunks;
+}
+
+BOOST_AUTO_TEST_CASE(MempoolClusterLinearizationTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // [tx1] <- [tx2]: a zero fee parent paid for by its child, added before tracking is enabled
+    CTransactionRef tx1 = make_tx(/* output_values */ {10 * COIN});
+    pool.addUnchecked(entry.Fee(0LL).FromTx(tx1));
+    CTransactionRef tx2 = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {tx1});
+    pool.addUnchecked(entry.Fee(80000LL).FromTx(tx2));
+
+    pool.SetClusterTracking(true);
+    BOOST_CHECK(pool.IsTrackingClusters());
+
+    // [tx3] <- [tx4]: the child pays less than its parent, so they form separate chunks
+    CTransactionRef tx3 = make_tx(/* output_values */ {8 * COIN});
+    pool.addUnchecked(entry.Fee(10000LL).FromTx(tx3));
+    CTransactionRef tx4 = make_tx(/* output_values */ {7 * COIN}, /* inputs */ {tx3});
+    pool.addUnchecked(entry.Fee(0LL).FromTx(tx4));
+
+    // [tx5] on its own
+    CTransactionRef tx5 = make_tx(/* output_values */ {6 * COIN});
+    pool.addUnchecked(entry.Fee(5000LL).FromTx(tx5));
+
+    std::vector<std::vector<uint256>> expected{
+        {tx1->GetHash(), tx2->GetHash()},
+        {tx3->GetHash()},
+        {tx5->GetHash()},
+        {tx4->GetHash()},
+    };
+    BOOST_CHECK(GetChunkTxids(pool) == expected);
+
+    // Prioritising moves tx5 to the front
+    pool.PrioritiseTransaction(tx5->GetHash(), 1 * COIN);
+    expected = {
+        {tx5->GetHash()},
+        {tx1->GetHash(), tx2->GetHash()},
+        {tx3->GetHash()},
+        {tx4->GetHash()},
+    };
+    BOOST_CHECK(GetChunkTxids(pool) == expected);
+
+    // Mining tx3 leaves tx4 in a cluster of its own
+    pool.removeForBlock({tx3}, 1);
+    expected = {
+        {tx5->GetHash()},
+        {tx1->GetHash(), tx2->GetHash()},
+        {tx4->GetHash()},
+    };
+    BOOST_CHECK(GetChunkTxids(pool) == expected);
+
+    // A child of tx2 and tx4 joins their clusters; being worth less than tx1+tx2, it ends up in a
+    // chunk with tx4 after them.
+    CTransactionRef tx6 = make_tx(/* output_values */ {5 * COIN}, /* inputs */ {tx2, tx4});
+    pool.addUnchecked(entry.Fee(3000LL).FromTx(tx6));
+    expected = {
+        {tx5->GetHash()},
+        {tx1->GetHash(), tx2->GetHash()},
+        {tx4->GetHash(), tx6->GetHash()},
+    };
+    BOOST_CHECK(GetChunkTxids(pool) == expected);
+    BOOST_CHECK_EQUAL(pool.GetClusterLinearization(pool.GetLinearizedChunks().rbegin()->cluster).size(), 4U);
+
+    // Trimming evicts the worst chunk first
+    pool.TrimToSize(pool.DynamicMemoryUsage() - 1);
+    BOOST_CHECK(pool.exists(tx1->GetHash()));
+    BOOST_CHECK(pool.exists(tx2->GetHash()));
+    BOOST_CHECK(!pool.exists(tx4->GetHash()));
+    BOOST_CHECK(pool.exists(tx5->GetHash()));
+    BOOST_CHECK(!pool.exists(tx6->GetHash()));
+    expected = {
+        {tx5->GetHash()},
+        {tx1->GetHash(), tx2->GetHash()},
+    };
+    BOOST_CHECK(GetChunkTxids(pool) == expected);
+
+    pool.SetClusterTracking(false);
+    BOOST_CHECK(!pool.IsTrackingClusters());
+    pool.SetClusterTracking(true);
+    BOOST_CHECK(GetChunkTxids(pool) == expected);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // [tx1] <- [tx2] <- [tx3], where tx1 signals replaceability and tx4 stands alone
+    CMutableTransaction mtx1;
+    mtx1.vin.resize(1);
+    mtx1.vin[0].nSequence = 0;
+    mtx1.vout.resize(1);
+    mtx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    mtx1.vout[0].nValue = 10 * COIN;
+    CTransactionRef tx1 = MakeTransactionRef(mtx1);
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(tx1));
+    CTransactionRef tx2 = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {tx1});
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(tx2));
+    CTransactionRef tx3 = make_tx(/* output_values */ {8 * COIN}, /* inputs */ {tx2});
+    pool.addUnchecked(entry.Fee(1000LL).FromTx(tx3));
+    CTransactionRef tx4 = make_tx(/* output_values */ {7 * COIN});
+    pool.addUnchecked(entry.Fee(5000LL).FromTx(tx4));
+
+    const size_t usage_without_snapshot = pool.DynamicMemoryUsage();
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = pool.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot->GetTransactionsUpdated(), pool.GetTransactionsUpdated());
+    // The kept snapshot is accounted for separately from the mempool, so it doesn't count against its limit
+    BOOST_CHECK(snapshot->DynamicMemoryUsage() > 0);
+    BOOST_CHECK_EQUAL(pool.SnapshotMemoryUsage(), snapshot->DynamicMemoryUsage());
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), usage_without_snapshot);
+    // Unchanged mempool, same snapshot
+    BOOST_CHECK(pool.GetSnapshot() == snapshot);
+
+    std::vector<uint256> vtxid;
+    pool.queryHashes(vtxid);
+    BOOST_REQUIRE_EQUAL(snapshot->GetEntries().size(), vtxid.size());
+    for (size_t i = 0; i < vtxid.size(); ++i) {
+        BOOST_CHECK(snapshot->GetEntries()[i].entry.GetTx().GetHash() == vtxid[i]);
+    }
+
+    const CTxMemPoolSnapshot::Entry* e1 = snapshot->Find(tx1->GetHash());
+    const CTxMemPoolSnapshot::Entry* e2 = snapshot->Find(tx2->GetHash());
+    const CTxMemPoolSnapshot::Entry* e3 = snapshot->Find(tx3->GetHash());
+    const CTxMemPoolSnapshot::Entry* e4 = snapshot->Find(tx4->GetHash());
+    BOOST_REQUIRE(e1 && e2 && e3 && e4);
+    BOOST_CHECK(e1->parents.empty());
+    BOOST_CHECK(e1->children == std::vector<uint256>{tx2->GetHash()});
+    BOOST_CHECK(e2->parents == std::vector<uint256>{tx1->GetHash()});
+    BOOST_CHECK(e2->children == std::vector<uint256>{tx3->GetHash()});
+    BOOST_CHECK(e3->parents == std::vector<uint256>{tx2->GetHash()});
+    BOOST_CHECK(e3->children.empty());
+    BOOST_CHECK_EQUAL(e3->entry.GetCountWithAncestors(), 3U);
+    BOOST_CHECK(e3->wtxid == tx3->GetWitnessHash());
+    // Replaceability is inherited from ancestors
+    BOOST_CHECK(e1->bip125_replaceable);
+    BOOST_CHECK(e2->bip125_replaceable);
+    BOOST_CHECK(e3->bip125_replaceable);
+    BOOST_CHECK(!e4->bip125_replaceable);
+
+    // A kept snapshot doesn't make the mempool evict anything
+    pool.TrimToSize(pool.DynamicMemoryUsage());
+    BOOST_CHECK_EQUAL(pool.size(), 4U);
+    BOOST_CHECK_EQUAL(pool.SnapshotMemoryUsage(), snapshot->DynamicMemoryUsage());
+
+    // A snapshot that is out of date is let go when the mempool is trimmed
+    pool.removeRecursive(*tx2);
+    BOOST_CHECK_EQUAL(pool.SnapshotMemoryUsage(), snapshot->DynamicMemoryUsage());
+    pool.TrimToSize(pool.DynamicMemoryUsage());
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+    BOOST_CHECK_EQUAL(pool.SnapshotMemoryUsage(), 0U);
+
+    // A changed mempool gets a new snapshot; the old one is left as it was
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot2 = pool.GetSnapshot();
+    BOOST_CHECK(snapshot2 != snapshot);
+    BOOST_CHECK_EQUAL(snapshot2->GetEntries().size(), 2U);
+    BOOST_CHECK(!snapshot2->Find(tx2->GetHash()));
+    BOOST_CHECK(!snapshot2->Find(tx3->GetHash()));
+    BOOST_CHECK(snapshot2->Find(tx1->GetHash())->children.empty());
+    BOOST_CHECK_EQUAL(snapshot->GetEntries().size(), 4U);
+    BOOST_CHECK(snapshot->Find(tx3->GetHash()) == e3);
+
+    // Relay lookups order like CompareDepthAndScore, with missing transactions last
+    std::vector<uint256> hashes{tx3->GetHash(), tx1->GetHash(), tx4->GetHash()};
+    std::vector<TxMempoolRelayInfo> infos = pool.infoForRelay(hashes);
+    BOOST_REQUIRE_EQUAL(infos.size(), 3U);
+    BOOST_CHECK(!infos[0].info.tx);
+    BOOST_CHECK(infos[1].info.tx == tx1);
+    BOOST_CHECK_EQUAL(infos[2].nCountWithAncestors, 1U);
+    BOOST_CHECK(CTxMemPool::CompareDepthAndScore(infos[1], infos[0]));
+    BOOST_CHECK(!CTxMemPool::CompareDepthAndScore(infos[0], infos[1]));
+    BOOST_CHECK_EQUAL(CTxMemPool::CompareDepthAndScore(infos[1], infos[2]), pool.CompareDepthAndScore(tx1->GetHash(), tx4->GetHash()));
+    BOOST_CHECK_EQUAL(CTxMemPool::CompareDepthAndScore(infos[2], infos[1]), pool.CompareDepthAndScore(tx4->GetHash(), tx1->GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolDeltaTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    CTransactionRef tx1 = make_tx(/* output_values */ {10 * COIN});
+    CTransactionRef tx2 = make_tx(/* output_values */ {9 * COIN}, /* inputs */ {tx1});
+    const uint64_t start = pool.GetSequence();
+    pool.addUnchecked(entry.FromTx(tx1));
+    pool.addUnchecked(entry.FromTx(tx2));
+    BOOST_CHECK_EQUAL(pool.GetSequence(), start + 2);
+    BOOST_CHECK_EQUAL(pool.GetSnapshot()->GetSequence(), start + 2);
+    pool.removeRecursive(*tx1);
+    BOOST_CHECK_EQUAL(pool.GetSequence(), start + 4);
+
+    std::vector<MempoolDelta> deltas;
+    BOOST_CHECK(pool.GetDeltas(start + 1, deltas));
+    BOOST_REQUIRE_EQUAL(deltas.size(), 3U);
+    BOOST_CHECK_EQUAL(deltas[0].sequence, start + 2);
+    BOOST_CHECK(deltas[0].txid == tx2->GetHash());
+    BOOST_CHECK(deltas[0].added);
+    BOOST_CHECK(!deltas[1].added);
+    BOOST_CHECK(!deltas[2].added);
+    BOOST_CHECK_EQUAL(deltas[2].sequence, start + 4);
+    BOOST_CHECK(deltas[2].reason == MemPoolRemovalReason::UNKNOWN);
+
+    // Nothing after the current sequence number
+    deltas.clear();
+    BOOST_CHECK(pool.GetDeltas(start + 4, deltas));
+    BOOST_CHECK(deltas.empty());
+
+    // Clearing the mempool loses the changes before it
+    pool.addUnchecked(entry.FromTx(tx1));
+    pool.clear();
+    BOOST_CHECK_EQUAL(pool.GetSequence(), start + 6);
+    BOOST_CHECK(!pool.GetDeltas(start + 4, deltas));
+    BOOST_CHECK(deltas.empty());
+    pool.addUnchecked(entry.FromTx(tx1));
+    BOOST_CHECK(!pool.GetDeltas(start + 4, deltas));
+    BOOST_REQUIRE_EQUAL(deltas.size(), 1U);
+    BOOST_CHECK_EQUAL(deltas[0].sequence, start + 7);
+    deltas.clear();
+    BOOST_CHECK(pool.GetDeltas(start + 6, deltas));
+    BOOST_CHECK_EQUAL(deltas.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolProjectedFeeRateTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // Nine of these fit in a block of default size
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < 25; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout.n = i;
+        mtx.vout.resize(1);
+        mtx.vout[0].scriptPubKey = CScript() << std::vector<unsigned char>(100000, 0x51);
+        mtx.vout[0].nValue = 10 * COIN;
+        txs.push_back(MakeTransactionRef(mtx));
+        pool.addUnchecked(entry.Fee((30 - i) * 100000LL).FromTx(txs.back()));
+    }
+    const int64_t vsize = GetVirtualTransactionSize(*txs[0]);
+    BOOST_CHECK(pool.GetProjectedFeeRate(1) == CFeeRate(22 * 100000LL, vsize));
+    BOOST_CHECK(pool.GetProjectedFeeRate(2) == CFeeRate(13 * 100000LL, vsize));
+    // The last block is not full
+    BOOST_CHECK(pool.GetProjectedFeeRate(3) == CFeeRate(0));
+    BOOST_CHECK(pool.GetProjectedFeeRate(0) == CFeeRate(0));
+
+    // A change to the mempool is picked up
+    pool.PrioritiseTransaction(txs[24]->GetHash(), 100 * COIN);
+    BOOST_CHECK(pool.GetProjectedFeeRate(1) == CFeeRate(23 * 100000LL, vsize));
+    pool.removeRecursive(*txs[0]);
+    BOOST_CHECK(pool.GetProjectedFeeRate(1) == CFeeRate(22 * 100000LL, vsize));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,108 @@
+// Copyright (c) 2019 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <clientversion.h>
+#include <mempooljournal.h>
+#include <streams.h>
+#include <txmempool.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mempooljournal_tests, TestingSetup)
+
+/** Read the journal id and offset recorded at the end of an empty mempool.dat. */
+static void ReadJournalPosition(uint64_t& id, uint64_t& offset)
+{
+    CAutoFile file(fsbridge::fopen(GetDataDir() / "mempool.dat", "rb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    uint64_t version, num;
+    std::map<uint256, CAmount> deltas;
+    file >> version >> num >> deltas >> id >> offset;
+    BOOST_CHECK_EQUAL(num, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(journal_records)
+{
+    const fs::path path = GetDataDir() / "mempool.journal";
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_11;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    CMutableTransaction tx2 = tx1;
+    tx2.vin[0].prevout.hash = tx1.GetHash();
+
+    CMempoolJournal journal(mempool, path);
+    BOOST_REQUIRE(journal.Start());
+    uint64_t id, offset;
+    ReadJournalPosition(id, offset);
+    BOOST_CHECK(id != 0);
+
+    {
+        LOCK2(cs_main, mempool.cs);
+        mempool.addUnchecked(entry.FromTx(tx1));
+        mempool.addUnchecked(entry.FromTx(tx2));
+    }
+    mempool.PrioritiseTransaction(tx2.GetHash(), 5000);
+    journal.Prioritise(tx2.GetHash());
+    {
+        LOCK2(cs_main, mempool.cs);
+        mempool.removeRecursive(CTransaction(tx2));
+    }
+    journal.Flush();
+
+    std::vector<MempoolJournalRecord> records;
+    BOOST_REQUIRE(ReadMempoolJournal(path, id, offset, records));
+    BOOST_REQUIRE_EQUAL(records.size(), 4U);
+    BOOST_CHECK(records[0].type == MempoolJournalRecord::ADD);
+    BOOST_CHECK(records[0].tx->GetHash() == tx1.GetHash());
+    BOOST_CHECK(records[1].type == MempoolJournalRecord::ADD);
+    BOOST_CHECK(records[1].txid == tx2.GetHash());
+    BOOST_CHECK(records[2].type == MempoolJournalRecord::PRIORITISE);
+    BOOST_CHECK_EQUAL(records[2].delta, 5000);
+    BOOST_CHECK(records[3].type == MempoolJournalRecord::REMOVE);
+    BOOST_CHECK(records[3].txid == tx2.GetHash());
+    BOOST_CHECK(!records[3].for_block);
+
+    // A journal of another id is not read.
+    std::vector<MempoolJournalRecord> other;
+    BOOST_CHECK(!ReadMempoolJournal(path, id + 1, offset, other));
+
+    // A record cut short, as by a crash, ends the journal.
+    {
+        FILE* file = fsbridge::fopen(path, "ab");
+        const unsigned char partial[] = {0x40, 0x00, 0x00, 0x00, 0x12, 0x34};
+        BOOST_REQUIRE_EQUAL(fwrite(partial, 1, sizeof(partial), file), sizeof(partial));
+        fclose(file);
+    }
+    records.clear();
+    BOOST_REQUIRE(ReadMempoolJournal(path, id, offset, records));
+    BOOST_CHECK_EQUAL(records.size(), 4U);
+
+    // Compacting dumps the mempool and starts an empty journal of a new id.
+    BOOST_REQUIRE(journal.Compact());
+    uint64_t new_id, new_offset;
+    CAutoFile file(fsbridge::fopen(GetDataDir() / "mempool.dat", "rb"), SER_DISK, CLIENT_VERSION);
+    uint64_t version, num;
+    file >> version >> num;
+    BOOST_CHECK_EQUAL(num, 1U);
+    CTransactionRef tx;
+    int64_t time, delta;
+    std::map<uint256, CAmount> deltas;
+    file >> tx >> time >> delta >> deltas >> new_id >> new_offset;
+    BOOST_CHECK(tx->GetHash() == tx1.GetHash());
+    BOOST_CHECK(new_id != id);
+    records.clear();
+    BOOST_REQUIRE(ReadMempoolJournal(path, new_id, new_offset, records));
+    BOOST_CHECK(records.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
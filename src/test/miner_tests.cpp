@@ -9,18 +9,24 @@
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
 #include <validation.h>
+#include <key.h>
 #include <miner.h>
 #include <policy/policy.h>
 #include <pubkey.h>
+#include <scheduler.h>
+#include <script/interpreter.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
 #include <util/system.h>
 #include <util/strencodings.h>
+#include <util/time.h>
+#include <validationinterface.h>
 
 #include <test/test_bitcoin.h>
 
 #include <memory>
+#include <set>
 
 #include <boost/test/unit_test.hpp>
 
@@ -521,4 +527,118 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+static bool ToMemPool(const CMutableTransaction& tx)
+{
+    LOCK(cs_main);
+    CValidationState state;
+    return AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), nullptr /* pfMissingInputs */,
+                              nullptr /* plTxnReplaced */, true /* bypass_limits */, 0 /* nAbsurdFee */);
+}
+
+// Spend the first output of prev, which pays to key, back to key.
+static CMutableTransaction SpendToKey(const CTransaction& prev, const CKey& key, CAmount fee)
+{
+    const CScript script = prev.vout[0].scriptPubKey;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(prev.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = prev.vout[0].nValue - fee;
+    tx.vout[0].scriptPubKey = script;
+    std::vector<unsigned char> sig;
+    BOOST_CHECK(key.Sign(SignatureHash(script, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE), sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << sig;
+    return tx;
+}
+
+// A cached template must be what BlockAssembler would build from the same chain and mempool.
+static void CheckMatchesNewBlock(const CBlockTemplate& cached)
+{
+    std::unique_ptr<CBlockTemplate> fresh = BlockAssembler(Params()).CreateNewBlock(CScript() << OP_TRUE);
+    BOOST_REQUIRE(fresh);
+    BOOST_CHECK(cached.block.hashPrevBlock == fresh->block.hashPrevBlock);
+    std::set<uint256> cached_txids, fresh_txids;
+    for (const CTransactionRef& tx : cached.block.vtx) cached_txids.insert(tx->GetHash());
+    for (const CTransactionRef& tx : fresh->block.vtx) fresh_txids.insert(tx->GetHash());
+    BOOST_CHECK_EQUAL(cached.block.vtx.size(), fresh->block.vtx.size());
+    cached_txids.erase(cached.block.vtx[0]->GetHash());
+    fresh_txids.erase(fresh->block.vtx[0]->GetHash());
+    BOOST_CHECK(cached_txids == fresh_txids);
+    BOOST_CHECK_EQUAL(cached.block.vtx[0]->vout[0].nValue, fresh->block.vtx[0]->vout[0].nValue);
+    BOOST_CHECK_EQUAL(cached.vTxFees[0], fresh->vTxFees[0]);
+    BOOST_CHECK(cached.vchCoinbaseCommitment == fresh->vchCoinbaseCommitment);
+}
+
+BOOST_FIXTURE_TEST_CASE(block_template_cache, TestChain100Setup)
+{
+    // Mempool changes reach the cache through the validation interface queue. Its refreshes go to
+    // a scheduler nobody services, so the test decides when they run. Freezing the clock keeps the
+    // periodic rebuild from running, so mempool changes are applied incrementally.
+    GetMainSignals().RegisterWithMempoolSignals(mempool);
+    CScheduler scheduler;
+    BlockTemplateCache cache(Params(), scheduler);
+    RegisterValidationInterface(&cache);
+    SetMockTime(GetTime());
+
+    // The first request only switches the cache on.
+    unsigned int transactions_updated = 0;
+    BOOST_CHECK(!cache.GetTemplate(chainActive.Tip(), transactions_updated));
+    cache.Refresh();
+    std::unique_ptr<CBlockTemplate> tmpl = cache.GetTemplate(chainActive.Tip(), transactions_updated);
+    BOOST_REQUIRE(tmpl);
+    BOOST_CHECK_EQUAL(tmpl->block.vtx.size(), 1U);
+
+    // Transactions are appended as they enter the mempool, parents first.
+    CMutableTransaction parent = SpendToKey(*m_coinbase_txns[0], coinbaseKey, 10000);
+    CMutableTransaction child = SpendToKey(CTransaction(parent), coinbaseKey, 10000);
+    BOOST_CHECK(ToMemPool(parent));
+    BOOST_CHECK(ToMemPool(child));
+    SyncWithValidationInterfaceQueue();
+    // Nothing is applied before the refresh.
+    tmpl = cache.GetTemplate(chainActive.Tip(), transactions_updated);
+    BOOST_REQUIRE(tmpl);
+    BOOST_CHECK_EQUAL(tmpl->block.vtx.size(), 1U);
+    cache.Refresh();
+    tmpl = cache.GetTemplate(chainActive.Tip(), transactions_updated);
+    BOOST_REQUIRE(tmpl);
+    BOOST_REQUIRE_EQUAL(tmpl->block.vtx.size(), 3U);
+    BOOST_CHECK(tmpl->block.vtx[1]->GetHash() == parent.GetHash());
+    BOOST_CHECK(tmpl->block.vtx[2]->GetHash() == child.GetHash());
+    BOOST_CHECK_EQUAL(transactions_updated, mempool.GetTransactionsUpdated());
+    CheckMatchesNewBlock(*tmpl);
+
+    // Removing the parent drops its spender too.
+    {
+        LOCK(mempool.cs);
+        mempool.removeRecursive(CTransaction(parent));
+    }
+    SyncWithValidationInterfaceQueue();
+    cache.Refresh();
+    tmpl = cache.GetTemplate(chainActive.Tip(), transactions_updated);
+    BOOST_REQUIRE(tmpl);
+    BOOST_CHECK_EQUAL(tmpl->block.vtx.size(), 1U);
+    CheckMatchesNewBlock(*tmpl);
+
+    // A new tip makes the cache rebuild from the mempool, which no longer holds the mined parent.
+    BOOST_CHECK(ToMemPool(parent));
+    const CScript script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlock block = CreateAndProcessBlock({parent}, script_pub_key);
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK(ToMemPool(child));
+    SyncWithValidationInterfaceQueue();
+    BOOST_CHECK(!cache.GetTemplate(chainActive.Tip(), transactions_updated));
+    cache.Refresh();
+    tmpl = cache.GetTemplate(chainActive.Tip(), transactions_updated);
+    BOOST_REQUIRE(tmpl);
+    BOOST_REQUIRE_EQUAL(tmpl->block.vtx.size(), 2U);
+    BOOST_CHECK(tmpl->block.vtx[1]->GetHash() == child.GetHash());
+    CheckMatchesNewBlock(*tmpl);
+
+    SyncWithValidationInterfaceQueue();
+    UnregisterValidationInterface(&cache);
+    GetMainSignals().UnregisterWithMempoolSignals(mempool);
+    SetMockTime(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -10,6 +10,7 @@
 #include <streams.h>
 #include <net.h>
 #include <netbase.h>
+#include <netmessagemaker.h>
 #include <chainparams.h>
 #include <util/system.h>
 
@@ -302,5 +303,64 @@ BOOST_AUTO_TEST_CASE(LocalAddress_BasicLifecycle)
     BOOST_CHECK_EQUAL(IsLocal(addr), false);
 }
 
+BOOST_AUTO_TEST_CASE(net_buffer_pool)
+{
+    CNetRecvBufferPool pool(2, 1, 0);
+
+    // An empty pool hands out fresh buffers.
+    CSerializeData buffer = pool.Get(100);
+    BOOST_CHECK_EQUAL(buffer.capacity(), 0U);
+    BOOST_CHECK_EQUAL(pool.GetStats(CNetRecvBufferPool::SMALL).allocated, 1U);
+
+    // Returned buffers are cleared, kept by capacity and handed out again.
+    buffer.resize(100);
+    const size_t capacity = buffer.capacity();
+    pool.Put(std::move(buffer));
+    BOOST_CHECK_EQUAL(pool.GetStats(CNetRecvBufferPool::SMALL).pooled, 1U);
+    CSerializeData reused = pool.Get(24);
+    BOOST_CHECK(reused.empty());
+    BOOST_CHECK_EQUAL(reused.capacity(), capacity);
+    BOOST_CHECK_EQUAL(pool.GetStats(CNetRecvBufferPool::SMALL).reused, 1U);
+    BOOST_CHECK_EQUAL(pool.GetStats(CNetRecvBufferPool::SMALL).pooled, 0U);
+
+    // Each size class keeps at most its configured number of buffers.
+    for (int i = 0; i < 3; ++i) {
+        CSerializeData tx_buffer(NET_BUFFER_SMALL_SIZE + 1);
+        pool.Put(std::move(tx_buffer));
+        CSerializeData block_buffer(NET_BUFFER_TX_SIZE + 1);
+        pool.Put(std::move(block_buffer));
+    }
+    BOOST_CHECK_EQUAL(pool.GetStats(CNetRecvBufferPool::TX).pooled, 1U);
+    BOOST_CHECK_EQUAL(pool.GetStats(CNetRecvBufferPool::BLOCK).pooled, 0U);
+    BOOST_CHECK(pool.Get(NET_BUFFER_SMALL_SIZE + 1).capacity() > NET_BUFFER_SMALL_SIZE);
+}
+
+BOOST_AUTO_TEST_CASE(net_message_recycles_buffer)
+{
+    CNetRecvBufferPool pool(1, 1, 1);
+    const CNetMsgMaker msg_maker(INIT_PROTO_VERSION);
+    CSerializedNetMsg ping = msg_maker.Make(NetMsgType::PING, (uint64_t)42);
+    CMessageHeader hdr(Params().MessageStart(), ping.command.c_str(), ping.data.size());
+    std::vector<unsigned char> raw;
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, raw, 0, hdr};
+    raw.insert(raw.end(), ping.data.begin(), ping.data.end());
+
+    for (int i = 0; i < 2; ++i) {
+        CNetMessage msg(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION, &pool);
+        const char* pch = (const char*)raw.data();
+        int handled = msg.readHeader(pch, raw.size());
+        msg.readData(pch + handled, raw.size() - handled);
+        BOOST_CHECK(msg.complete());
+        uint64_t nonce;
+        msg.vRecv >> nonce;
+        BOOST_CHECK_EQUAL(nonce, 42U);
+    }
+
+    // The first message's buffer went back to the pool and was used by the second one.
+    BOOST_CHECK_EQUAL(pool.GetStats(CNetRecvBufferPool::SMALL).allocated, 1U);
+    BOOST_CHECK_EQUAL(pool.GetStats(CNetRecvBufferPool::SMALL).reused, 1U);
+    BOOST_CHECK_EQUAL(pool.GetStats(CNetRecvBufferPool::SMALL).pooled, 1U);
+}
+
 
 BOOST_AUTO_TEST_SUITE_END()
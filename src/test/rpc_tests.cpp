@@ -6,11 +6,16 @@
 #include <rpc/client.h>
 #include <rpc/util.h>
 
+#include <consensus/validation.h>
 #include <core_io.h>
 #include <init.h>
 #include <interfaces/chain.h>
 #include <key_io.h>
 #include <netbase.h>
+#include <node/transaction.h>
+#include <script/interpreter.h>
+#include <txmempool.h>
+#include <validation.h>
 
 #include <test/test_bitcoin.h>
 
@@ -420,4 +425,98 @@ BOOST_AUTO_TEST_CASE(rpc_getblockstats_calculate_percentiles_by_weight)
     }
 }
 
+BOOST_AUTO_TEST_CASE(rpc_getmempoolacceptlatency)
+{
+    const UniValue before = CallRPC("getmempoolacceptlatency");
+
+    // A transaction without inputs is rejected.
+    CMutableTransaction tx;
+    tx.vout.emplace_back(1 * COIN, CScript() << OP_TRUE);
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(!AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), nullptr /* pfMissingInputs */,
+                                        nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */));
+    }
+
+    const UniValue after = CallRPC("getmempoolacceptlatency");
+    BOOST_CHECK_EQUAL(find_value(after, "rejected")["count"].get_int64(), find_value(before, "rejected")["count"].get_int64() + 1);
+    BOOST_CHECK_EQUAL(find_value(after, "accepted")["count"].get_int64(), find_value(before, "accepted")["count"].get_int64());
+    for (const char* name : {"accepted", "rejected", "scriptchecks"}) {
+        const UniValue& histogram = find_value(after, name);
+        BOOST_CHECK(histogram["totaltime"].get_int64() >= 0);
+        // Only the buckets that counted something are listed, each bounded by twice the previous.
+        int64_t count = 0;
+        int64_t below = 0;
+        const UniValue& buckets = histogram["histogram"].get_array();
+        for (size_t i = 0; i < buckets.size(); ++i) {
+            BOOST_CHECK(buckets[i]["count"].get_int64() > 0);
+            count += buckets[i]["count"].get_int64();
+            if (i + 1 < buckets.size()) {
+                BOOST_CHECK(buckets[i]["below"].get_int64() > below);
+                below = buckets[i]["below"].get_int64();
+            }
+        }
+        BOOST_CHECK_EQUAL(count, histogram["count"].get_int64());
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(rpc_sendrawtransactions, TestChain100Setup)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    auto spend = [&](const CTransactionRef& prev, const uint256& prev_hash) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(prev_hash, 0));
+        tx.vout.emplace_back((prev ? prev->vout[0].nValue : 1 * COIN) - 10000, scriptPubKey);
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(coinbaseKey.Sign(SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE), vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        return MakeTransactionRef(tx);
+    };
+    const CTransactionRef parent = spend(m_coinbase_txns[0], m_coinbase_txns[0]->GetHash());
+    const CTransactionRef child = spend(parent, parent->GetHash());
+    // Spends an output that does not exist.
+    const CTransactionRef missing = spend(nullptr, InsecureRand256());
+
+    // The child is listed before its parent, and the failure of the other transaction is
+    // reported on its own.
+    const UniValue result = CallRPC("sendrawtransactions [\"" + EncodeHexTx(*child) + "\",\"" +
+                                    EncodeHexTx(*missing) + "\",\"" + EncodeHexTx(*parent) + "\"]");
+    BOOST_REQUIRE_EQUAL(result.size(), 3U);
+    BOOST_CHECK_EQUAL(find_value(result[0], "txid").get_str(), child->GetHash().GetHex());
+    BOOST_CHECK(find_value(result[0], "error").isNull());
+    BOOST_CHECK_EQUAL(find_value(result[1], "txid").get_str(), missing->GetHash().GetHex());
+    BOOST_CHECK_EQUAL(find_value(result[1], "error")["code"].get_int(), RPCErrorFromTransactionError(TransactionError::MISSING_INPUTS));
+    BOOST_CHECK_EQUAL(find_value(result[1], "error")["message"].get_str(), "Missing inputs");
+    BOOST_CHECK_EQUAL(find_value(result[2], "txid").get_str(), parent->GetHash().GetHex());
+    BOOST_CHECK(find_value(result[2], "error").isNull());
+
+    LOCK(cs_main);
+    BOOST_CHECK(mempool.exists(parent->GetHash()));
+    BOOST_CHECK(mempool.exists(child->GetHash()));
+    BOOST_CHECK(!mempool.exists(missing->GetHash()));
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(rpc_sendrawtransactions_limit)
+{
+    // A batch over the limit is refused before any of it is decoded
+    std::string rawtxs;
+    for (int i = 0; i < 101; ++i) {
+        rawtxs += std::string(i ? "," : "") + "\"00\"";
+    }
+    auto error_message = [](const std::string& args) -> std::string {
+        try {
+            CallRPC(args);
+        } catch (const std::runtime_error& e) {
+            return e.what();
+        }
+        return "";
+    };
+    BOOST_CHECK_EQUAL(error_message("sendrawtransactions [" + rawtxs + "]").find("Too many transactions"), 0U);
+    // One less is decoded
+    BOOST_CHECK_EQUAL(error_message("sendrawtransactions [" + rawtxs.substr(5) + "]").find("TX decode failed"), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -208,4 +208,39 @@ BOOST_AUTO_TEST_CASE(sighash_from_data)
         BOOST_CHECK_MESSAGE(sh.GetHex() == sigHashHex, strTest);
     }
 }
+
+// Goal: check that the precomputed legacy signature hashing matches hashing from scratch
+BOOST_AUTO_TEST_CASE(sighash_legacy_cache)
+{
+    for (int i = 0; i < 200; i++) {
+        CMutableTransaction txTo;
+        RandomTransaction(txTo, false);
+        // Enough inputs, and sometimes more than fit a single byte compact size
+        const size_t ins = LEGACY_SIGHASH_CACHE_MIN_INPUTS + InsecureRandRange(i % 10 == 0 ? 300 : 30);
+        while (txTo.vin.size() < ins) {
+            txTo.vin.push_back(txTo.vin[InsecureRandRange(txTo.vin.size())]);
+            txTo.vin.back().prevout.n = InsecureRand32();
+        }
+        const CTransaction tx(txTo);
+        const PrecomputedTransactionData txdata(tx);
+        BOOST_CHECK(txdata.m_legacy_ready);
+
+        for (int j = 0; j < 10; j++) {
+            int nHashType = InsecureRand32();
+            if (InsecureRandBool()) nHashType = SIGHASH_ALL;
+            if ((nHashType & 0x1f) == SIGHASH_SINGLE) nHashType ^= SIGHASH_SINGLE;
+            CScript scriptCode;
+            RandomScript(scriptCode);
+            const unsigned int nIn = j == 0 ? tx.vin.size() - 1 : InsecureRandRange(tx.vin.size());
+
+            BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, 0, SigVersion::BASE, &txdata) == SignatureHashOld(scriptCode, tx, nIn, nHashType));
+            BOOST_CHECK(SignatureHash(scriptCode, tx, nIn, nHashType, 0, SigVersion::BASE, &txdata) == SignatureHash(scriptCode, tx, nIn, nHashType, 0, SigVersion::BASE));
+        }
+    }
+
+    // Transactions with few inputs are not worth precomputing for
+    CMutableTransaction txTo;
+    RandomTransaction(txTo, false);
+    BOOST_CHECK(!PrecomputedTransactionData(txTo).m_legacy_ready);
+}
 BOOST_AUTO_TEST_SUITE_END()
@@ -18,6 +18,7 @@
 #include <script/script.h>
 #include <script/sign.h>
 #include <script/script_error.h>
+#include <script/sigcache.h>
 #include <script/standard.h>
 #include <util/strencodings.h>
 
@@ -494,6 +495,169 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction)
     threadGroup.join_all();
 }
 
+BOOST_AUTO_TEST_CASE(test_script_check_batch)
+{
+    CKey key1, key2;
+    key1.MakeNewKey(true);
+    key2.MakeNewKey(true);
+    CBasicKeyStore keystore1, keystore2;
+    BOOST_CHECK(keystore1.AddKeyPubKey(key1, key1.GetPubKey()));
+    BOOST_CHECK(keystore2.AddKeyPubKey(key2, key2.GetPubKey()));
+
+    const CScript p2pkh = GetScriptForDestination(key1.GetPubKey().GetID());
+    const std::vector<CTxOut> outs = {
+        CTxOut(1000, p2pkh),
+        CTxOut(1000, GetScriptForMultisig(1, {key1.GetPubKey(), key2.GetPubKey()})),
+        CTxOut(1000, CScript() << ToByteVector(key1.GetPubKey()) << OP_CHECKSIG << OP_NOT),
+        CTxOut(1000, p2pkh),
+    };
+    CMutableTransaction mtx;
+    for (uint32_t i = 0; i < outs.size(); i++) {
+        mtx.vin.emplace_back(COutPoint(InsecureRand256(), i));
+    }
+    mtx.vout.emplace_back(1000, CScript() << OP_1);
+    BOOST_CHECK(SignSignature(keystore1, outs[0].scriptPubKey, mtx, 0, 1000, SIGHASH_ALL));
+    // The second key signs the multisig, so the signature does not go with the first key
+    BOOST_CHECK(SignSignature(keystore2, outs[1].scriptPubKey, mtx, 1, 1000, SIGHASH_ALL));
+    // A signature for another input, which the third input needs to fail and the fourth to pass
+    std::vector<unsigned char> sig;
+    CScript::const_iterator pc = mtx.vin[0].scriptSig.begin();
+    opcodetype opcode;
+    BOOST_CHECK(mtx.vin[0].scriptSig.GetOp(pc, opcode, sig));
+    mtx.vin[2].scriptSig = CScript() << sig;
+    mtx.vin[3].scriptSig = mtx.vin[0].scriptSig;
+    const CTransaction tx(mtx);
+    PrecomputedTransactionData txdata(tx);
+
+    auto make_checks = [&](size_t count) {
+        std::vector<CScriptCheck> checks;
+        for (size_t i = 0; i < count; i++) {
+            checks.emplace_back(outs[i], tx, i, SCRIPT_VERIFY_P2SH, false, &txdata);
+        }
+        return checks;
+    };
+
+    // Taking signatures to be valid, the third fails, but all three pass when run for real,
+    // and so in a batch. The second is multisig, which is not batched.
+    std::vector<CScriptCheck> checks = make_checks(3);
+    for (CScriptCheck& check : checks) {
+        BOOST_CHECK(check());
+    }
+    checks = make_checks(3);
+    BOOST_CHECK(RunChecks(checks));
+
+    // The fourth fails, on its own and in a batch.
+    checks = make_checks(4);
+    BOOST_CHECK(!checks[3]());
+    BOOST_CHECK(!RunChecks(checks));
+    checks = make_checks(4);
+    checks.erase(checks.begin(), checks.begin() + 3);
+    BOOST_CHECK(!RunChecks(checks));
+}
+
+BOOST_AUTO_TEST_CASE(test_script_check_batch_multisig)
+{
+    CKey keys[3];
+    std::vector<CPubKey> pubkeys;
+    for (CKey& key : keys) {
+        key.MakeNewKey(true);
+        pubkeys.push_back(key.GetPubKey());
+    }
+    // Only the first and last keys sign, so the signatures are not paired with keys in order.
+    CBasicKeyStore keystore;
+    BOOST_CHECK(keystore.AddKeyPubKey(keys[0], pubkeys[0]));
+    BOOST_CHECK(keystore.AddKeyPubKey(keys[2], pubkeys[2]));
+    const CScript multisig = GetScriptForMultisig(2, pubkeys);
+    BOOST_CHECK(keystore.AddCScript(multisig));
+
+    const std::vector<CTxOut> outs = {
+        CTxOut(1000, GetScriptForDestination(pubkeys[0].GetID())),
+        CTxOut(1000, multisig),
+        CTxOut(1000, GetScriptForDestination(CScriptID(multisig))),
+        CTxOut(1000, GetScriptForDestination(WitnessV0ScriptHash(multisig))),
+    };
+    CMutableTransaction mtx;
+    for (uint32_t i = 0; i < outs.size(); i++) {
+        mtx.vin.emplace_back(COutPoint(InsecureRand256(), i));
+    }
+    mtx.vout.emplace_back(1000, CScript() << OP_1);
+    for (uint32_t i = 0; i < outs.size(); i++) {
+        BOOST_CHECK(SignSignature(keystore, outs[i].scriptPubKey, mtx, i, 1000, SIGHASH_ALL));
+    }
+    const CTransaction tx(mtx);
+    PrecomputedTransactionData txdata(tx);
+
+    std::vector<CScriptCheck> checks;
+    for (size_t i = 0; i < outs.size(); i++) {
+        checks.emplace_back(outs[i], tx, i, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS, false, &txdata);
+    }
+    // Bare, P2SH and P2WSH multisig are all run on their own.
+    BOOST_CHECK(checks[0].CanBatch());
+    for (size_t i = 1; i < checks.size(); i++) {
+        BOOST_CHECK(!checks[i].CanBatch());
+        BOOST_CHECK(checks[i]());
+    }
+    BOOST_CHECK(RunChecks(checks));
+
+    // A multisig spend that fails still fails the batch.
+    mtx.vin[2].scriptSig = CScript() << OP_0 << ToByteVector(multisig);
+    const CTransaction bad_tx(mtx);
+    PrecomputedTransactionData bad_txdata(bad_tx);
+    checks.clear();
+    for (size_t i = 0; i < outs.size(); i++) {
+        checks.emplace_back(outs[i], bad_tx, i, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS, false, &bad_txdata);
+    }
+    BOOST_CHECK(!checks[2].CanBatch());
+    BOOST_CHECK(!RunChecks(checks));
+}
+
+BOOST_AUTO_TEST_CASE(test_signature_cache_stats)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const uint256 hash = InsecureRand256();
+    std::vector<unsigned char> sig;
+    BOOST_CHECK(key.Sign(hash, sig));
+    const CTransaction tx(CMutableTransaction{});
+    PrecomputedTransactionData txdata(tx);
+    const CachingTransactionSignatureChecker mempool_checker(&tx, 0, 0, true, txdata);
+    const CachingTransactionSignatureChecker block_checker(&tx, 0, 0, false, txdata);
+
+    const size_t capacity = ResizeSignatureCache(1 << 20);
+    SignatureCacheStats stats = GetSignatureCacheStats();
+    BOOST_CHECK_EQUAL(stats.shards, SIGNATURE_CACHE_SHARDS);
+    BOOST_CHECK_EQUAL(stats.capacity, capacity);
+    BOOST_CHECK_EQUAL(stats.entries, 0U);
+    BOOST_CHECK_EQUAL(stats.hits + stats.misses + stats.insertions, 0U);
+
+    // Validating in the memory pool misses and adds the signature
+    BOOST_CHECK(mempool_checker.VerifySignature(sig, key.GetPubKey(), hash));
+    stats = GetSignatureCacheStats();
+    BOOST_CHECK_EQUAL(stats.misses, 1U);
+    BOOST_CHECK_EQUAL(stats.insertions, 1U);
+    BOOST_CHECK_EQUAL(stats.entries, 1U);
+
+    // Connecting a block finds and erases it
+    BOOST_CHECK(block_checker.VerifySignature(sig, key.GetPubKey(), hash));
+    stats = GetSignatureCacheStats();
+    BOOST_CHECK_EQUAL(stats.hits, 1U);
+    BOOST_CHECK_EQUAL(stats.block_hits, 1U);
+    BOOST_CHECK_EQUAL(stats.block_misses, 0U);
+    BOOST_CHECK_EQUAL(stats.entries, 0U);
+
+    // Resizing drops the entries and the counts
+    BOOST_CHECK(mempool_checker.VerifySignature(sig, key.GetPubKey(), hash));
+    ResizeSignatureCache(2 << 20);
+    stats = GetSignatureCacheStats();
+    BOOST_CHECK(stats.capacity > capacity);
+    BOOST_CHECK_EQUAL(stats.entries, 0U);
+    BOOST_CHECK_EQUAL(stats.hits + stats.misses + stats.insertions, 0U);
+    BOOST_CHECK(block_checker.VerifySignature(sig, key.GetPubKey(), hash));
+    BOOST_CHECK_EQUAL(GetSignatureCacheStats().block_misses, 1U);
+
+    InitSignatureCache();
+}
+
 SignatureData CombineSignatures(const CMutableTransaction& input1, const CMutableTransaction& input2, const CTransactionRef tx)
 {
     SignatureData sigdata;
@@ -6,15 +6,53 @@
 #include <txmempool.h>
 #include <amount.h>
 #include <consensus/validation.h>
+#include <key.h>
+#include <node/transaction.h>
 #include <primitives/transaction.h>
+#include <script/interpreter.h>
 #include <script/script.h>
 #include <test/test_bitcoin.h>
+#include <util/system.h>
+
+#include <limits>
 
 #include <boost/test/unit_test.hpp>
 
 
 BOOST_AUTO_TEST_SUITE(txvalidation_tests)
 
+/**
+ * A transaction spending the given outputs, which pay to key, into n_outputs equal outputs paying
+ * to key as well.
+ */
+static CTransactionRef Spend(const CKey& key, const std::vector<std::pair<CTransactionRef, uint32_t>>& prevouts, size_t n_outputs)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    CAmount value = 0;
+    for (const auto& prevout : prevouts) {
+        tx.vin.emplace_back(COutPoint(prevout.first->GetHash(), prevout.second));
+        value += prevout.first->vout[prevout.second].nValue;
+    }
+    for (size_t i = 0; i < n_outputs; ++i) {
+        tx.vout.emplace_back((value - 10000) / n_outputs, scriptPubKey);
+    }
+    for (size_t i = 0; i < tx.vin.size(); ++i) {
+        std::vector<unsigned char> vchSig;
+        const uint256 hash = SignatureHash(scriptPubKey, tx, i, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(key.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[i].scriptSig << vchSig;
+    }
+    return MakeTransactionRef(tx);
+}
+
+static bool ToMemPool(const CTransactionRef& tx, CValidationState& state) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    return AcceptToMemoryPool(mempool, state, tx, nullptr /* pfMissingInputs */,
+                              nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
+}
+
 /**
  * Ensure that the mempool won't accept coinbase transactions.
  */
@@ -58,4 +96,174 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK_EQUAL(nDoS, 100);
 }
 
+/**
+ * With cluster tracking, transactions that would make a cluster larger than -limitclustercount
+ * are rejected.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_cluster_limit, TestChain100Setup)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    // Let the second coinbase mature too.
+    CreateAndProcessBlock({}, scriptPubKey);
+
+    LOCK(cs_main);
+    mempool.SetClusterTracking(true);
+    gArgs.ForceSetArg("-limitclustercount", "3");
+
+    CValidationState state;
+    const CTransactionRef parent = Spend(coinbaseKey, {{m_coinbase_txns[0], 0}}, 3);
+    const CTransactionRef child1 = Spend(coinbaseKey, {{parent, 0}}, 1);
+    const CTransactionRef child2 = Spend(coinbaseKey, {{parent, 1}}, 1);
+    BOOST_CHECK(ToMemPool(parent, state));
+    BOOST_CHECK(ToMemPool(child1, state));
+    BOOST_CHECK(ToMemPool(child2, state));
+
+    // A fourth transaction in the cluster is one too many.
+    const CTransactionRef child3 = Spend(coinbaseKey, {{parent, 2}}, 1);
+    BOOST_CHECK(!ToMemPool(child3, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "too-large-cluster");
+
+    // So is joining another cluster to it.
+    const CTransactionRef unrelated = Spend(coinbaseKey, {{m_coinbase_txns[1], 0}}, 1);
+    state = CValidationState();
+    BOOST_CHECK(ToMemPool(unrelated, state));
+    const CTransactionRef joining = Spend(coinbaseKey, {{unrelated, 0}, {child1, 0}}, 1);
+    BOOST_CHECK(!ToMemPool(joining, state));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "too-large-cluster");
+
+    // Without cluster tracking there is no such limit.
+    mempool.SetClusterTracking(false);
+    state = CValidationState();
+    BOOST_CHECK(ToMemPool(child3, state));
+
+    gArgs.ForceSetArg("-limitclustercount", std::to_string(DEFAULT_CLUSTER_LIMIT));
+    mempool.clear();
+}
+
+static void CheckHistogram(const MempoolAcceptLatencyStats::Histogram& before, const MempoolAcceptLatencyStats::Histogram& after, uint64_t added)
+{
+    BOOST_CHECK_EQUAL(after.count, before.count + added);
+    BOOST_CHECK(after.total_micros >= before.total_micros);
+    uint64_t bucketed = 0;
+    for (int i = 0; i < MEMPOOL_ACCEPT_LATENCY_BUCKETS; ++i) {
+        BOOST_CHECK(after.buckets[i] >= before.buckets[i]);
+        bucketed += after.buckets[i] - before.buckets[i];
+    }
+    BOOST_CHECK_EQUAL(bucketed, added);
+}
+
+/**
+ * The scripts of transactions with enough inputs are checked on the script-checking threads. An
+ * invalid signature is caught there too, and the time taken is recorded either way.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_parallel_script_checks, TestChain100Setup)
+{
+    BOOST_REQUIRE(nScriptCheckThreads > 0);
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const size_t n_inputs = MEMPOOL_PARALLEL_SCRIPT_CHECK_MIN_INPUTS;
+
+    // Confirm outputs to spend together.
+    const CTransactionRef split = Spend(coinbaseKey, {{m_coinbase_txns[0], 0}}, n_inputs);
+    CreateAndProcessBlock({CMutableTransaction(*split)}, scriptPubKey);
+    std::vector<std::pair<CTransactionRef, uint32_t>> prevouts;
+    for (size_t i = 0; i < n_inputs; ++i) {
+        prevouts.emplace_back(split, i);
+    }
+
+    // The last input signed by another key.
+    CMutableTransaction bad(*Spend(coinbaseKey, prevouts, 1));
+    CKey other_key;
+    other_key.MakeNewKey(true);
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(other_key.Sign(SignatureHash(scriptPubKey, bad, n_inputs - 1, SIGHASH_ALL, 0, SigVersion::BASE), vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    bad.vin[n_inputs - 1].scriptSig = CScript() << vchSig;
+
+    LOCK(cs_main);
+    BOOST_REQUIRE(pcoinsTip->HaveCoin(COutPoint(split->GetHash(), 0)));
+    const MempoolAcceptLatencyStats before = GetMempoolAcceptLatencyStats();
+
+    CValidationState state;
+    BOOST_CHECK(!ToMemPool(MakeTransactionRef(bad), state));
+    BOOST_CHECK(state.IsInvalid());
+    BOOST_CHECK_EQUAL(state.GetRejectReason().find("mandatory-script-verify-flag-failed"), 0U);
+    BOOST_CHECK(!mempool.exists(bad.GetHash()));
+
+    const CTransactionRef good = Spend(coinbaseKey, prevouts, 1);
+    state = CValidationState();
+    BOOST_CHECK(ToMemPool(good, state));
+    BOOST_CHECK(mempool.exists(good->GetHash()));
+
+    // Each call is counted once, in one bucket, and both got as far as the script checks.
+    const MempoolAcceptLatencyStats after = GetMempoolAcceptLatencyStats();
+    CheckHistogram(before.rejected, after.rejected, 1);
+    CheckHistogram(before.accepted, after.accepted, 1);
+    CheckHistogram(before.script_checks, after.script_checks, 2);
+
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(mempool_accept_latency_buckets)
+{
+    // Bucket i counts durations below 2^i microseconds, the last one everything longer.
+    BOOST_CHECK_EQUAL(GetMempoolAcceptLatencyBucket(0), 0);
+    BOOST_CHECK_EQUAL(GetMempoolAcceptLatencyBucket(1), 1);
+    BOOST_CHECK_EQUAL(GetMempoolAcceptLatencyBucket(2), 2);
+    BOOST_CHECK_EQUAL(GetMempoolAcceptLatencyBucket(3), 2);
+    BOOST_CHECK_EQUAL(GetMempoolAcceptLatencyBucket(4), 3);
+    BOOST_CHECK_EQUAL(GetMempoolAcceptLatencyBucket(1000), 10);
+    BOOST_CHECK_EQUAL(GetMempoolAcceptLatencyBucket((int64_t{1} << (MEMPOOL_ACCEPT_LATENCY_BUCKETS - 2)) - 1), MEMPOOL_ACCEPT_LATENCY_BUCKETS - 2);
+    BOOST_CHECK_EQUAL(GetMempoolAcceptLatencyBucket(int64_t{1} << (MEMPOOL_ACCEPT_LATENCY_BUCKETS - 2)), MEMPOOL_ACCEPT_LATENCY_BUCKETS - 1);
+    BOOST_CHECK_EQUAL(GetMempoolAcceptLatencyBucket(std::numeric_limits<int64_t>::max()), MEMPOOL_ACCEPT_LATENCY_BUCKETS - 1);
+}
+
+/**
+ * A batch is added to the mempool parents first, whatever its order. A transaction that is
+ * rejected, and those spending from it, fail on their own without affecting the others.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_broadcast_batch, TestChain100Setup)
+{
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    // Let the second coinbase mature too.
+    CreateAndProcessBlock({}, scriptPubKey);
+
+    const CTransactionRef parent = Spend(coinbaseKey, {{m_coinbase_txns[0], 0}}, 2);
+    const CTransactionRef child = Spend(coinbaseKey, {{parent, 0}}, 1);
+    const CTransactionRef grandchild = Spend(coinbaseKey, {{child, 0}, {parent, 1}}, 1);
+    // Signed for another key than the one the coinbase pays to.
+    CKey other_key;
+    other_key.MakeNewKey(true);
+    const CTransactionRef bad = Spend(other_key, {{m_coinbase_txns[1], 0}}, 1);
+    const CTransactionRef bad_child = Spend(other_key, {{bad, 0}}, 1);
+
+    const std::vector<CTransactionRef> txs{grandchild, bad_child, child, bad, parent};
+    std::vector<std::string> err_strings;
+    const std::vector<TransactionError> errors = BroadcastTransactions(txs, err_strings, 0 /* highfee */);
+    BOOST_REQUIRE_EQUAL(errors.size(), txs.size());
+    BOOST_REQUIRE_EQUAL(err_strings.size(), txs.size());
+
+    BOOST_CHECK(errors[0] == TransactionError::OK);
+    BOOST_CHECK(errors[1] == TransactionError::MISSING_INPUTS);
+    BOOST_CHECK(errors[2] == TransactionError::OK);
+    BOOST_CHECK(errors[3] == TransactionError::MEMPOOL_REJECTED);
+    BOOST_CHECK_EQUAL(err_strings[3].find("mandatory-script-verify-flag-failed"), 0U);
+    BOOST_CHECK(errors[4] == TransactionError::OK);
+    for (size_t i : {0, 1, 2, 4}) {
+        BOOST_CHECK(err_strings[i].empty());
+    }
+
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+    BOOST_CHECK(mempool.exists(parent->GetHash()));
+    BOOST_CHECK(mempool.exists(child->GetHash()));
+    BOOST_CHECK(mempool.exists(grandchild->GetHash()));
+
+    // Sending the batch again changes nothing.
+    const std::vector<TransactionError> again = BroadcastTransactions(txs, err_strings, 0 /* highfee */);
+    BOOST_CHECK(again == errors);
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+
+    LOCK(cs_main);
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -367,4 +367,59 @@ BOOST_FIXTURE_TEST_CASE(checkinputs_test, TestChain100Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(script_execution_cache_persistence, TestChain100Setup)
+{
+    CMutableTransaction spend_tx;
+    spend_tx.nVersion = 1;
+    spend_tx.vin.resize(1);
+    spend_tx.vin[0].prevout.hash = m_coinbase_txns[0]->GetHash();
+    spend_tx.vin[0].prevout.n = 0;
+    spend_tx.vout.resize(1);
+    spend_tx.vout[0].nValue = 11*CENT;
+    spend_tx.vout[0].scriptPubKey = GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+
+    CBasicKeyStore keystore;
+    BOOST_CHECK(keystore.AddKey(coinbaseKey));
+    BOOST_CHECK(SignSignature(keystore, *m_coinbase_txns[0], spend_tx, 0, SIGHASH_ALL));
+    const CTransaction tx(spend_tx);
+
+    LOCK(cs_main);
+    InitScriptExecutionCache();
+    CValidationState state;
+    PrecomputedTransactionData txdata(tx);
+    BOOST_CHECK(CheckInputs(tx, state, pcoinsTip.get(), true, SCRIPT_VERIFY_P2SH, true, true, txdata, nullptr));
+
+    BOOST_CHECK(DumpScriptExecutionCache());
+
+    // Start over as after a restart: the cache is set up again under a new nonce, and the
+    // transaction is no longer cached.
+    InitScriptExecutionCache();
+    std::vector<CScriptCheck> scriptchecks;
+    BOOST_CHECK(CheckInputs(tx, state, pcoinsTip.get(), true, SCRIPT_VERIFY_P2SH, true, true, txdata, &scriptchecks));
+    BOOST_CHECK_EQUAL(scriptchecks.size(), 1U);
+
+    // The dump loads back at the same tip, and its entries are hits under the nonce it restores.
+    BOOST_CHECK(LoadScriptExecutionCache());
+    scriptchecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, pcoinsTip.get(), true, SCRIPT_VERIFY_P2SH, true, true, txdata, &scriptchecks));
+    BOOST_CHECK(scriptchecks.empty());
+
+    // A dump made for other script flags is not loaded.
+    const fs::path path = GetDataDir() / "scriptcache.dat";
+    uint64_t version;
+    uint256 nonce;
+    unsigned int flags;
+    std::vector<uint256> entries;
+    {
+        CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+        file >> version >> nonce >> flags >> entries;
+    }
+    BOOST_CHECK_EQUAL(entries.size(), 1U);
+    {
+        CAutoFile file(fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION);
+        file << version << nonce << (flags ^ SCRIPT_VERIFY_NULLDUMMY) << entries;
+    }
+    BOOST_CHECK(!LoadScriptExecutionCache());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,10 +7,13 @@
 #include <chainparams.h>
 #include <consensus/merkle.h>
 #include <consensus/validation.h>
+#include <key.h>
 #include <miner.h>
 #include <pow.h>
 #include <random.h>
+#include <script/standard.h>
 #include <test/test_bitcoin.h>
+#include <txdb.h>
 #include <validation.h>
 #include <validationinterface.h>
 
@@ -184,4 +187,175 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering)
     BOOST_CHECK_EQUAL(sub.m_expected_tip, chainActive.Tip()->GetBlockHash());
 }
 
+
+BOOST_FIXTURE_TEST_CASE(replay_validated_blocks, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // A transaction spending prevout to scriptPubKey, signed with SIGHASH_ALL.
+    const auto spend_output = [&](const COutPoint& prevout, const CScript& prevScript, CAmount nValue) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.emplace_back(prevout);
+        tx.vout.emplace_back(nValue, scriptPubKey);
+        std::vector<unsigned char> vchSig;
+        const uint256 hash = SignatureHash(prevScript, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        return tx;
+    };
+    const COutPoint spent(m_coinbase_txns[0]->GetHash(), 0);
+    const CMutableTransaction spend = spend_output(spent, m_coinbase_txns[0]->vout[0].scriptPubKey, 11 * CENT);
+    CreateAndProcessBlock({spend}, scriptPubKey);
+
+    const CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+        BOOST_CHECK_EQUAL(pindexTip->nHeight, COINBASE_MATURITY + 1);
+        FlushStateToDisk();
+
+        // Start over with an empty UTXO set, as -reindex-chainstate does.
+        pcoinsTip.reset();
+        pcoinsdbview.reset(new CCoinsViewDB(1 << 23, true, true));
+        pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
+        chainActive.SetTip(nullptr);
+    }
+
+    BOOST_CHECK(ReplayValidatedBlocks(Params(), pindexTip));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Tip() == pindexTip);
+        BOOST_CHECK(pcoinsTip->GetBestBlock() == pindexTip->GetBlockHash());
+        BOOST_CHECK(!pcoinsTip->HaveCoin(spent));
+        BOOST_CHECK(pcoinsTip->HaveCoin(COutPoint(spend.GetHash(), 0)));
+        for (size_t i = 1; i < m_coinbase_txns.size(); i++) {
+            BOOST_CHECK(pcoinsTip->HaveCoin(COutPoint(m_coinbase_txns[i]->GetHash(), 0)));
+        }
+    }
+
+    // Blocks are connected normally on top of the replayed ones.
+    const CMutableTransaction spend2 = spend_output(COutPoint(spend.GetHash(), 0), scriptPubKey, 10 * CENT);
+    const CBlock block = CreateAndProcessBlock({spend2}, scriptPubKey);
+    LOCK(cs_main);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK(!pcoinsTip->HaveCoin(COutPoint(spend.GetHash(), 0)));
+}
+
+BOOST_FIXTURE_TEST_CASE(replay_validated_blocks_corrupt, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    const auto spend_coinbase = [&](size_t i) {
+        CMutableTransaction tx;
+        tx.nVersion = 1;
+        tx.vin.emplace_back(COutPoint(m_coinbase_txns[i]->GetHash(), 0));
+        tx.vout.emplace_back(11 * CENT, scriptPubKey);
+        std::vector<unsigned char> vchSig;
+        const uint256 hash = SignatureHash(m_coinbase_txns[i]->vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        return tx;
+    };
+    const CMutableTransaction spend1 = spend_coinbase(0);
+    CreateAndProcessBlock({spend1}, scriptPubKey);
+    const CMutableTransaction spend2 = spend_coinbase(1);
+    CBlock block2 = CreateAndProcessBlock({spend2}, scriptPubKey);
+
+    const CBlockIndex* pindexTip;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+        BOOST_CHECK(pindexTip->GetBlockHash() == block2.GetHash());
+        FlushStateToDisk();
+
+        // Change a transaction of the last block on disk, keeping its header and size.
+        CMutableTransaction corrupt(*block2.vtx[1]);
+        corrupt.vout[0].nValue += 1;
+        block2.vtx[1] = MakeTransactionRef(std::move(corrupt));
+        CAutoFile fileout(OpenBlockFile(pindexTip->GetBlockPos()), SER_DISK, CLIENT_VERSION);
+        BOOST_REQUIRE(!fileout.IsNull());
+        fileout << block2;
+        fileout.fclose();
+
+        pcoinsTip.reset();
+        pcoinsdbview.reset(new CCoinsViewDB(1 << 23, true, true));
+        pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
+        chainActive.SetTip(nullptr);
+    }
+
+    // The replay stops before the block whose transactions don't match its merkle root.
+    BOOST_CHECK(ReplayValidatedBlocks(Params(), pindexTip));
+    LOCK(cs_main);
+    BOOST_CHECK(chainActive.Tip() == pindexTip->pprev);
+    BOOST_CHECK(pcoinsTip->GetBestBlock() == pindexTip->pprev->GetBlockHash());
+    BOOST_CHECK(pcoinsTip->HaveCoin(COutPoint(spend1.GetHash(), 0)));
+    BOOST_CHECK(!pcoinsTip->HaveCoin(COutPoint(spend2.GetHash(), 0)));
+    BOOST_CHECK(!pcoinsTip->HaveCoin(COutPoint(block2.vtx[1]->GetHash(), 0)));
+}
+
+BOOST_FIXTURE_TEST_CASE(stored_tx_hashes, TestChain100Setup)
+{
+    fStoreTxHashes = true;
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.emplace_back(COutPoint(m_coinbase_txns[0]->GetHash(), 0));
+    spend.vout.emplace_back(11 * CENT, scriptPubKey);
+    std::vector<unsigned char> vchSig;
+    const uint256 hash = SignatureHash(m_coinbase_txns[0]->vout[0].scriptPubKey, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    const CBlock block = CreateAndProcessBlock({spend}, scriptPubKey);
+
+    const CBlockIndex* pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+    }
+    BOOST_CHECK(pindex->GetBlockHash() == block.GetHash());
+    CBlockTxHashes tx_hashes;
+    BOOST_CHECK(pblocktree->ReadBlockTxHashes(block.GetHash(), tx_hashes));
+    BOOST_CHECK_EQUAL(tx_hashes.txids.size(), 2U);
+
+    // The block is read with the stored hashes, which are those of its transactions.
+    const auto check_read = [&] {
+        CBlock read;
+        BOOST_CHECK(ReadBlockFromDiskWithStoredTxHashes(read, pindex, Params().GetConsensus()));
+        BOOST_CHECK_EQUAL(read.vtx.size(), block.vtx.size());
+        for (size_t i = 0; i < read.vtx.size(); i++) {
+            BOOST_CHECK(read.vtx[i]->GetHash() == block.vtx[i]->GetHash());
+            BOOST_CHECK(read.vtx[i]->GetWitnessHash() == block.vtx[i]->GetWitnessHash());
+        }
+    };
+    check_read();
+
+    // Stored hashes that don't fit the block are not used.
+    tx_hashes.txids.pop_back();
+    BOOST_CHECK(pblocktree->WriteBlockTxHashes(block.GetHash(), tx_hashes));
+    check_read();
+    tx_hashes = CBlockTxHashes();
+    tx_hashes.txids.resize(block.vtx.size());
+    tx_hashes.witness_hashes.emplace_back(1, uint256());
+    BOOST_CHECK(pblocktree->WriteBlockTxHashes(block.GetHash(), tx_hashes));
+    check_read();
+
+    // Hashes that fit the block are trusted as they are, but only by reads that don't validate it;
+    // ReadBlockFromDisk, used for connecting and disconnecting blocks, always computes them.
+    tx_hashes = CBlockTxHashes(block);
+    tx_hashes.txids[1] = uint256S("01");
+    BOOST_CHECK(pblocktree->WriteBlockTxHashes(block.GetHash(), tx_hashes));
+    CBlock read;
+    BOOST_CHECK(ReadBlockFromDiskWithStoredTxHashes(read, pindex, Params().GetConsensus()));
+    BOOST_CHECK(read.vtx[1]->GetHash() == tx_hashes.txids[1]);
+    BOOST_CHECK(ReadBlockFromDisk(read, pindex, Params().GetConsensus()));
+    BOOST_CHECK(read.vtx[1]->GetHash() == block.vtx[1]->GetHash());
+
+    fStoreTxHashes = DEFAULT_STORE_TX_HASHES;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -28,6 +28,7 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_BLOCK_TX_HASHES = 'h';
 
 namespace {
 
@@ -246,6 +247,57 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+CBlockTxHashes::CBlockTxHashes(const CBlock& block)
+{
+    txids.reserve(block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        txids.push_back(tx.GetHash());
+        if (tx.HasWitness()) {
+            witness_hashes.emplace_back(i, tx.GetWitnessHash());
+        }
+    }
+}
+
+bool CBlockTxHashes::MakeTransactions(std::vector<CMutableTransaction>&& txs, std::vector<CTransactionRef>& vtx) const
+{
+    vtx.clear();
+    if (txs.size() != txids.size()) {
+        return false;
+    }
+    vtx.reserve(txs.size());
+    auto witness_hash = witness_hashes.cbegin();
+    for (size_t i = 0; i < txs.size(); i++) {
+        const bool fWitness = witness_hash != witness_hashes.cend() && witness_hash->first == i;
+        if (txs[i].HasWitness() != fWitness) {
+            vtx.clear();
+            return false;
+        }
+        vtx.emplace_back(new CTransaction(std::move(txs[i]), txids[i], fWitness ? (witness_hash++)->second : txids[i]));
+    }
+    if (witness_hash != witness_hashes.cend()) {
+        vtx.clear();
+        return false;
+    }
+    return true;
+}
+
+bool CBlockTreeDB::WriteBlockTxHashes(const uint256& hash, const CBlockTxHashes& tx_hashes) {
+    return Write(std::make_pair(DB_BLOCK_TX_HASHES, hash), tx_hashes);
+}
+
+bool CBlockTreeDB::ReadBlockTxHashes(const uint256& hash, CBlockTxHashes& tx_hashes) {
+    return Read(std::make_pair(DB_BLOCK_TX_HASHES, hash), tx_hashes);
+}
+
+bool CBlockTreeDB::EraseBlockTxHashes(const std::vector<uint256>& hashes) {
+    CDBBatch batch(*this);
+    for (const uint256& hash : hashes) {
+        batch.Erase(std::make_pair(DB_BLOCK_TX_HASHES, hash));
+    }
+    return WriteBatch(batch);
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
@@ -37,6 +37,8 @@ static const int64_t nMaxBlockDBCache = 2;
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
 static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to all block filter index caches combined in MiB.
+static const int64_t max_filter_index_cache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -82,6 +84,32 @@ private:
     friend class CCoinsViewDB;
 };
 
+/**
+ * The hashes of the transactions of a block, stored so that they need not be computed
+ * again when the block is read.
+ */
+struct CBlockTxHashes
+{
+    std::vector<uint256> txids;
+    //! Witness hashes of the transactions that have a witness, by position in the block
+    std::vector<std::pair<uint32_t, uint256>> witness_hashes;
+
+    CBlockTxHashes() {}
+    explicit CBlockTxHashes(const CBlock& block);
+
+    /** Build the transactions of the block these hashes were stored for, without computing their
+     *  hashes. Returns false, leaving vtx empty, if the hashes do not fit the transactions. */
+    bool MakeTransactions(std::vector<CMutableTransaction>&& txs, std::vector<CTransactionRef>& vtx) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txids);
+        READWRITE(witness_hashes);
+    }
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -95,6 +123,9 @@ public:
     void ReadReindexing(bool &fReindexing);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    bool WriteBlockTxHashes(const uint256& hash, const CBlockTxHashes& tx_hashes);
+    bool ReadBlockTxHashes(const uint256& hash, CBlockTxHashes& tx_hashes);
+    bool EraseBlockTxHashes(const std::vector<uint256>& hashes);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
 };
 
@@ -11,6 +11,7 @@
 #include <validation.h>
 #include <policy/policy.h>
 #include <policy/fees.h>
+#include <policy/rbf.h>
 #include <reverse_iterator.h>
 #include <streams.h>
 #include <timedata.h>
@@ -144,6 +145,8 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
         }
         UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
     }
+    // Descendant and ancestor state has changed, so any snapshot is out of date
+    ++nTransactionsUpdated;
 }
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
@@ -324,7 +327,7 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
-    nTransactionsUpdated(0), minerPolicyEstimator(estimator)
+    nTransactionsUpdated(0), minerPolicyEstimator(estimator), m_track_clusters(false), m_next_cluster_id(0)
 {
     _clear(); //lock free clear
 
@@ -352,6 +355,43 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
+std::string RemovalReasonToString(MemPoolRemovalReason reason)
+{
+    switch (reason) {
+    case MemPoolRemovalReason::UNKNOWN: return "unknown";
+    case MemPoolRemovalReason::EXPIRY: return "expiry";
+    case MemPoolRemovalReason::SIZELIMIT: return "sizelimit";
+    case MemPoolRemovalReason::REORG: return "reorg";
+    case MemPoolRemovalReason::BLOCK: return "block";
+    case MemPoolRemovalReason::CONFLICT: return "conflict";
+    case MemPoolRemovalReason::REPLACED: return "replaced";
+    }
+    assert(false);
+}
+
+uint64_t CTxMemPool::GetSequence() const
+{
+    LOCK(cs);
+    return m_sequence;
+}
+
+void CTxMemPool::AddDelta(const uint256& txid, bool added, MemPoolRemovalReason reason)
+{
+    AssertLockHeld(cs);
+    if (m_delta_log.size() >= MEMPOOL_DELTA_LOG_SIZE) m_delta_log.pop_front();
+    m_delta_log.push_back(MempoolDelta{++m_sequence, txid, added, reason});
+}
+
+bool CTxMemPool::GetDeltas(uint64_t since, std::vector<MempoolDelta>& deltas) const
+{
+    LOCK(cs);
+    if (since >= m_sequence) return since == m_sequence;
+    // The log holds the changes numbered up to m_sequence, without gaps
+    const uint64_t available = std::min<uint64_t>(m_sequence - since, m_delta_log.size());
+    deltas.insert(deltas.end(), m_delta_log.end() - available, m_delta_log.end());
+    return available == m_sequence - since;
+}
+
 void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate)
 {
     NotifyEntryAdded(entry.GetSharedTx());
@@ -360,6 +400,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     // all the appropriate checks.
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
     mapLinks.insert(make_pair(newit, TxLinks()));
+    if (m_track_clusters) AddToCluster(newit);
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting
@@ -396,6 +437,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     UpdateEntryForAncestors(newit, setAncestors);
 
     nTransactionsUpdated++;
+    AddDelta(tx.GetHash(), true, MemPoolRemovalReason::UNKNOWN);
     totalTxSize += entry.GetTxSize();
     if (minerPolicyEstimator) {minerPolicyEstimator->processTransaction(entry, validFeeEstimate);}
 
@@ -422,9 +464,11 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
+    if (m_track_clusters) RemoveFromCluster(it);
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
+    AddDelta(hash, false, reason);
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
 }
 
@@ -578,6 +622,9 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 void CTxMemPool::_clear()
 {
     mapLinks.clear();
+    m_clusters.clear();
+    m_dirty_clusters.clear();
+    m_cluster_chunks.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -586,6 +633,9 @@ void CTxMemPool::_clear()
     blockSinceLastRollingFeeBump = false;
     rollingMinimumFeeRate = 0;
     ++nTransactionsUpdated;
+    // The removals are not logged; numbering them as a whole tells GetDeltas callers to start over.
+    ++m_sequence;
+    m_delta_log.clear();
 }
 
 void CTxMemPool::clear()
@@ -684,6 +734,15 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             }
         }
         assert(setChildrenCheck == GetMemPoolChildren(it));
+        if (m_track_clusters) {
+            // Connected transactions share a cluster
+            auto cluster_it = m_clusters.find(links.cluster);
+            assert(cluster_it != m_clusters.end());
+            assert(cluster_it->second.txs.count(it));
+            for (txiter childit : setChildrenCheck) {
+                assert(mapLinks.find(childit)->second.cluster == links.cluster);
+            }
+        }
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= child_sizes + it->GetTxSize());
@@ -717,6 +776,13 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
 
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
+    if (m_track_clusters) {
+        size_t cluster_txs = 0;
+        for (const auto& cluster : m_clusters) {
+            cluster_txs += cluster.second.txs.size();
+        }
+        assert(cluster_txs == mapTx.size());
+    }
 }
 
 bool CTxMemPool::CompareDepthAndScore(const uint256& hasha, const uint256& hashb)
@@ -795,6 +861,132 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
     return ret;
 }
 
+std::vector<TxMempoolRelayInfo> CTxMemPool::infoForRelay(const std::vector<uint256>& hashes) const
+{
+    std::vector<TxMempoolRelayInfo> ret;
+    ret.reserve(hashes.size());
+
+    LOCK(cs);
+    for (const uint256& hash : hashes) {
+        indexed_transaction_set::const_iterator i = mapTx.find(hash);
+        if (i == mapTx.end()) {
+            ret.emplace_back();
+        } else {
+            ret.push_back(TxMempoolRelayInfo{GetInfo(i), i->GetFee(), i->GetTxSize(), i->GetCountWithAncestors()});
+        }
+    }
+    return ret;
+}
+
+bool CTxMemPool::CompareDepthAndScore(const TxMempoolRelayInfo& a, const TxMempoolRelayInfo& b)
+{
+    if (!a.info.tx) return false;
+    if (!b.info.tx) return true;
+    if (a.nCountWithAncestors == b.nCountWithAncestors) {
+        // As CompareTxMemPoolEntryByScore
+        double f1 = (double)a.nFee * b.nTxSize;
+        double f2 = (double)b.nFee * a.nTxSize;
+        if (f1 == f2) {
+            return b.info.tx->GetHash() < a.info.tx->GetHash();
+        }
+        return f1 > f2;
+    }
+    return a.nCountWithAncestors < b.nCountWithAncestors;
+}
+
+const CTxMemPoolSnapshot::Entry* CTxMemPoolSnapshot::Find(const uint256& txid) const
+{
+    auto it = m_index.find(txid);
+    if (it == m_index.end()) return nullptr;
+    return &m_entries[it->second];
+}
+
+std::shared_ptr<const CTxMemPoolSnapshot> CTxMemPool::GetSnapshot() const
+{
+    {
+        LOCK(m_snapshot_mutex);
+        if (m_snapshot && m_snapshot->m_transactions_updated == nTransactionsUpdated) return m_snapshot;
+    }
+
+    LOCK(cs);
+    const unsigned int transactions_updated = nTransactionsUpdated;
+    {
+        // Another caller may have taken one while we waited for cs
+        LOCK(m_snapshot_mutex);
+        if (m_snapshot && m_snapshot->m_transactions_updated == transactions_updated) return m_snapshot;
+    }
+
+    std::shared_ptr<CTxMemPoolSnapshot> snapshot = std::make_shared<CTxMemPoolSnapshot>();
+    snapshot->m_transactions_updated = transactions_updated;
+    snapshot->m_sequence = m_sequence;
+    snapshot->m_entries.reserve(mapTx.size());
+    snapshot->m_index.reserve(mapTx.size());
+    // Parents have fewer ancestors than their children, so come first in this order.
+    for (txiter it : GetSortedDepthAndScore()) {
+        snapshot->m_entries.emplace_back(*it);
+        CTxMemPoolSnapshot::Entry& entry = snapshot->m_entries.back();
+        entry.wtxid = vTxHashes[it->vTxHashesIdx].first;
+        entry.bip125_replaceable = SignalsOptInRBF(it->GetTx());
+        for (txiter parent : GetMemPoolParents(it)) {
+            entry.parents.push_back(parent->GetTx().GetHash());
+            // A parent's flag already covers its own ancestors
+            if (snapshot->Find(entry.parents.back())->bip125_replaceable) {
+                entry.bip125_replaceable = true;
+            }
+        }
+        for (txiter child : GetMemPoolChildren(it)) {
+            entry.children.push_back(child->GetTx().GetHash());
+        }
+        snapshot->m_index.emplace(it->GetTx().GetHash(), snapshot->m_entries.size() - 1);
+    }
+    snapshot->m_usage = memusage::MallocUsage(sizeof(CTxMemPoolSnapshot)) +
+        memusage::DynamicUsage(snapshot->m_entries) + memusage::DynamicUsage(snapshot->m_index);
+    for (const CTxMemPoolSnapshot::Entry& entry : snapshot->m_entries) {
+        snapshot->m_usage += memusage::DynamicUsage(entry.parents) + memusage::DynamicUsage(entry.children);
+    }
+
+    LOCK(m_snapshot_mutex);
+    m_snapshot = snapshot;
+    return m_snapshot;
+}
+
+void CTxMemPool::ReleaseStaleSnapshot() const
+{
+    AssertLockHeld(cs);
+    LOCK(m_snapshot_mutex);
+    if (m_snapshot && m_snapshot->m_transactions_updated != nTransactionsUpdated) {
+        m_snapshot.reset();
+    }
+}
+
+CFeeRate CTxMemPool::GetProjectedFeeRate(unsigned int blocks) const
+{
+    if (blocks == 0) return CFeeRate(0);
+    LOCK(cs);
+    if (!m_projection_valid || m_projection_updated != nTransactionsUpdated) {
+        m_projected_feerates.clear();
+        const uint64_t block_vsize = DEFAULT_BLOCK_MAX_WEIGHT / WITNESS_SCALE_FACTOR;
+        uint64_t vsize = 0;
+        CFeeRate block_min_feerate;
+        // This approximates block assembly: a transaction is counted at the feerate of its
+        // package, which is what it is mined at when it sorts ahead of its ancestors.
+        for (const CTxMemPoolEntry& entry : mapTx.get<ancestor_score>()) {
+            if (m_projected_feerates.size() >= MEMPOOL_FEE_PROJECTION_MAX_BLOCKS) break;
+            if (vsize + entry.GetTxSize() > block_vsize) {
+                m_projected_feerates.push_back(block_min_feerate);
+                vsize = 0;
+            }
+            vsize += entry.GetTxSize();
+            block_min_feerate = std::min(CFeeRate(entry.GetModifiedFee(), entry.GetTxSize()),
+                                         CFeeRate(entry.GetModFeesWithAncestors(), entry.GetSizeWithAncestors()));
+        }
+        m_projection_valid = true;
+        m_projection_updated = nTransactionsUpdated;
+    }
+    if (blocks > m_projected_feerates.size()) return CFeeRate(0);
+    return m_projected_feerates[blocks - 1];
+}
+
 CTransactionRef CTxMemPool::get(const uint256& hash) const
 {
     LOCK(cs);
@@ -837,6 +1029,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
             for (txiter descendantIt : setDescendants) {
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
+            if (m_track_clusters) m_dirty_clusters.insert(mapLinks[it].cluster);
             ++nTransactionsUpdated;
         }
     }
@@ -911,7 +1104,19 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    size_t usage = memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    if (m_track_clusters) {
+        // Estimate each transaction to take a cluster membership entry, a linearization slot and
+        // a chunk, ignoring unused vector capacity.
+        usage += memusage::DynamicUsage(m_clusters) + memusage::DynamicUsage(m_cluster_chunks) +
+            (memusage::MallocUsage(sizeof(memusage::stl_tree_node<txiter>)) + sizeof(txiter) + sizeof(ClusterChunk)) * mapTx.size();
+    }
+    return usage;
+}
+
+size_t CTxMemPool::SnapshotMemoryUsage() const {
+    LOCK(m_snapshot_mutex);
+    return m_snapshot ? m_snapshot->DynamicMemoryUsage() : 0;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -952,6 +1157,7 @@ void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
     setEntries s;
     if (add && mapLinks[entry].children.insert(child).second) {
         cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
+        if (m_track_clusters) MergeClusters(entry, child);
     } else if (!add && mapLinks[entry].children.erase(child)) {
         cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
     }
@@ -1015,25 +1221,74 @@ void CTxMemPool::trackPackageRemoved(const CFeeRate& rate) {
     }
 }
 
+size_t CTxMemPool::RemovalUsage(txiter entry) const
+{
+    AssertLockHeld(cs);
+    const TxLinks& links = mapLinks.find(entry)->second;
+    // Links are held on both ends, in the entry's own sets and in those of its parents and children.
+    size_t usage = memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) + entry->DynamicMemoryUsage() +
+        memusage::IncrementalDynamicUsage(mapLinks) + 2 * (memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children)) +
+        entry->GetTx().vin.size() * memusage::IncrementalDynamicUsage(mapNextTx) + sizeof(decltype(vTxHashes)::value_type);
+    if (m_track_clusters) {
+        usage += memusage::MallocUsage(sizeof(memusage::stl_tree_node<txiter>)) + sizeof(txiter) + sizeof(ClusterChunk);
+    }
+    return usage;
+}
+
 void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpendsRemaining) {
     LOCK(cs);
 
+    // An out of date snapshot is only kept for the next reader to replace, and keeps the
+    // transactions evicted below alive, so let it go.
+    ReleaseStaleSnapshot();
+
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
     while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+        setEntries stage;
+        if (m_track_clusters) {
+            // Stage the worst chunks until removing them is expected to bring the mempool under the
+            // limit, and remove them all at once. The expected usage may be too high, but not too
+            // low, so that no more chunks are removed than needed; another round may follow. The
+            // worst chunk is the last of its cluster, so nothing else in the mempool spends from
+            // it; CalculateDescendants is only a safeguard, and picks up the later chunks of a
+            // cluster should an earlier one come first.
+            const size_t excess = DynamicMemoryUsage() - sizelimit;
+            size_t freed = 0;
+            const auto& chunks = GetLinearizedChunks();
+            for (auto chunk = chunks.rbegin(); chunk != chunks.rend() && freed < excess; ++chunk) {
+                const std::vector<txiter>& linearization = GetClusterLinearization(chunk->cluster);
+                setEntries package;
+                for (size_t i = chunk->begin; i < chunk->end; ++i) {
+                    if (stage.count(linearization[i])) continue;
+                    CalculateDescendants(linearization[i], package);
+                }
+                if (package.empty()) continue;
 
-        // We set the new mempool min fee to the feerate of the removed set, plus the
-        // "minimum reasonable fee rate" (ie some value under which we consider txn
-        // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
-        // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
-        removed += incrementalRelayFee;
-        trackPackageRemoved(removed);
-        maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+                // The rolling minimum fee is bumped as for a package below.
+                CFeeRate removed(chunk->fee, chunk->size);
+                removed += incrementalRelayFee;
+                trackPackageRemoved(removed);
+                maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
 
-        setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
+                for (txiter it : package) {
+                    if (stage.insert(it).second) freed += RemovalUsage(it);
+                }
+            }
+        } else {
+            indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+
+            // We set the new mempool min fee to the feerate of the removed set, plus the
+            // "minimum reasonable fee rate" (ie some value under which we consider txn
+            // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
+            // equal to txn which were removed with no block in between.
+            CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+            removed += incrementalRelayFee;
+            trackPackageRemoved(removed);
+            maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
+
+            CalculateDescendants(mapTx.project<0>(it), stage);
+        }
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
@@ -1043,6 +1298,7 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
                 txn.push_back(iter->GetTx());
         }
         RemoveStaged(stage, false, MemPoolRemovalReason::SIZELIMIT);
+        ReleaseStaleSnapshot();
         if (pvNoSpendsRemaining) {
             for (const CTransaction& tx : txn) {
                 for (const CTxIn& txin : tx.vin) {
@@ -1058,6 +1314,241 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
     }
 }
 
+bool CTxMemPool::CompareClusterChunkByFeeRate::operator()(const ClusterChunk& a, const ClusterChunk& b) const
+{
+    // Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
+    double f1 = (double)a.fee * b.size;
+    double f2 = (double)b.fee * a.size;
+    if (f1 == f2) {
+        if (a.cluster != b.cluster) return a.cluster < b.cluster;
+        return a.begin < b.begin;
+    }
+    return f1 > f2;
+}
+
+void CTxMemPool::SetClusterTracking(bool enable)
+{
+    LOCK(cs);
+    if (enable == m_track_clusters) return;
+    m_clusters.clear();
+    m_dirty_clusters.clear();
+    m_cluster_chunks.clear();
+    m_track_clusters = enable;
+    if (!enable) return;
+
+    for (txiter it = mapTx.begin(); it != mapTx.end(); ++it) {
+        AddToCluster(it);
+    }
+    for (txiter it = mapTx.begin(); it != mapTx.end(); ++it) {
+        for (txiter child : GetMemPoolChildren(it)) {
+            MergeClusters(it, child);
+        }
+    }
+}
+
+void CTxMemPool::AddToCluster(txiter entry)
+{
+    const uint64_t cluster_id = ++m_next_cluster_id;
+    mapLinks[entry].cluster = cluster_id;
+    m_clusters[cluster_id].txs.insert(entry);
+    m_dirty_clusters.insert(cluster_id);
+}
+
+void CTxMemPool::MergeClusters(txiter a, txiter b)
+{
+    uint64_t into_id = mapLinks[a].cluster;
+    uint64_t from_id = mapLinks[b].cluster;
+    if (into_id == from_id) return;
+    // Move the smaller cluster's transactions
+    if (m_clusters[into_id].txs.size() < m_clusters[from_id].txs.size()) {
+        std::swap(into_id, from_id);
+    }
+    TxCluster& into = m_clusters[into_id];
+    TxCluster& from = m_clusters[from_id];
+    for (txiter it : from.txs) {
+        mapLinks[it].cluster = into_id;
+        into.txs.insert(it);
+    }
+    for (const ClusterChunk& chunk : from.chunks) {
+        m_cluster_chunks.erase(chunk);
+    }
+    m_clusters.erase(from_id);
+    m_dirty_clusters.erase(from_id);
+    m_dirty_clusters.insert(into_id);
+}
+
+void CTxMemPool::RemoveFromCluster(txiter entry)
+{
+    const uint64_t cluster_id = mapLinks[entry].cluster;
+    TxCluster& cluster = m_clusters[cluster_id];
+    cluster.txs.erase(entry);
+    // The linearization must not keep the iterator; the chunks are dropped once relinearized.
+    cluster.linearization.clear();
+    m_dirty_clusters.insert(cluster_id);
+}
+
+namespace {
+/** A cluster transaction not yet linearized, scored by the feerate of its remaining ancestors. */
+struct LinearizationCandidate {
+    CAmount fee;
+    int64_t size;
+    CTxMemPool::txiter iter;
+};
+
+struct CompareLinearizationCandidate {
+    bool operator()(const LinearizationCandidate& a, const LinearizationCandidate& b) const
+    {
+        double f1 = (double)a.fee * b.size;
+        double f2 = (double)b.fee * a.size;
+        if (f1 == f2) {
+            return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
+        }
+        return f1 > f2;
+    }
+};
+} // namespace
+
+void CTxMemPool::LinearizeCluster(uint64_t cluster_id)
+{
+    auto cluster_it = m_clusters.find(cluster_id);
+    if (cluster_it == m_clusters.end()) return;
+    TxCluster& cluster = cluster_it->second;
+    for (const ClusterChunk& chunk : cluster.chunks) {
+        m_cluster_chunks.erase(chunk);
+    }
+    cluster.chunks.clear();
+    cluster.linearization.clear();
+    if (cluster.txs.empty()) {
+        m_clusters.erase(cluster_it);
+        return;
+    }
+
+    // Removing transactions may have split the cluster. Keep what is still connected to its
+    // first transaction, and move the rest to a new cluster that is handled separately.
+    setEntries connected;
+    std::vector<txiter> to_visit{*cluster.txs.begin()};
+    while (!to_visit.empty()) {
+        txiter it = to_visit.back();
+        to_visit.pop_back();
+        if (!connected.insert(it).second) continue;
+        const TxLinks& links = mapLinks[it];
+        to_visit.insert(to_visit.end(), links.parents.begin(), links.parents.end());
+        to_visit.insert(to_visit.end(), links.children.begin(), links.children.end());
+    }
+    if (connected.size() < cluster.txs.size()) {
+        const uint64_t split_id = ++m_next_cluster_id;
+        TxCluster& split = m_clusters[split_id];
+        for (txiter it : cluster.txs) {
+            if (connected.count(it)) continue;
+            mapLinks[it].cluster = split_id;
+            split.txs.insert(it);
+        }
+        cluster.txs.swap(connected);
+        m_dirty_clusters.insert(split_id);
+    }
+
+    // Linearize by repeatedly taking the transaction with the best feerate including its not yet
+    // linearized ancestors, as block assembly does for the whole mempool. All in-mempool
+    // ancestors are in the same cluster, so the ancestor state gives the starting scores.
+    std::set<LinearizationCandidate, CompareLinearizationCandidate> candidates;
+    std::map<txiter, LinearizationCandidate, CompareIteratorByHash> candidate_by_tx;
+    for (txiter it : cluster.txs) {
+        LinearizationCandidate candidate{it->GetModFeesWithAncestors(), (int64_t)it->GetSizeWithAncestors(), it};
+        candidates.insert(candidate);
+        candidate_by_tx.emplace(it, candidate);
+    }
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::string dummy;
+    while (!candidates.empty()) {
+        const txiter best = candidates.begin()->iter;
+        setEntries ancestors;
+        CalculateMemPoolAncestors(*best, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        ancestors.insert(best);
+
+        // A transaction has more ancestors than any of its in-mempool parents, so sorting by
+        // ancestor count puts parents first.
+        std::vector<txiter> package;
+        for (txiter it : ancestors) {
+            if (candidate_by_tx.count(it)) package.push_back(it);
+        }
+        std::sort(package.begin(), package.end(), [](const txiter& a, const txiter& b) {
+            if (a->GetCountWithAncestors() != b->GetCountWithAncestors()) {
+                return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+            }
+            return CompareIteratorByHash()(a, b);
+        });
+        for (txiter it : package) {
+            auto candidate = candidate_by_tx.find(it);
+            candidates.erase(candidate->second);
+            candidate_by_tx.erase(candidate);
+            cluster.linearization.push_back(it);
+        }
+        // Descendants no longer pay for the transactions just taken
+        for (txiter it : package) {
+            setEntries descendants;
+            CalculateDescendants(it, descendants);
+            for (txiter desc : descendants) {
+                auto candidate = candidate_by_tx.find(desc);
+                if (candidate == candidate_by_tx.end()) continue;
+                candidates.erase(candidate->second);
+                candidate->second.fee -= it->GetModifiedFee();
+                candidate->second.size -= it->GetTxSize();
+                candidates.insert(candidate->second);
+            }
+        }
+    }
+
+    // Chunk the linearization: merge each transaction into the chunk before it for as long as
+    // that raises the earlier chunk's feerate, leaving chunks of non-increasing feerate.
+    for (size_t i = 0; i < cluster.linearization.size(); ++i) {
+        const txiter it = cluster.linearization[i];
+        cluster.chunks.push_back(ClusterChunk{cluster_id, i, i + 1, it->GetModifiedFee(), (int64_t)it->GetTxSize()});
+        while (cluster.chunks.size() > 1) {
+            ClusterChunk& last = cluster.chunks.back();
+            ClusterChunk& prev = cluster.chunks[cluster.chunks.size() - 2];
+            if ((double)last.fee * prev.size <= (double)prev.fee * last.size) break;
+            prev.end = last.end;
+            prev.fee += last.fee;
+            prev.size += last.size;
+            cluster.chunks.pop_back();
+        }
+    }
+    m_cluster_chunks.insert(cluster.chunks.begin(), cluster.chunks.end());
+}
+
+const CTxMemPool::setClusterChunks& CTxMemPool::GetLinearizedChunks()
+{
+    AssertLockHeld(cs);
+    while (!m_dirty_clusters.empty()) {
+        const uint64_t cluster_id = *m_dirty_clusters.begin();
+        m_dirty_clusters.erase(m_dirty_clusters.begin());
+        LinearizeCluster(cluster_id);
+    }
+    return m_cluster_chunks;
+}
+
+const std::vector<CTxMemPool::txiter>& CTxMemPool::GetClusterLinearization(uint64_t cluster_id) const
+{
+    auto cluster_it = m_clusters.find(cluster_id);
+    assert(cluster_it != m_clusters.end());
+    return cluster_it->second.linearization;
+}
+
+size_t CTxMemPool::CalculateClusterSize(const setEntries& ancestors) const
+{
+    AssertLockHeld(cs);
+    // The ancestors are in the clusters of the parents, which the new transaction joins together.
+    std::set<uint64_t> clusters;
+    size_t size = 1;
+    for (txiter it : ancestors) {
+        const uint64_t cluster_id = mapLinks.at(it).cluster;
+        if (clusters.insert(cluster_id).second) {
+            size += m_clusters.at(cluster_id).txs.size();
+        }
+    }
+    return size;
+}
+
 uint64_t CTxMemPool::CalculateDescendantMaximum(txiter entry) const {
     // find parent with highest descendant count
     std::vector<txiter> candidates;
@@ -6,9 +6,12 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <atomic>
+#include <deque>
 #include <memory>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 #include <string>
@@ -34,6 +37,15 @@ extern CCriticalSection cs_main;
 /** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const uint32_t MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/** Default for -clustermempool, order block assembly and eviction by linearized clusters */
+static const bool DEFAULT_CLUSTER_MEMPOOL = false;
+
+/** Number of most recent additions and removals the mempool keeps for getmempooldelta */
+static const size_t MEMPOOL_DELTA_LOG_SIZE = 50000;
+
+/** Number of blocks, a day's worth, that the mempool is projected into for fee estimation */
+static const unsigned int MEMPOOL_FEE_PROJECTION_MAX_BLOCKS = 144;
+
 struct LockPoints
 {
     // Will be set to the blockchain height and median time past
@@ -340,6 +352,23 @@ struct TxMempoolInfo
     int64_t nFeeDelta;
 };
 
+/**
+ * Information about a mempool transaction, with what is needed to order its relay.
+ */
+struct TxMempoolRelayInfo
+{
+    TxMempoolInfo info;
+
+    /** Fee of the transaction, without any fee delta. */
+    CAmount nFee;
+
+    /** Virtual size of the transaction. */
+    size_t nTxSize;
+
+    /** Number of in-mempool ancestors, including the transaction itself. */
+    uint64_t nCountWithAncestors;
+};
+
 /** Reason why a transaction was removed from the mempool,
  * this is passed to the notification signal.
  */
@@ -353,6 +382,17 @@ enum class MemPoolRemovalReason {
     REPLACED,    //!< Removed for replacement
 };
 
+std::string RemovalReasonToString(MemPoolRemovalReason reason);
+
+/** A transaction entering or leaving the mempool, numbered by the mempool sequence. */
+struct MempoolDelta {
+    uint64_t sequence;
+    uint256 txid;
+    bool added;
+    //! Why the transaction left the mempool, if it did
+    MemPoolRemovalReason reason;
+};
+
 class SaltedTxidHasher
 {
 private:
@@ -367,6 +407,52 @@ public:
     }
 };
 
+/**
+ * An immutable copy of the mempool's entries. It is taken under CTxMemPool::cs and then shared
+ * through a std::shared_ptr, so readers that walk the whole mempool, such as getrawmempool, do not
+ * hold the mempool lock while they do and do not hold up transaction acceptance.
+ */
+class CTxMemPoolSnapshot
+{
+public:
+    struct Entry {
+        explicit Entry(const CTxMemPoolEntry& entry_in) : entry(entry_in) {}
+
+        CTxMemPoolEntry entry;
+        uint256 wtxid;
+        //! In-mempool transactions spent by this one
+        std::vector<uint256> parents;
+        //! In-mempool transactions spending this one
+        std::vector<uint256> children;
+        //! Whether the transaction or any of its in-mempool ancestors signals BIP125 replaceability
+        bool bip125_replaceable;
+    };
+
+    /** Entries sorted by ancestor count and then by fee rate, as by CTxMemPool::queryHashes. */
+    const std::vector<Entry>& GetEntries() const { return m_entries; }
+
+    /** Find the entry for a transaction, or nullptr if it was not in the mempool. */
+    const Entry* Find(const uint256& txid) const;
+
+    /** The value of CTxMemPool::GetTransactionsUpdated() this snapshot was taken at. */
+    unsigned int GetTransactionsUpdated() const { return m_transactions_updated; }
+
+    /** The value of CTxMemPool::GetSequence() this snapshot was taken at. */
+    uint64_t GetSequence() const { return m_sequence; }
+
+    /** Memory taken by the snapshot, not counting the transactions it shares with the mempool. */
+    size_t DynamicMemoryUsage() const { return m_usage; }
+
+private:
+    friend class CTxMemPool;
+
+    std::vector<Entry> m_entries;
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> m_index;
+    unsigned int m_transactions_updated;
+    uint64_t m_sequence;
+    size_t m_usage;
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions
  * that may be included in the next block.
@@ -443,7 +529,7 @@ class CTxMemPool
 {
 private:
     uint32_t nCheckFrequency GUARDED_BY(cs); //!< Value n means that n times in 2^32 we check.
-    unsigned int nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation
+    std::atomic<unsigned int> nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation, and to tell if the snapshot is current
     CBlockPolicyEstimator* minerPolicyEstimator;
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
@@ -453,6 +539,19 @@ private:
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
 
+    bool m_track_clusters GUARDED_BY(cs); //!< whether transactions are grouped into linearized clusters
+    uint64_t m_next_cluster_id GUARDED_BY(cs);
+
+    mutable Mutex m_snapshot_mutex;
+    mutable std::shared_ptr<const CTxMemPoolSnapshot> m_snapshot GUARDED_BY(m_snapshot_mutex); //!< most recent snapshot
+
+    uint64_t m_sequence GUARDED_BY(cs){0}; //!< sequence number of the last addition or removal
+    std::deque<MempoolDelta> m_delta_log GUARDED_BY(cs); //!< most recent additions and removals, oldest first
+
+    mutable std::vector<CFeeRate> m_projected_feerates GUARDED_BY(cs); //!< lowest feerate in each full projected block
+    mutable bool m_projection_valid GUARDED_BY(cs){false};
+    mutable unsigned int m_projection_updated GUARDED_BY(cs){0}; //!< nTransactionsUpdated the projection was made at
+
     void trackPackageRemoved(const CFeeRate& rate) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
 public:
@@ -537,21 +636,69 @@ public:
     const setEntries & GetMemPoolParents(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     const setEntries & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /**
+     * A chunk of a linearized cluster: a run of transactions in the cluster's linearization that
+     * is mined, or evicted, as a unit. The chunks of a cluster have non-increasing feerates.
+     */
+    struct ClusterChunk {
+        uint64_t cluster;
+        //! Positions [begin, end) in the cluster linearization
+        size_t begin;
+        size_t end;
+        CAmount fee; //!< modified fees of the chunk's transactions
+        int64_t size; //!< virtual size of the chunk's transactions
+    };
+
+    /** Sort chunks by decreasing feerate. Chunks of one cluster keep their linearization order. */
+    struct CompareClusterChunkByFeeRate {
+        bool operator()(const ClusterChunk& a, const ClusterChunk& b) const;
+    };
+    typedef std::set<ClusterChunk, CompareClusterChunkByFeeRate> setClusterChunks;
+
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
         setEntries parents;
         setEntries children;
+        uint64_t cluster{0}; //!< cluster the transaction belongs to, if clusters are tracked
     };
 
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
+    /**
+     * A set of transactions connected by spending relations. Its linearization orders all of
+     * them so that parents come before children, and is recomputed when the cluster changes.
+     */
+    struct TxCluster {
+        setEntries txs;
+        std::vector<txiter> linearization;
+        std::vector<ClusterChunk> chunks;
+    };
+
+    std::map<uint64_t, TxCluster> m_clusters GUARDED_BY(cs);
+    //! Clusters changed since they were last linearized
+    std::set<uint64_t> m_dirty_clusters GUARDED_BY(cs);
+    //! Chunks of all linearized clusters, best feerate first
+    setClusterChunks m_cluster_chunks GUARDED_BY(cs);
+
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
+    /** Put a transaction into a new cluster of its own. */
+    void AddToCluster(txiter entry) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Merge the clusters of two transactions that have become connected. */
+    void MergeClusters(txiter a, txiter b) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Take a transaction that is about to leave the mempool out of its cluster. */
+    void RemoveFromCluster(txiter entry) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Split a changed cluster if it is no longer connected, then linearize and chunk it. */
+    void LinearizeCluster(uint64_t cluster_id) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Drop the kept snapshot if the mempool has changed since it was taken. */
+    void ReleaseStaleSnapshot() const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
 public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx GUARDED_BY(cs);
@@ -570,6 +717,29 @@ public:
     void check(const CCoinsViewCache *pcoins) const;
     void setSanityCheck(double dFrequency = 1.0) { LOCK(cs); nCheckFrequency = static_cast<uint32_t>(dFrequency * 4294967295.0); }
 
+    /**
+     * Enable or disable cluster tracking. While enabled, transactions connected by spending
+     * relations are grouped into clusters, each kept linearized by feerate and split into chunks,
+     * and both block assembly and TrimToSize work through those chunks: the best chunks are mined
+     * first and the worst chunk is evicted first. Ancestor and descendant state is still kept, as
+     * the package limits and RPCs use it.
+     */
+    void SetClusterTracking(bool enable);
+    bool IsTrackingClusters() const { LOCK(cs); return m_track_clusters; }
+
+    /** Linearize any changed clusters and return the chunks of all clusters, best feerate first. */
+    const setClusterChunks& GetLinearizedChunks() EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** Get the linearization of a cluster, which the positions in its chunks refer to. */
+    const std::vector<txiter>& GetClusterLinearization(uint64_t cluster_id) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /**
+     * With cluster tracking, the number of transactions in the cluster a new transaction with the
+     * given in-mempool ancestors would make, itself included. May be too high, but not too low,
+     * while a cluster split by a removal is not linearized again yet.
+     */
+    size_t CalculateClusterSize(const setEntries& ancestors) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     // addUnchecked must updated state for all ancestors of a given transaction,
     // to track size/count of descendant transactions.  First version of
     // addUnchecked can be used to have it call CalculateMemPoolAncestors(), and
@@ -588,10 +758,22 @@ public:
     void clear();
     void _clear() EXCLUSIVE_LOCKS_REQUIRED(cs); //lock free
     bool CompareDepthAndScore(const uint256& hasha, const uint256& hashb);
+    /** CompareDepthAndScore on information looked up earlier; transactions not in the mempool sort last. */
+    static bool CompareDepthAndScore(const TxMempoolRelayInfo& a, const TxMempoolRelayInfo& b);
     void queryHashes(std::vector<uint256>& vtxid);
     bool isSpent(const COutPoint& outpoint) const;
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
+
+    /** The sequence number of the last transaction added to or removed from the mempool. Every
+     *  addition and removal takes the next number. */
+    uint64_t GetSequence() const;
+    /**
+     * Get the additions and removals after sequence number since, oldest first. Only the last
+     * MEMPOOL_DELTA_LOG_SIZE are kept, and none across a clear(); returns false if some of the
+     * changes are no longer available, leaving the ones that are in deltas.
+     */
+    bool GetDeltas(uint64_t since, std::vector<MempoolDelta>& deltas) const;
     /**
      * Check that none of this transactions inputs are in the mempool, and thus
      * the tx is not dependent on other mempool transactions to be included in a block.
@@ -658,6 +840,9 @@ public:
     CFeeRate GetMinFee(size_t sizelimit) const;
 
     /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
+      *  Only with cluster tracking (-clustermempool) are several removed at once: the
+      *  worst chunks, as many at a time as are expected to be needed to reach the
+      *  limit. Otherwise one package is removed at a time, by descendant score.
       *  pvNoSpendsRemaining, if set, will be populated with the list of outpoints
       *  which are not in mempool which no longer have any spends in this mempool.
       */
@@ -693,9 +878,38 @@ public:
     CTransactionRef get(const uint256& hash) const;
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** Look up several transactions to relay under a single lock. Transactions that are not in
+     *  the mempool get an entry with a null tx. */
+    std::vector<TxMempoolRelayInfo> infoForRelay(const std::vector<uint256>& hashes) const;
+
+    /**
+     * Get a snapshot of the mempool as it is now, which can be used without holding cs. The
+     * snapshot is shared between callers, and only retaken by the first caller after the mempool
+     * has changed. The snapshot kept for them is not part of DynamicMemoryUsage(), see
+     * SnapshotMemoryUsage().
+     */
+    std::shared_ptr<const CTxMemPoolSnapshot> GetSnapshot() const;
+
+    /**
+     * Estimate the feerate a transaction needs to be mined within the given number of blocks,
+     * were no other transactions to arrive, by filling blocks of default size from the mempool
+     * in ancestor feerate order. This is the lowest feerate in the last of those blocks, or 0
+     * when the mempool does not fill them. The projection is only redone once the mempool has
+     * changed.
+     */
+    CFeeRate GetProjectedFeeRate(unsigned int blocks) const;
 
     size_t DynamicMemoryUsage() const;
 
+    /**
+     * Memory taken by the snapshot kept for GetSnapshot() callers. It is left out of
+     * DynamicMemoryUsage() so that it does not count against -maxmempool: transactions are not
+     * evicted to make room for a copy of the mempool. At most one snapshot is kept, and it is
+     * dropped once out of date when the mempool is trimmed, so it stays below the usage of the
+     * entries it copied.
+     */
+    size_t SnapshotMemoryUsage() const;
+
     boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
     boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
 
@@ -736,6 +950,11 @@ private:
      *  removal.
      */
     void removeUnchecked(txiter entry, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Number the addition or removal of txid and keep it for GetDeltas. */
+    void AddDelta(const uint256& txid, bool added, MemPoolRemovalReason reason) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** The decrease in DynamicMemoryUsage() removing entry will make, erring on the high side
+     *  where links to other transactions removed along with it are counted twice. */
+    size_t RemovalUsage(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 };
 
 /**
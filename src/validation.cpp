@@ -17,6 +17,7 @@
 #include <cuckoocache.h>
 #include <hash.h>
 #include <index/txindex.h>
+#include <mempooljournal.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -41,8 +42,12 @@
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <condition_variable>
+#include <deque>
 #include <future>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/thread.hpp>
@@ -181,6 +186,7 @@ public:
     void ResetBlockFailureFlags(CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
+    bool ReplayValidatedBlocks(const CChainParams& chainparams, const CBlockIndex* pindexTarget) LOCKS_EXCLUDED(cs_main);
     bool RewindBlockIndex(const CChainParams& params);
     bool LoadGenesisBlock(const CChainParams& chainparams);
 
@@ -238,6 +244,7 @@ bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
+bool fStoreTxHashes = DEFAULT_STORE_TX_HASHES;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
@@ -321,6 +328,8 @@ static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfte
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
 static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
 bool CheckFinalTx(const CTransaction &tx, int flags)
 {
     AssertLockHeld(cs_main);
@@ -567,6 +576,96 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
     return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
 }
 
+/**
+ * CheckInputs for a transaction being accepted to the mempool. The script checks of transactions with
+ * at least MEMPOOL_PARALLEL_SCRIPT_CHECK_MIN_INPUTS inputs are handed to the script-checking threads,
+ * as in ConnectBlock, instead of all being run on the calling thread. Both callers hold cs_main, so
+ * they never use the queue at the same time. The queue only reports that some check failed, so
+ * then the inputs are checked again serially, up to the first one that fails, only to fill in
+ * state as CheckInputs would.
+ */
+static bool CheckInputsForMempool(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view, unsigned int flags, PrecomputedTransactionData& txdata) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (nScriptCheckThreads && tx.vin.size() >= MEMPOOL_PARALLEL_SCRIPT_CHECK_MIN_INPUTS) {
+        std::vector<CScriptCheck> vChecks;
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        if (!CheckInputs(tx, state, view, true, flags, true, false, txdata, &vChecks)) {
+            return false;
+        }
+        control.Add(vChecks);
+        if (control.Wait()) {
+            return true;
+        }
+        // The inputs before the failing one had their signatures cached by the checks above.
+        if (CheckInputs(tx, state, view, true, flags, true, false, txdata)) {
+            state.Invalid(false, REJECT_INVALID, "mandatory-script-verify-flag-failed (script check failed)");
+        }
+        return false;
+    }
+    return CheckInputs(tx, state, view, true, flags, true, false, txdata);
+}
+
+namespace {
+
+/** Lock-free counterpart of MempoolAcceptLatencyStats::Histogram. */
+class LatencyHistogram
+{
+public:
+    LatencyHistogram()
+    {
+        for (std::atomic<uint64_t>& bucket : m_buckets) {
+            bucket = 0;
+        }
+    }
+
+    void Add(int64_t micros)
+    {
+        m_count.fetch_add(1, std::memory_order_relaxed);
+        m_total_micros.fetch_add(micros, std::memory_order_relaxed);
+        m_buckets[GetMempoolAcceptLatencyBucket(micros)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    MempoolAcceptLatencyStats::Histogram Get() const
+    {
+        MempoolAcceptLatencyStats::Histogram histogram;
+        histogram.count = m_count.load(std::memory_order_relaxed);
+        histogram.total_micros = m_total_micros.load(std::memory_order_relaxed);
+        for (int i = 0; i < MEMPOOL_ACCEPT_LATENCY_BUCKETS; ++i) {
+            histogram.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        }
+        return histogram;
+    }
+
+private:
+    std::atomic<uint64_t> m_count{0};
+    std::atomic<int64_t> m_total_micros{0};
+    std::atomic<uint64_t> m_buckets[MEMPOOL_ACCEPT_LATENCY_BUCKETS];
+};
+
+LatencyHistogram g_accept_latency_accepted;
+LatencyHistogram g_accept_latency_rejected;
+LatencyHistogram g_accept_latency_script_checks;
+
+} // namespace
+
+int GetMempoolAcceptLatencyBucket(int64_t micros)
+{
+    int bucket = 0;
+    while (bucket < MEMPOOL_ACCEPT_LATENCY_BUCKETS - 1 && micros >= (int64_t{1} << bucket)) {
+        ++bucket;
+    }
+    return bucket;
+}
+
+MempoolAcceptLatencyStats GetMempoolAcceptLatencyStats()
+{
+    MempoolAcceptLatencyStats stats;
+    stats.accepted = g_accept_latency_accepted.Get();
+    stats.rejected = g_accept_latency_rejected.Get();
+    stats.script_checks = g_accept_latency_script_checks.Get();
+    return stats;
+}
+
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
                               bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
@@ -761,6 +860,16 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
         }
 
+        // Each change to a cluster has it linearized again, so its size is bounded as well.
+        if (pool.IsTrackingClusters()) {
+            const size_t nLimitCluster = gArgs.GetArg("-limitclustercount", DEFAULT_CLUSTER_LIMIT);
+            const size_t nClusterSize = pool.CalculateClusterSize(setAncestors);
+            if (nClusterSize > nLimitCluster) {
+                return state.DoS(0, false, REJECT_NONSTANDARD, "too-large-cluster", false,
+                    strprintf("cluster would have %u transactions [limit: %u]", nClusterSize, nLimitCluster));
+            }
+        }
+
         // A transaction that spends outputs that would be replaced by it is invalid. Now
         // that we have the set of all ancestors we can detect this
         // pathological case by making sure setConflicts and setAncestors don't
@@ -899,8 +1008,9 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+        const int64_t nScriptCheckStart = GetTimeMicros();
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
+        if (!CheckInputsForMempool(tx, state, view, scriptVerifyFlags, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
@@ -910,6 +1020,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
                 // Only the witness is missing, so the transaction itself may be fine.
                 state.SetCorruptionPossible();
             }
+            g_accept_latency_script_checks.Add(GetTimeMicros() - nScriptCheckStart);
             return false; // state filled in by CheckInputs
         }
 
@@ -933,6 +1044,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             return error("%s: BUG! PLEASE REPORT THIS! CheckInputs failed against latest-block but not STANDARD flags %s, %s",
                     __func__, hash.ToString(), FormatStateMessage(state));
         }
+        g_accept_latency_script_checks.Add(GetTimeMicros() - nScriptCheckStart);
 
         if (test_accept) {
             // Tx was accepted, but not added
@@ -981,7 +1093,9 @@ static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPo
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     std::vector<COutPoint> coins_to_uncache;
+    const int64_t nStart = GetTimeMicros();
     bool res = AcceptToMemoryPoolWorker(chainparams, pool, state, tx, pfMissingInputs, nAcceptTime, plTxnReplaced, bypass_limits, nAbsurdFee, coins_to_uncache, test_accept);
+    (res ? g_accept_latency_accepted : g_accept_latency_rejected).Add(GetTimeMicros() - nStart);
     if (!res) {
         for (const COutPoint& hashTx : coins_to_uncache)
             pcoinsTip->Uncache(hashTx);
@@ -1020,7 +1134,7 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
         }
     } else {
         CBlock block;
-        if (ReadBlockFromDisk(block, block_index, consensusParams)) {
+        if (ReadBlockFromDiskWithStoredTxHashes(block, block_index, consensusParams)) {
             for (const auto& tx : block.vtx) {
                 if (tx->GetHash() == hash) {
                     txOut = tx;
@@ -1105,6 +1219,43 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadBlockFromDiskWithStoredTxHashes(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams)
+{
+    // Only blocks that were connected have their transaction hashes stored, so these can be trusted.
+    CBlockTxHashes tx_hashes;
+    if (!fStoreTxHashes || !pblocktree || !pblocktree->ReadBlockTxHashes(pindex->GetBlockHash(), tx_hashes)) {
+        return ReadBlockFromDisk(block, pindex, consensusParams);
+    }
+
+    CDiskBlockPos blockPos;
+    {
+        LOCK(cs_main);
+        blockPos = pindex->GetBlockPos();
+    }
+
+    block.SetNull();
+    CAutoFile filein(OpenBlockFile(blockPos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, blockPos.ToString());
+    std::vector<CMutableTransaction> txs;
+    try {
+        filein >> static_cast<CBlockHeader&>(block);
+        filein >> txs;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), blockPos.ToString());
+    }
+    // A header that is the one in the index needs no proof of work check.
+    if (block.GetHash() != pindex->GetBlockHash())
+        return error("%s: GetHash() doesn't match index for %s at %s", __func__,
+                pindex->ToString(), blockPos.ToString());
+    if (!tx_hashes.MakeTransactions(std::move(txs), block.vtx)) {
+        // If the stored hashes are what's wrong, the block can still be read without them.
+        LogPrintf("%s: stored transaction hashes do not match block %s\n", __func__, pindex->ToString());
+        return ReadBlockFromDisk(block, pindex, consensusParams);
+    }
+    return true;
+}
+
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start)
 {
     CDiskBlockPos hpos = pos;
@@ -1335,6 +1486,74 @@ bool CScriptCheck::operator()() {
     return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
 }
 
+/** Whether script has a CHECKMULTISIG(VERIFY) before any part of it that does not parse. */
+static bool HasCheckMultisig(const CScript& script)
+{
+    CScript::const_iterator pc = script.begin();
+    opcodetype opcode;
+    while (script.GetOp(pc, opcode)) {
+        if (opcode == OP_CHECKMULTISIG || opcode == OP_CHECKMULTISIGVERIFY) return true;
+    }
+    return false;
+}
+
+bool CScriptCheck::CanBatch() const {
+    const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
+    const CScriptWitness &witness = ptxTo->vin[nIn].scriptWitness;
+    if (HasCheckMultisig(m_tx_out.scriptPubKey) || HasCheckMultisig(scriptSig)) return false;
+    // Whatever the last push of the scriptSig or the last witness stack item might be run as a
+    // P2SH or P2WSH script. Treating them as one whenever they parse can only leave out scripts
+    // that could have been batched.
+    CScript::const_iterator pc = scriptSig.begin();
+    opcodetype opcode;
+    std::vector<unsigned char> data, last_push;
+    while (scriptSig.GetOp(pc, opcode, data)) {
+        last_push = data;
+    }
+    if (HasCheckMultisig(CScript(last_push.begin(), last_push.end()))) return false;
+    if (!witness.stack.empty() && HasCheckMultisig(CScript(witness.stack.back().begin(), witness.stack.back().end()))) return false;
+    return true;
+}
+
+bool CScriptCheck::RunBatched(SignatureBatch& batch) {
+    const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
+    const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
+    return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, BatchingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata, batch), &error);
+}
+
+bool RunChecks(std::vector<CScriptCheck>& checks)
+{
+    SignatureBatch batch;
+    std::vector<bool> passed(checks.size());
+    // Where the signatures collected from each check end in the batch
+    std::vector<size_t> ends(checks.size());
+    for (size_t i = 0; i < checks.size(); i++) {
+        const size_t begin = batch.size();
+        if (!checks[i].CanBatch()) {
+            // Collecting its signatures would pair them with the wrong keys, and the batch
+            // would fail for valid spends.
+            if (!checks[i]()) return false;
+            passed[i] = true;
+        } else {
+            passed[i] = checks[i].RunBatched(batch);
+            // A check that failed has to be run again anyway, so its signatures need not be verified now.
+            if (!passed[i]) batch.Truncate(begin);
+        }
+        ends[i] = batch.size();
+    }
+
+    std::vector<bool> valid;
+    const bool all_valid = batch.Verify(valid);
+    size_t begin = 0;
+    for (size_t i = 0; i < checks.size(); i++) {
+        const auto end = valid.begin() + ends[i];
+        const bool ok = passed[i] && (all_valid || std::find(valid.begin() + begin, end, false) == end);
+        begin = ends[i];
+        if (!ok && !checks[i]()) return false;
+    }
+    return true;
+}
+
 int GetSpendHeight(const CCoinsViewCache& inputs)
 {
     LOCK(cs_main);
@@ -1353,6 +1572,90 @@ void InitScriptExecutionCache() {
     size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
     LogPrintf("Using %zu MiB out of %zu/2 requested for script execution cache, able to store %zu elements\n",
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
+    // Entries left in the table from before no longer match anything.
+    scriptExecutionCacheNonce = GetRandHash();
+}
+
+static const uint64_t SCRIPT_CACHE_DUMP_VERSION = 1;
+
+bool DumpScriptExecutionCache()
+{
+    int64_t start = GetTimeMicros();
+
+    uint256 nonce;
+    unsigned int flags;
+    std::vector<uint256> entries;
+    {
+        LOCK(cs_main);
+        if (!chainActive.Tip()) return false;
+        // The entries are only of use as long as the next block is checked with the same flags.
+        flags = GetBlockScriptFlags(chainActive.Tip(), Params().GetConsensus());
+        nonce = scriptExecutionCacheNonce;
+        scriptExecutionCache.for_each_live([&entries](const uint256& entry) { entries.push_back(entry); });
+    }
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "scriptcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << SCRIPT_CACHE_DUMP_VERSION;
+        file << nonce;
+        file << flags;
+        file << entries;
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        RenameOver(GetDataDir() / "scriptcache.dat.new", GetDataDir() / "scriptcache.dat");
+        LogPrintf("Dumped %u script execution cache entries: %gs\n", entries.size(), (GetTimeMicros() - start) * MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump script execution cache: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadScriptExecutionCache()
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "scriptcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open script execution cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 nonce;
+    unsigned int flags;
+    std::vector<uint256> entries;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SCRIPT_CACHE_DUMP_VERSION) {
+            return false;
+        }
+        file >> nonce;
+        file >> flags;
+        file >> entries;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize script execution cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LOCK(cs_main);
+    if (!chainActive.Tip() || flags != GetBlockScriptFlags(chainActive.Tip(), Params().GetConsensus())) {
+        LogPrintf("Script execution cache on disk is for other script flags. Not loading it.\n");
+        return false;
+    }
+    // The entries are hashes salted with the nonce, so it is taken over with them. What was cached
+    // under the previous nonce is lost, which is little as this is done at startup.
+    scriptExecutionCacheNonce = nonce;
+    for (const uint256& entry : entries) {
+        scriptExecutionCache.insert(entry);
+    }
+    LogPrintf("Loaded %u script execution cache entries from disk\n", entries.size());
+    return true;
 }
 
 /**
@@ -1481,7 +1784,9 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
-static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+} // namespace
+
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
 {
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
@@ -1512,6 +1817,8 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
     return true;
 }
 
+namespace {
+
 /** Abort with a message */
 static bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1674,8 +1981,6 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState&
     return true;
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck() {
     RenameThread("obsidian-scriptch");
     scriptcheckqueue.Thread();
@@ -2044,6 +2349,10 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     if (!WriteUndoDataForBlock(blockundo, state, pindex, chainparams))
         return false;
 
+    if (fStoreTxHashes && !pblocktree->WriteBlockTxHashes(pindex->GetBlockHash(), CBlockTxHashes(block))) {
+        return AbortNode(state, "Failed to write transaction hashes");
+    }
+
     if (!pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
         setDirtyBlockIndex.insert(pindex);
@@ -3633,9 +3942,11 @@ void PruneOneBlockFile(const int fileNumber)
 {
     LOCK(cs_LastBlockFile);
 
+    std::vector<uint256> vPruned;
     for (const auto& entry : mapBlockIndex) {
         CBlockIndex* pindex = entry.second;
         if (pindex->nFile == fileNumber) {
+            vPruned.push_back(pindex->GetBlockHash());
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
             pindex->nStatus &= ~BLOCK_HAVE_UNDO;
             pindex->nFile = 0;
@@ -3660,6 +3971,11 @@ void PruneOneBlockFile(const int fileNumber)
 
     vinfoBlockFile[fileNumber].SetNull();
     setDirtyFileInfo.insert(fileNumber);
+
+    // Stored transaction hashes are of no use without the blocks.
+    if (pblocktree && !pblocktree->EraseBlockTxHashes(vPruned)) {
+        LogPrintf("%s: failed to erase transaction hashes of pruned blocks\n", __func__);
+    }
 }
 
 
@@ -4181,6 +4497,251 @@ bool ReplayBlocks(const CChainParams& params, CCoinsView* view) {
     return g_chainstate.ReplayBlocks(params, view);
 }
 
+namespace {
+
+/** A bounded queue passing items from one stage of a pipeline to the next. */
+template <typename T>
+class PipelineQueue
+{
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<T> m_items;
+    const size_t m_capacity;
+    bool m_closed = false;
+
+public:
+    explicit PipelineQueue(size_t capacity) : m_capacity(capacity) {}
+
+    /** Add an item, waiting for room. Returns false if the queue was closed. */
+    bool Push(T&& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed) return false;
+        m_items.push_back(std::move(item));
+        m_cond.notify_all();
+        return true;
+    }
+
+    /** Take the next item, waiting for one. Returns false once the queue is closed and empty. */
+    bool Pop(T& item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty()) return false;
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_cond.notify_all();
+        return true;
+    }
+
+    /** Stop accepting items. Those already queued can still be taken. */
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_cond.notify_all();
+    }
+};
+
+/** A block on its way through the ReplayValidatedBlocks pipeline. */
+struct ReplayBlock {
+    const CBlockIndex* pindex = nullptr;
+    std::vector<uint8_t> raw;
+    CBlock block;
+    CBlockUndo undo;
+};
+
+//! Blocks read or deserialized ahead of the one being applied, per stage
+static const size_t REPLAY_QUEUE_SIZE = 16;
+
+/**
+ * The threads reading and deserializing blocks for ReplayValidatedBlocks. However the replay
+ * ends, including by an exception while applying a block, the queues are closed so that the
+ * threads stop, and the threads are waited for.
+ */
+struct ReplayThreads {
+    PipelineQueue<ReplayBlock>& read_queue;
+    PipelineQueue<ReplayBlock>& apply_queue;
+    std::thread reader;
+    std::thread deserializer;
+
+    ReplayThreads(PipelineQueue<ReplayBlock>& read_queue_in, PipelineQueue<ReplayBlock>& apply_queue_in) : read_queue(read_queue_in), apply_queue(apply_queue_in) {}
+
+    ~ReplayThreads()
+    {
+        read_queue.Close();
+        apply_queue.Close();
+        if (deserializer.joinable()) deserializer.join();
+        if (reader.joinable()) reader.join();
+    }
+};
+
+/**
+ * Apply the changes of a block that was validated before to the UTXO set. The coins
+ * it spends are taken from its undo data into the cache before being spent, so that
+ * they need not be looked up in the database just to be erased.
+ */
+void ApplyValidatedBlock(const CBlock& block, const CBlockUndo& blockundo, int nHeight, CCoinsViewCache& view)
+{
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            for (size_t j = 0; j < tx.vin.size(); j++) {
+                // Undo data written by old versions may not have the coin (nHeight 0), in
+                // which case it is looked up.
+                if (txundo.vprevout[j].nHeight > 0) {
+                    view.AddCoin(tx.vin[j].prevout, Coin(txundo.vprevout[j]), true);
+                }
+                view.SpendCoin(tx.vin[j].prevout);
+            }
+        }
+        AddCoins(view, tx, nHeight);
+    }
+}
+
+} // namespace
+
+bool CChainState::ReplayValidatedBlocks(const CChainParams& chainparams, const CBlockIndex* pindexTarget)
+{
+    // Keep ActivateBestChain from connecting blocks on top of ours meanwhile.
+    LOCK(m_cs_chainstate);
+
+    // The blocks to replay, from the tip up to the first one that was not fully validated
+    // before or lacks its data.
+    std::vector<const CBlockIndex*> blocks;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindexTip = chainActive.Tip();
+        if (pindexTarget == nullptr || (pindexTip && (pindexTarget->nHeight <= pindexTip->nHeight || pindexTarget->GetAncestor(pindexTip->nHeight) != pindexTip))) {
+            return true;
+        }
+        for (const CBlockIndex* pindex = pindexTarget; pindex != pindexTip; pindex = pindex->pprev) {
+            blocks.push_back(pindex);
+        }
+        std::reverse(blocks.begin(), blocks.end());
+        const auto unusable = std::find_if(blocks.begin(), blocks.end(), [](const CBlockIndex* pindex) {
+            return pindex->nHeight > 0 && (!pindex->IsValid(BLOCK_VALID_SCRIPTS) || !(pindex->nStatus & BLOCK_HAVE_DATA) || !(pindex->nStatus & BLOCK_HAVE_UNDO));
+        });
+        blocks.erase(unusable, blocks.end());
+    }
+    if (blocks.empty()) return true;
+
+    LogPrintf("Replaying %d validated blocks up to height %d\n", blocks.size(), blocks.back()->nHeight);
+    const int64_t nStart = GetTimeMillis();
+
+    // Blocks are read on one thread, deserialized on another and applied on this one.
+    // Block positions do not change while the chain state is being rebuilt, so the
+    // reading needs no lock.
+    PipelineQueue<ReplayBlock> readQueue(REPLAY_QUEUE_SIZE);
+    PipelineQueue<ReplayBlock> applyQueue(REPLAY_QUEUE_SIZE);
+    ReplayThreads threads(readQueue, applyQueue);
+    threads.reader = std::thread([&] {
+        RenameThread("obsidian-replayread");
+        for (const CBlockIndex* pindex : blocks) {
+            ReplayBlock item;
+            item.pindex = pindex;
+            // The genesis block has no undo data, and does not change the UTXO set.
+            if (pindex->nHeight > 0 && (!ReadRawBlockFromDisk(item.raw, pindex, chainparams.MessageStart()) || !UndoReadFromDisk(item.undo, pindex))) {
+                break;
+            }
+            if (!readQueue.Push(std::move(item))) break;
+        }
+        readQueue.Close();
+    });
+    threads.deserializer = std::thread([&] {
+        RenameThread("obsidian-replayload");
+        ReplayBlock item;
+        while (readQueue.Pop(item)) {
+            if (item.pindex->nHeight > 0) {
+                // The transaction hashes are computed rather than taken from the stored ones,
+                // so that the merkle root check below covers the transaction data.
+                try {
+                    VectorReader(SER_DISK, CLIENT_VERSION, item.raw, 0) >> item.block;
+                } catch (const std::exception& e) {
+                    error("ReplayValidatedBlocks(): Deserialize error %s at %s", e.what(), item.pindex->ToString());
+                    break;
+                }
+                item.raw.clear();
+                item.raw.shrink_to_fit();
+                if (item.block.GetHash() != item.pindex->GetBlockHash()) {
+                    error("ReplayValidatedBlocks(): GetHash() doesn't match index for %s", item.pindex->ToString());
+                    break;
+                }
+                // The header hash does not cover the transactions, and the block is not
+                // validated again, so make sure they are the ones that were.
+                bool mutated;
+                if (BlockMerkleRoot(item.block, &mutated) != item.block.hashMerkleRoot || mutated) {
+                    error("ReplayValidatedBlocks(): merkle root doesn't match block %s", item.pindex->ToString());
+                    break;
+                }
+                bool fUndoMatches = item.undo.vtxundo.size() + 1 == item.block.vtx.size();
+                for (size_t i = 1; fUndoMatches && i < item.block.vtx.size(); i++) {
+                    fUndoMatches = item.undo.vtxundo[i - 1].vprevout.size() == item.block.vtx[i]->vin.size();
+                }
+                if (!fUndoMatches) {
+                    error("ReplayValidatedBlocks(): undo data doesn't match block %s", item.pindex->ToString());
+                    break;
+                }
+            }
+            if (!applyQueue.Push(std::move(item))) break;
+        }
+        applyQueue.Close();
+        readQueue.Close();
+    });
+
+    bool fOk = true;
+    int nReplayed = 0;
+    ReplayBlock item;
+    while (applyQueue.Pop(item)) {
+        if (ShutdownRequested()) break;
+        LOCK(cs_main);
+        if (item.pindex->nHeight > 0) {
+            ApplyValidatedBlock(item.block, item.undo, item.pindex->nHeight, *pcoinsTip);
+        }
+        pcoinsTip->SetBestBlock(item.pindex->GetBlockHash());
+        chainActive.SetTip(const_cast<CBlockIndex*>(item.pindex));
+        nReplayed++;
+        CValidationState state;
+        if (!FlushStateToDisk(chainparams, state, FlushStateMode::PERIODIC)) {
+            fOk = error("ReplayValidatedBlocks(): failed to flush state (%s)", FormatStateMessage(state));
+            break;
+        }
+        if (nReplayed % 10000 == 0) {
+            LogPrintf("Replayed blocks up to height %d\n", item.pindex->nHeight);
+        }
+    }
+
+    {
+        LOCK(cs_main);
+        PruneBlockIndexCandidates();
+        LogPrintf("Replayed %d blocks to height %d in %.2fs\n", nReplayed, chainActive.Height(), (GetTimeMillis() - nStart) * 0.001);
+    }
+    return fOk;
+}
+
+bool ReplayValidatedBlocks(const CChainParams& chainparams, const CBlockIndex* pindexTarget)
+{
+    return g_chainstate.ReplayValidatedBlocks(chainparams, pindexTarget);
+}
+
+const CBlockIndex* GetAssumedValidReplayTarget(const Consensus::Params& params)
+{
+    AssertLockHeld(cs_main);
+    if (hashAssumeValid.IsNull() || pindexBestHeader == nullptr) return nullptr;
+    const CBlockIndex* pindex = LookupBlockIndex(hashAssumeValid);
+    if (pindex == nullptr || pindexBestHeader->GetAncestor(pindex->nHeight) != pindex || pindexBestHeader->nChainWork < nMinimumChainWork) {
+        return nullptr;
+    }
+    // As in ConnectBlock, only blocks buried under two weeks' worth of work skip validation.
+    while (pindex && GetBlockProofEquivalentTime(*pindexBestHeader, *pindex, *pindexBestHeader, params) <= 60 * 60 * 24 * 7 * 2) {
+        pindex = pindex->pprev;
+    }
+    return pindex;
+}
+
 //! Helper for CChainState::RewindBlockIndex
 void CChainState::EraseBlockData(CBlockIndex* index)
 {
@@ -4754,6 +5315,38 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
 
 static const uint64_t MEMPOOL_DUMP_VERSION = 1;
 
+/**
+ * Run the script checks of transactions about to be added to the mempool on the script-checking
+ * threads, so that AcceptToMemoryPool finds their signatures in the signature cache instead of
+ * verifying them one at a time. Transactions whose inputs are not all available yet, such as
+ * children of transactions in the same batch, are left to AcceptToMemoryPool.
+ */
+static void PrecheckMempoolScripts(const std::vector<CTransactionRef>& txs, CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (!nScriptCheckThreads) return;
+
+    // CScriptChecks point into txdata, which must therefore not be reallocated.
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(txs.size());
+    CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+    {
+        LOCK(pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
+        CCoinsViewCache view(&viewMemPool);
+        for (const CTransactionRef& tx : txs) {
+            if (tx->IsCoinBase() || !view.HaveInputs(*tx)) continue;
+            txdata.emplace_back(*tx);
+            std::vector<CScriptCheck> vChecks;
+            CValidationState state;
+            if (CheckInputs(*tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, false, txdata.back(), &vChecks)) {
+                control.Add(vChecks);
+            }
+        }
+    }
+    // Failures are reported by AcceptToMemoryPool.
+    control.Wait();
+}
+
 bool LoadMempool()
 {
     const CChainParams& chainparams = Params();
@@ -4771,6 +5364,13 @@ bool LoadMempool()
     int64_t already_there = 0;
     int64_t nNow = GetTime();
 
+    // Transactions to add, in order, and the positions of those not removed by the journal.
+    std::vector<std::pair<CTransactionRef, int64_t>> txs;
+    std::map<uint256, size_t> tx_positions;
+    std::map<uint256, CAmount> mapDeltas;
+    uint64_t journal_id = 0;
+    uint64_t journal_offset = 0;
+
     try {
         uint64_t version;
         file >> version;
@@ -4787,44 +5387,119 @@ bool LoadMempool()
             file >> nTime;
             file >> nFeeDelta;
 
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+            if (nFeeDelta) {
+                mapDeltas[tx->GetHash()] = nFeeDelta;
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                                           false /* test_accept */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (mempool.exists(tx->GetHash())) {
-                        ++already_there;
-                    } else {
-                        ++failed;
-                    }
+            tx_positions[tx->GetHash()] = txs.size();
+            txs.emplace_back(std::move(tx), nTime);
+        }
+        std::map<uint256, CAmount> mapDumpedDeltas;
+        file >> mapDumpedDeltas;
+        mapDeltas.insert(mapDumpedDeltas.begin(), mapDumpedDeltas.end());
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    try {
+        // Dumps written without a journal, or by older versions, end here.
+        file >> journal_id;
+        file >> journal_offset;
+    } catch (const std::exception&) {
+        journal_id = 0;
+    }
+
+    std::vector<MempoolJournalRecord> records;
+    if (ReadMempoolJournal(GetDataDir() / "mempool.journal", journal_id, journal_offset, records)) {
+        for (MempoolJournalRecord& record : records) {
+            switch (record.type) {
+            case MempoolJournalRecord::ADD: {
+                auto it = tx_positions.find(record.txid);
+                if (it != tx_positions.end()) {
+                    txs[it->second].first = nullptr;
                 }
+                tx_positions[record.txid] = txs.size();
+                txs.emplace_back(std::move(record.tx), record.time);
+                break;
+            }
+            case MempoolJournalRecord::REMOVE: {
+                auto it = tx_positions.find(record.txid);
+                if (it != tx_positions.end()) {
+                    txs[it->second].first = nullptr;
+                    tx_positions.erase(it);
+                }
+                if (record.for_block) {
+                    mapDeltas.erase(record.txid);
+                }
+                break;
+            }
+            case MempoolJournalRecord::PRIORITISE:
+                mapDeltas[record.txid] = record.delta;
+                break;
+            }
+        }
+        LogPrintf("Replayed %u records from the mempool journal\n", records.size());
+    }
+
+    for (const auto& i : mapDeltas) {
+        mempool.PrioritiseTransaction(i.first, i.second);
+    }
+
+    // Transactions whose inputs were missing, likely because a parent came later in the journal;
+    // they are tried once more at the end.
+    std::vector<std::pair<CTransactionRef, int64_t>> retry;
+    auto accept = [&](const std::pair<CTransactionRef, int64_t>& entry, bool can_retry) {
+        AssertLockHeld(cs_main);
+        CValidationState state;
+        bool missing_inputs = false;
+        AcceptToMemoryPoolWithTime(chainparams, mempool, state, entry.first, &missing_inputs, entry.second,
+                                   nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
+                                   false /* test_accept */);
+        if (state.IsValid() && !missing_inputs) {
+            ++count;
+        } else {
+            // mempool may contain the transaction already, e.g. from
+            // wallet(s) having loaded it while we were processing
+            // mempool transactions; consider these as valid, instead of
+            // failed, but mark them as 'already there'
+            if (mempool.exists(entry.first->GetHash())) {
+                ++already_there;
+            } else if (missing_inputs && can_retry) {
+                retry.push_back(entry);
             } else {
-                ++expired;
+                ++failed;
             }
-            if (ShutdownRequested())
-                return false;
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
+    };
 
-        for (const auto& i : mapDeltas) {
-            mempool.PrioritiseTransaction(i.first, i.second);
+    // Add the transactions in batches, checking the scripts of each batch in parallel first.
+    std::vector<CTransactionRef> batch;
+    for (size_t begin = 0; begin < txs.size(); begin += MEMPOOL_LOAD_BATCH_SIZE) {
+        const size_t end = std::min(txs.size(), begin + MEMPOOL_LOAD_BATCH_SIZE);
+        batch.clear();
+        for (size_t i = begin; i < end; ++i) {
+            if (!txs[i].first) continue;
+            if (txs[i].second + nExpiryTimeout > nNow) {
+                batch.push_back(txs[i].first);
+            } else {
+                txs[i].first = nullptr;
+                ++expired;
+            }
+        }
+        {
+            LOCK(cs_main);
+            PrecheckMempoolScripts(batch, mempool);
+            for (size_t i = begin; i < end; ++i) {
+                if (txs[i].first) accept(txs[i], true);
+            }
+        }
+        if (ShutdownRequested())
+            return false;
+    }
+    {
+        LOCK(cs_main);
+        for (const auto& entry : retry) {
+            accept(entry, false);
         }
-    } catch (const std::exception& e) {
-        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
-        return false;
     }
 
     LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
@@ -4832,6 +5507,14 @@ bool LoadMempool()
 }
 
 bool DumpMempool()
+{
+    if (g_mempool_journal) {
+        return g_mempool_journal->Compact();
+    }
+    return DumpMempool(0, 0);
+}
+
+bool DumpMempool(uint64_t journal_id, uint64_t journal_offset)
 {
     int64_t start = GetTimeMicros();
 
@@ -4871,6 +5554,9 @@ bool DumpMempool()
         }
 
         file << mapDeltas;
+        // Older versions stop reading here.
+        file << journal_id;
+        file << journal_offset;
         if (!FileCommit(file.Get()))
             throw std::runtime_error("FileCommit failed");
         file.fclose();
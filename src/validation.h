@@ -33,12 +33,14 @@
 #include <atomic>
 
 class CBlockIndex;
+class CBlockUndo;
 class CBlockTreeDB;
 class CChainParams;
 class CCoinsViewDB;
 class CInv;
 class CConnman;
 class CScriptCheck;
+class SignatureBatch;
 class CBlockPolicyEstimator;
 class CTxMemPool;
 class CValidationState;
@@ -67,6 +69,8 @@ static const unsigned int DEFAULT_ANCESTOR_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 /** Default for -limitdescendantsize, maximum kilobytes of in-mempool descendants */
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
+/** Default for -limitclustercount, max number of transactions in a mempool cluster with -clustermempool */
+static const unsigned int DEFAULT_CLUSTER_LIMIT = 100;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 336;
 /** Maximum kilobytes for transactions to store for processing during reorg */
@@ -82,8 +86,18 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Transactions with at least this many inputs have their script checks spread over the script-checking threads on mempool acceptance */
+static const unsigned int MEMPOOL_PARALLEL_SCRIPT_CHECK_MIN_INPUTS = 4;
+/** Number of buckets in the mempool acceptance latency histograms */
+static const int MEMPOOL_ACCEPT_LATENCY_BUCKETS = 24;
+/** Number of transactions whose scripts are checked together when loading the mempool from disk */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 256;
+/** Number of blocks that can be requested at any given time from a single peer, until we have measured
+ *  its delivery rate and can size its in-flight window adaptively. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
+/** Bounds on the adaptive per-peer in-flight window derived from measured block delivery rate and RTT. */
+static const int MIN_BLOCKS_IN_TRANSIT_PER_PEER = 4;
+static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER_ADAPTIVE = 128;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
@@ -96,8 +110,8 @@ static const int MAX_CMPCTBLOCK_DEPTH = 5;
 static const int MAX_BLOCKTXN_DEPTH = 10;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
- *  degree of disordering of blocks on disk (which make reindexing and pruning harder). We'll probably
- *  want to make this a per-peer adaptive value at some point. */
+ *  degree of disordering of blocks on disk (which make reindexing and pruning harder). The number of
+ *  blocks in flight per peer inside this window is adaptive, see MIN/MAX_BLOCKS_IN_TRANSIT_PER_PEER. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
@@ -118,9 +132,14 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_STORE_TX_HASHES = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistscriptcache */
+static const bool DEFAULT_PERSIST_SCRIPT_CACHE = false;
+/** Default for -reindexreplay */
+static const bool DEFAULT_REINDEX_REPLAY = true;
 /** Default for -mempoolreplacement */
 static const bool DEFAULT_ENABLE_REPLACEMENT = false;
 /** Default for using fee filter */
@@ -162,6 +181,8 @@ extern int nScriptCheckThreads;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
+/** Whether the transaction hashes of connected blocks are stored, and used when reading them */
+extern bool fStoreTxHashes;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
@@ -306,6 +327,27 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee, bool test_accept=false) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+/** How long AcceptToMemoryPool calls have taken since startup */
+struct MempoolAcceptLatencyStats {
+    struct Histogram {
+        uint64_t count;
+        int64_t total_micros;
+        /** Bucket i counts durations below 2^i microseconds not counted in an earlier bucket; the
+         *  last bucket also counts everything longer. */
+        uint64_t buckets[MEMPOOL_ACCEPT_LATENCY_BUCKETS];
+    };
+    //! Calls that accepted the transaction
+    Histogram accepted;
+    //! Calls that did not
+    Histogram rejected;
+    //! Script verification, for transactions that got that far
+    Histogram script_checks;
+};
+
+MempoolAcceptLatencyStats GetMempoolAcceptLatencyStats();
+/** The MempoolAcceptLatencyStats::Histogram bucket a duration of micros is counted in. */
+int GetMempoolAcceptLatencyBucket(int64_t micros);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -373,6 +415,15 @@ public:
 
     bool operator()();
 
+    /**
+     * Whether RunBatched collects the signatures the script actually checks. Not so for scripts
+     * that may run CHECKMULTISIG, which tries keys until one matches each signature.
+     */
+    bool CanBatch() const;
+
+    /** Run the script taking the signatures in it to be valid, and collect them into batch. See RunChecks. */
+    bool RunBatched(SignatureBatch& batch);
+
     void swap(CScriptCheck &check) {
         std::swap(ptxTo, check.ptxTo);
         std::swap(m_tx_out, check.m_tx_out);
@@ -386,16 +437,41 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+/**
+ * Run a batch of script checks, as a script-checking thread does, returning whether
+ * they all pass. The scripts are run taking their signatures to be valid, and the
+ * signatures are then verified together, which is faster than one by one. Only the
+ * checks that fail that way, or have a signature that turns out invalid, are run
+ * again on their own to find out whether they actually fail. Checks that cannot be
+ * batched are only run on their own.
+ */
+bool RunChecks(std::vector<CScriptCheck>& checks);
+
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
+/** Dump the script-execution cache, with its nonce and the script flags of the next block, to disk. */
+bool DumpScriptExecutionCache();
+
+/** Load the script-execution cache from disk, if it was dumped for the script flags of the next block. */
+bool LoadScriptExecutionCache();
+
 
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/**
+ * Reads the block of pindex like ReadBlockFromDisk, but with -storetxhashes takes the hashes of its
+ * transactions from those stored when it was connected, if there are any, instead of computing
+ * them. The transactions are not checked against those hashes, so this is only for blocks that are
+ * served, indexed or rescanned, never for blocks being validated, connected or disconnected.
+ */
+bool ReadBlockFromDiskWithStoredTxHashes(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
+
 /** Functions for validating blocks and updating the block tree */
 
 /** Context-independent validity checks */
@@ -430,6 +506,22 @@ public:
 /** Replay blocks that aren't fully applied to the database. */
 bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
 
+/**
+ * Connect the blocks from the tip up to pindexTarget by only applying their changes to
+ * the UTXO set, with the spent coins taken from their undo data. Blocks are read and
+ * deserialized ahead on other threads. Stops before any block that was not fully
+ * validated before, leaving it to be connected normally. Validation interface
+ * subscribers are not notified of the replayed blocks.
+ */
+bool ReplayValidatedBlocks(const CChainParams& chainparams, const CBlockIndex* pindexTarget) LOCKS_EXCLUDED(cs_main);
+
+/**
+ * The last block that -reindex-chainstate may replay without validating: the last
+ * ancestor of the -assumevalid block that ConnectBlock would skip the scripts of.
+ * Returns nullptr if there is none.
+ */
+const CBlockIndex* GetAssumedValidReplayTarget(const Consensus::Params& params) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 inline CBlockIndex* LookupBlockIndex(const uint256& hash)
 {
     AssertLockHeld(cs_main);
@@ -490,10 +582,16 @@ static const unsigned int REJECT_HIGHFEE = 0x100;
 /** Get block file info entry for one block file */
 CBlockFileInfo* GetBlockFileInfo(size_t n);
 
-/** Dump the mempool to disk. */
+/** Dump the mempool to disk. With the mempool journal running, this also starts a new journal. */
 bool DumpMempool();
 
-/** Load the mempool from disk. */
+/**
+ * Dump the mempool to disk, to be continued on loading by the records of the mempool journal with
+ * the given id from the given offset on. An id of 0 means no journal.
+ */
+bool DumpMempool(uint64_t journal_id, uint64_t journal_offset);
+
+/** Load the mempool from disk, replaying the mempool journal that continues the dump, if any. */
 bool LoadMempool();
 
 //! Check whether the block associated with this index entry is pruned or not.
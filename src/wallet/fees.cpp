@@ -57,8 +57,13 @@ CFeeRate GetMinimumFeeRate(const CWallet& wallet, const CCoinControl& coin_contr
         // Allow to override the default fee estimate mode over the CoinControl instance
         if (coin_control.m_fee_mode == FeeEstimateMode::CONSERVATIVE) conservative_estimate = true;
         else if (coin_control.m_fee_mode == FeeEstimateMode::ECONOMICAL) conservative_estimate = false;
+        else if (coin_control.m_fee_mode == FeeEstimateMode::MEMPOOL) conservative_estimate = false;
 
-        feerate_needed = estimator.estimateSmartFee(target, feeCalc, conservative_estimate);
+        if (coin_control.m_fee_mode == FeeEstimateMode::MEMPOOL) {
+            feerate_needed = estimator.estimateSmartFeeWithMempool(target, feeCalc, conservative_estimate, pool);
+        } else {
+            feerate_needed = estimator.estimateSmartFee(target, feeCalc, conservative_estimate);
+        }
         if (feerate_needed == CFeeRate(0)) {
             // if we don't have enough data for estimateSmartFee, then use fallback fee
             feerate_needed = wallet.m_fallback_fee;
@@ -377,7 +377,8 @@ static UniValue sendtoaddress(const JSONRPCRequest& request)
                     {"estimate_mode", RPCArg::Type::STR, /* default */ "UNSET", "The fee estimate mode, must be one of:\n"
             "       \"UNSET\"\n"
             "       \"ECONOMICAL\"\n"
-            "       \"CONSERVATIVE\""},
+            "       \"CONSERVATIVE\"\n"
+            "       \"MEMPOOL\""},
                 },
                 RPCResult{
             "\"txid\"                  (string) The transaction id.\n"
@@ -836,7 +837,8 @@ static UniValue sendmany(const JSONRPCRequest& request)
                     {"estimate_mode", RPCArg::Type::STR, /* default */ "UNSET", "The fee estimate mode, must be one of:\n"
             "       \"UNSET\"\n"
             "       \"ECONOMICAL\"\n"
-            "       \"CONSERVATIVE\""},
+            "       \"CONSERVATIVE\"\n"
+            "       \"MEMPOOL\""},
                 },
                  RPCResult{
             "\"txid\"                   (string) The transaction id for the send. Only 1 transaction is created regardless of \n"
@@ -3084,7 +3086,8 @@ static UniValue fundrawtransaction(const JSONRPCRequest& request)
                             {"estimate_mode", RPCArg::Type::STR, /* default */ "UNSET", "The fee estimate mode, must be one of:\n"
                             "         \"UNSET\"\n"
                             "         \"ECONOMICAL\"\n"
-                            "         \"CONSERVATIVE\""},
+                            "         \"CONSERVATIVE\"\n"
+                            "         \"MEMPOOL\""},
                         },
                         "options"},
                     {"iswitness", RPCArg::Type::BOOL, /* default */ "depends on heuristic tests", "Whether the transaction hex is a serialized witness transaction.\n"
@@ -3259,7 +3262,8 @@ static UniValue bumpfee(const JSONRPCRequest& request)
                             {"estimate_mode", RPCArg::Type::STR, /* default */ "UNSET", "The fee estimate mode, must be one of:\n"
             "         \"UNSET\"\n"
             "         \"ECONOMICAL\"\n"
-            "         \"CONSERVATIVE\""},
+            "         \"CONSERVATIVE\"\n"
+            "         \"MEMPOOL\""},
                         },
                         "options"},
                 },
@@ -4093,7 +4097,8 @@ UniValue walletcreatefundedpsbt(const JSONRPCRequest& request)
                             {"estimate_mode", RPCArg::Type::STR, /* default */ "UNSET", "The fee estimate mode, must be one of:\n"
                             "         \"UNSET\"\n"
                             "         \"ECONOMICAL\"\n"
-                            "         \"CONSERVATIVE\""},
+                            "         \"CONSERVATIVE\"\n"
+                            "         \"MEMPOOL\""},
                         },
                         "options"},
                     {"bip32derivs", RPCArg::Type::BOOL, /* default */ "false", "If true, includes the BIP 32 derivation paths for public keys if we know them"},
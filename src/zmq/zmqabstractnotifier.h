@@ -42,6 +42,8 @@ public:
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    /** Called after transactions have entered or left the mempool. */
+    virtual bool NotifyMempoolChanged();
 
 protected:
     void *psocket;
@@ -5,6 +5,7 @@
 #include <chain.h>
 #include <chainparams.h>
 #include <streams.h>
+#include <txmempool.h>
 #include <zmq/zmqpublishnotifier.h>
 #include <validation.h>
 #include <util/system.h>
@@ -16,6 +17,7 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_SEQUENCE  = "sequence";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -186,7 +188,7 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
     {
         LOCK(cs_main);
         CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
+        if(!ReadBlockFromDiskWithStoredTxHashes(block, pindex, consensusParams))
         {
             zmqError("Can't read block from disk");
             return false;
@@ -206,3 +208,22 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishSequenceNotifier::NotifyMempoolChanged()
+{
+    std::vector<MempoolDelta> deltas;
+    // Changes that are no longer available are skipped, leaving a gap in the sequence numbers.
+    mempool.GetDeltas(m_mempool_sequence, deltas);
+    for (const MempoolDelta& delta : deltas) {
+        LogPrint(BCLog::ZMQ, "zmq: Publish sequence %s %s %d\n", delta.txid.GetHex(), delta.added ? "added" : "removed", delta.sequence);
+        /* 32 byte hash, 'A' for added or 'R' for removed, LE 8 byte mempool sequence number */
+        unsigned char data[32 + 1 + sizeof(uint64_t)];
+        for (unsigned int i = 0; i < 32; i++)
+            data[31 - i] = delta.txid.begin()[i];
+        data[32] = delta.added ? 'A' : 'R';
+        WriteLE64(&data[33], delta.sequence);
+        if (!SendMessage(MSG_SEQUENCE, data, sizeof(data))) return false;
+        m_mempool_sequence = delta.sequence;
+    }
+    return true;
+}
@@ -52,4 +52,16 @@ public:
     bool NotifyTransaction(const CTransaction &transaction) override;
 };
 
+/** Publishes every addition to and removal from the mempool, with its mempool sequence number,
+ *  in order. A gap in those numbers means changes were missed, and getrawmempool is needed to
+ *  catch up. */
+class CZMQPublishSequenceNotifier : public CZMQAbstractPublishNotifier
+{
+private:
+    uint64_t m_mempool_sequence{0}; //!< mempool sequence number of the last change published
+
+public:
+    bool NotifyMempoolChanged() override;
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H